@@ -0,0 +1,4 @@
+// the fragment shader of the depth pre-pass. Only the depth is written.
+void main()
+{
+}
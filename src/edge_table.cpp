@@ -0,0 +1,256 @@
+#include "edge_table.hpp"
+#include "thread_pool.hpp"
+#include "unique_ids.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+static inline uint32_t NextPowerOfTwo(size_t n) {
+    uint32_t p = 1;
+    while(p < n)
+	p *= 2;
+    return p;
+}
+
+static inline uint32_t HashPosition(const float* p) {
+    uint32_t bits[3];
+    memcpy(bits, p, sizeof(bits));
+    return HashEdge(bits[0] ^ (bits[2] * 0xC2B2AE35u), bits[1]);
+}
+
+/*
+  Every side of every triangle, as the vertices a < b, both as vertex
+  indices and as ids of their positions. The vertices with the same
+  position are the same vertex, as far as edges are concerned. Returns
+  false if a triangle uses a vertex that does not exist.
+*/
+static bool FindSides(
+    const float* positions,
+    size_t numVertices,
+    const unsigned int* indices,
+    const ObjShape* shapes,
+    size_t numShapes,
+    std::vector<uint32_t>& positionIds,
+    std::vector<uint32_t>& sides,
+    std::vector<uint32_t>& sidePositions) {
+
+    positionIds.resize(numVertices);
+    std::vector<uint32_t> firstVertex;
+    AssignUniqueIds(numVertices,
+		    [&](size_t v) { return HashPosition(&positions[3 * v]); },
+		    [&](size_t v, size_t w) { return memcmp(&positions[3 * v], &positions[3 * w], 3 * sizeof(float)) == 0; },
+		    positionIds.data(), firstVertex);
+
+    std::vector<size_t> shapeFirstSide(numShapes + 1, 0);
+    for(size_t s = 0; s < numShapes; ++s)
+	shapeFirstSide[s + 1] = shapeFirstSide[s] + shapes[s].numIndices / 3 * 3;
+
+    size_t numSides = shapeFirstSide[numShapes];
+    sides.resize(2 * numSides);
+    sidePositions.resize(2 * numSides);
+
+    std::atomic<bool> ok(true);
+    GetThreadPool().ParallelFor(numShapes, [&](size_t s) {
+	    const ObjShape& shape = shapes[s];
+	    const unsigned int* shapeIndices = indices + shape.firstIndex;
+	    size_t side = shapeFirstSide[s];
+
+	    for(size_t t = 0; t < shape.numIndices / 3; ++t) {
+		for(int k = 0; k < 3; ++k, ++side) {
+		    uint32_t a = shape.baseVertex + shapeIndices[3 * t + k];
+		    uint32_t b = shape.baseVertex + shapeIndices[3 * t + (k + 1) % 3];
+		    if(a >= numVertices || b >= numVertices) {
+			ok = false;
+			a = b = 0;
+		    }
+		    sides[2 * side + 0] = std::min(a, b);
+		    sides[2 * side + 1] = std::max(a, b);
+		    sidePositions[2 * side + 0] = std::min(positionIds[a], positionIds[b]);
+		    sidePositions[2 * side + 1] = std::max(positionIds[a], positionIds[b]);
+		}
+	    }
+	});
+    return ok;
+}
+
+void BuildEdges(
+    const float* positions,
+    size_t numVertices,
+    const unsigned int* indices,
+    const ObjShape* shapes,
+    size_t numShapes,
+    std::vector<uint32_t>& edges) {
+
+    std::vector<uint32_t> positionIds;
+    std::vector<uint32_t> sides;
+    std::vector<uint32_t> sidePositions;
+    FindSides(positions, numVertices, indices, shapes, numShapes, positionIds, sides, sidePositions);
+
+    // the edges are the unique pairs of positions.
+    size_t numSides = sides.size() / 2;
+    std::vector<uint32_t> sideEdges(numSides);
+    std::vector<uint32_t> firstSide;
+    size_t numEdges = AssignUniqueIds(numSides,
+				      [&](size_t i) { return HashEdge(sidePositions[2 * i], sidePositions[2 * i + 1]); },
+				      [&](size_t i, size_t j) {
+					  return sidePositions[2 * i] == sidePositions[2 * j] && sidePositions[2 * i + 1] == sidePositions[2 * j + 1];
+				      },
+				      sideEdges.data(), firstSide);
+
+    edges.resize(2 * numEdges);
+    for(size_t e = 0; e < numEdges; ++e) {
+	edges[2 * e + 0] = sides[2 * (size_t)firstSide[e] + 0];
+	edges[2 * e + 1] = sides[2 * (size_t)firstSide[e] + 1];
+    }
+}
+
+bool BuildEdgeTable(
+    const float* positions,
+    size_t numVertices,
+    const unsigned int* indices,
+    const ObjShape* shapes,
+    size_t numShapes,
+    const uint32_t* edges,
+    size_t numEdges,
+    std::vector<EdgeTableEntry>& table) {
+
+    std::vector<uint32_t> positionIds;
+    std::vector<uint32_t> sides;
+    std::vector<uint32_t> sidePositions;
+    if(!FindSides(positions, numVertices, indices, shapes, numShapes, positionIds, sides, sidePositions))
+	return false;
+
+    //
+    // The table has one entry per unique pair of vertices,
+    //
+    size_t numSides = sides.size() / 2;
+    std::vector<uint32_t> sideKeys(numSides);
+    std::vector<uint32_t> keySide;
+    size_t numKeys = AssignUniqueIds(numSides,
+				     [&](size_t i) { return HashEdge(sides[2 * i], sides[2 * i + 1]); },
+				     [&](size_t i, size_t j) { return sides[2 * i] == sides[2 * j] && sides[2 * i + 1] == sides[2 * j + 1]; },
+				     sideKeys.data(), keySide);
+
+    //
+    // that points to the edge of their positions. The pairs of positions of
+    // the edges come first, so the lowest pair with the same id as that of
+    // an entry is its edge.
+    //
+    std::vector<uint32_t> pairs(2 * (numEdges + numKeys));
+    for(size_t e = 0; e < numEdges; ++e) {
+	uint32_t a = positionIds[edges[2 * e + 0]];
+	uint32_t b = positionIds[edges[2 * e + 1]];
+	pairs[2 * e + 0] = std::min(a, b);
+	pairs[2 * e + 1] = std::max(a, b);
+    }
+    for(size_t k = 0; k < numKeys; ++k) {
+	pairs[2 * (numEdges + k) + 0] = sidePositions[2 * (size_t)keySide[k] + 0];
+	pairs[2 * (numEdges + k) + 1] = sidePositions[2 * (size_t)keySide[k] + 1];
+    }
+
+    std::vector<uint32_t> pairIds(numEdges + numKeys);
+    std::vector<uint32_t> firstPair;
+    AssignUniqueIds(numEdges + numKeys,
+		    [&](size_t i) { return HashEdge(pairs[2 * i], pairs[2 * i + 1]); },
+		    [&](size_t i, size_t j) { return pairs[2 * i] == pairs[2 * j] && pairs[2 * i + 1] == pairs[2 * j + 1]; },
+		    pairIds.data(), firstPair);
+
+    std::vector<std::vector<uint32_t> > regionKeys(EDGE_TABLE_REGIONS);
+    for(size_t k = 0; k < numKeys; ++k) {
+	const uint32_t* side = &sides[2 * (size_t)keySide[k]];
+	regionKeys[HashEdge(side[0], side[1]) >> EDGE_TABLE_REGION_SHIFT].push_back((uint32_t)k);
+    }
+
+    // the fullest region is at most 80% full, so that the probe sequences stay short.
+    size_t largestRegion = 0;
+    for(int r = 0; r < EDGE_TABLE_REGIONS; ++r)
+	largestRegion = std::max(largestRegion, regionKeys[r].size());
+    uint32_t regionSize = NextPowerOfTwo(largestRegion + largestRegion / 4 + 1);
+
+    EdgeTableEntry empty = { EDGE_TABLE_EMPTY, EDGE_TABLE_EMPTY, EDGE_TABLE_EMPTY };
+    table.assign((size_t)EDGE_TABLE_REGIONS * regionSize, empty);
+
+    GetThreadPool().ParallelFor(EDGE_TABLE_REGIONS, [&](size_t r) {
+	    EdgeTableEntry* region = &table[r * regionSize];
+	    for(size_t i = 0; i < regionKeys[r].size(); ++i) {
+		uint32_t key = regionKeys[r][i];
+		uint32_t a = sides[2 * (size_t)keySide[key] + 0];
+		uint32_t b = sides[2 * (size_t)keySide[key] + 1];
+
+		uint32_t slot = HashEdge(a, b) & (regionSize - 1);
+		while(region[slot].a != EDGE_TABLE_EMPTY)
+		    slot = (slot + 1) & (regionSize - 1);
+
+		// the edges are from the mesh cache, so a side may have none if it is broken.
+		uint32_t edge = firstPair[pairIds[numEdges + key]];
+		region[slot].a = a;
+		region[slot].b = b;
+		region[slot].edge = edge < numEdges ? edge : EDGE_TABLE_EMPTY;
+	    }
+	});
+    return true;
+}
+
+uint32_t FindEdge(const EdgeTableEntry* table, size_t tableSize, uint32_t a, uint32_t b) {
+    uint32_t lo = std::min(a, b);
+    uint32_t hi = std::max(a, b);
+    uint32_t hash = HashEdge(lo, hi);
+
+    uint32_t regionSize = (uint32_t)(tableSize / EDGE_TABLE_REGIONS);
+    const EdgeTableEntry* region = table + (size_t)(hash >> EDGE_TABLE_REGION_SHIFT) * regionSize;
+    uint32_t slot = hash & (regionSize - 1);
+    for(uint32_t i = 0; i < regionSize; ++i) {
+	if(region[slot].a == lo && region[slot].b == hi)
+	    return region[slot].edge;
+	if(region[slot].a == EDGE_TABLE_EMPTY)
+	    break;
+	slot = (slot + 1) & (regionSize - 1);
+    }
+    return EDGE_TABLE_EMPTY;
+}
+
+// the edges are handled in blocks of this many, in parallel.
+static const size_t EDGE_LEVEL_BLOCK_SIZE = 16 * 1024;
+
+void ComputeEdgeTessLevels(
+    const uint32_t* edges,
+    size_t numEdges,
+    const float* positions,
+    const float* viewProjection,
+    float width,
+    float height,
+    float pixelsPerSegment,
+    float maxLevel,
+    float* levels) {
+
+    const float* m = viewProjection;
+    size_t numBlocks = (numEdges + EDGE_LEVEL_BLOCK_SIZE - 1) / EDGE_LEVEL_BLOCK_SIZE;
+
+    GetThreadPool().ParallelFor(numBlocks, [&](size_t b) {
+	    size_t end = std::min((b + 1) * EDGE_LEVEL_BLOCK_SIZE, numEdges);
+	    for(size_t e = b * EDGE_LEVEL_BLOCK_SIZE; e < end; ++e) {
+		float screen[2][2];
+		bool behind = false;
+		for(int k = 0; k < 2; ++k) {
+		    const float* p = positions + 3 * (size_t)edges[2 * e + k];
+		    float x = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+		    float y = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+		    float w = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+		    behind = behind || w <= 0.0f;
+		    screen[k][0] = 0.5f * width * x / w;
+		    screen[k][1] = 0.5f * height * y / w;
+		}
+
+		float level = maxLevel;
+		if(!behind) {
+		    float dx = screen[1][0] - screen[0][0];
+		    float dy = screen[1][1] - screen[0][1];
+		    level = std::sqrt(dx * dx + dy * dy) / pixelsPerSegment;
+		    level = std::min(std::max(level, 1.0f), maxLevel);
+		}
+		levels[e] = level;
+	    }
+	});
+}
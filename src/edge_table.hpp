@@ -0,0 +1,100 @@
+#pragma once
+
+#include "obj_loader.hpp"
+
+#include <vector>
+#include <stdint.h>
+
+/*
+  Ids for the edges of a mesh, that two triangles agree on as long as they
+  share the positions of the edge, even across seams and shapes, and across
+  the LODs of mesh_lod.hpp.
+
+  The tessellation control shader looks up the ids of its edges by the
+  vertices of the patch, in a hash table that is uploaded as a buffer
+  texture. Anything that is stored per edge id, like a tessellation level,
+  is then the same on both sides of the edge, so no cracks open up.
+
+  Only the edges are stored in the mesh cache. The hash table is several
+  times their size, so it is built from them when the model is loaded.
+*/
+
+// the hash table is split into this many regions, that are built in parallel.
+// Must match EDGE_TABLE_REGION_SHIFT and findEdge() in shader_common.
+static const int EDGE_TABLE_REGIONS = 64;
+static const int EDGE_TABLE_REGION_SHIFT = 26;
+
+// the vertex of empty entries, and the id findEdge() returns for an edge it does not know.
+static const uint32_t EDGE_TABLE_EMPTY = 0xFFFFFFFF;
+
+/*
+  An entry of the hash table, that maps the vertices a < b of an edge to its
+  id. It is one texel of a GL_RGB32UI buffer texture.
+*/
+struct EdgeTableEntry {
+    uint32_t a;
+    uint32_t b;
+    uint32_t edge;
+};
+
+// the hash of the edge between the vertices a < b, the same as hashEdge() in shader_common.
+inline uint32_t HashEdge(uint32_t a, uint32_t b) {
+    uint32_t h = (a * 0x9E3779B1u) ^ (b * 0x85EBCA77u);
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+/*
+  Find the edges of all the shapes, in parallel. Every edge gets an id
+  below edges.size() / 2, and edges[2 * id] and edges[2 * id + 1] are the
+  vertices of one of the triangles that have it.
+*/
+void BuildEdges(
+    const float* positions,
+    size_t numVertices,
+    const unsigned int* indices,
+    const ObjShape* shapes,
+    size_t numShapes,
+    std::vector<uint32_t>& edges);
+
+/*
+  Build the hash table from the vertex indices of the triangles, with the
+  baseVertex of the shape added, to the ids of the numEdges edges that
+  BuildEdges() found for the same shapes. Its size is EDGE_TABLE_REGIONS
+  times a power of two. Returns false if a triangle uses a vertex that
+  does not exist, since they come from the mesh cache.
+*/
+bool BuildEdgeTable(
+    const float* positions,
+    size_t numVertices,
+    const unsigned int* indices,
+    const ObjShape* shapes,
+    size_t numShapes,
+    const uint32_t* edges,
+    size_t numEdges,
+    std::vector<EdgeTableEntry>& table);
+
+// the id of the edge between the vertices a and b, or EDGE_TABLE_EMPTY if there is none.
+uint32_t FindEdge(const EdgeTableEntry* table, size_t tableSize, uint32_t a, uint32_t b);
+
+/*
+  The tessellation level of every edge, so that it is cut into pieces of
+  about pixelsPerSegment pixels on screen, with the column-major
+  viewProjection matrix and a viewport of width by height pixels. The levels
+  are between 1 and maxLevel, and edges that reach behind the camera get
+  maxLevel.
+*/
+void ComputeEdgeTessLevels(
+    const uint32_t* edges,
+    size_t numEdges,
+    const float* positions,
+    const float* viewProjection,
+    float width,
+    float height,
+    float pixelsPerSegment,
+    float maxLevel,
+    float* levels);
@@ -0,0 +1,6 @@
+// a triangle that covers the whole viewport, made from gl_VertexID alone. Draw it with three vertices.
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(2.0 * p - 1.0, 0.0, 1.0);
+}
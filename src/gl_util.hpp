@@ -193,6 +193,25 @@ inline GLuint LoadNormalShader(const std::string& vsSource, const std::string& f
     return shader;
 }
 
+/*
+  Replace buffer with a bigger one, that starts with the first oldSize bytes of
+  the old buffer. The copy happens on the GPU.
+*/
+inline void ResizeBuffer(GLuint& buffer, GLsizeiptr oldSize, GLsizeiptr newSize) {
+    GLuint newBuffer;
+    GL_C(glGenBuffers(1, &newBuffer));
+    GL_C(glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer));
+    GL_C(glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, GL_STATIC_DRAW));
+
+    if(oldSize > 0) {
+	GL_C(glBindBuffer(GL_COPY_READ_BUFFER, buffer));
+	GL_C(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize));
+    }
+
+    GL_C(glDeleteBuffers(1, &buffer));
+    buffer = newBuffer;
+}
+
 class GpuProfiler
 {
 public:
@@ -205,6 +224,8 @@ public:
     inline void EndFrame (); // call at the end of a frame.
 
     inline float GetAverageTime (){ return averageTime; }
+    // of the frame that was last collected, which is two frames behind.
+    inline float GetLastTime (){ return m_lastTime; }
 
 protected:
     int m_iFrameQuery;
@@ -213,6 +234,7 @@ protected:
     GLuint m_queries[2];
 
     float averageTime;
+    float m_lastTime;
 
     float m_totalAverage;
     int m_frameCountAverage;
@@ -223,6 +245,7 @@ protected:
 inline GpuProfiler::GpuProfiler ()
     :	m_iFrameQuery(0),
 	m_iFrameCollect(-1),
+	m_lastTime(0.0f),
 	m_frameCountAverage(0),
 	m_begAverage(0.0f) {
     GL_C(glGenQueries(1,&m_queries[0] ));
@@ -264,7 +287,8 @@ inline void GpuProfiler::EndFrame ()
     glGetQueryObjectui64v(m_queries[iFrame],
 			  GL_QUERY_RESULT, &timerResult);
 
-    m_totalAverage += float(timerResult) / (1000.0f * 1000.0f );
+    m_lastTime = float(timerResult) / (1000.0f * 1000.0f );
+    m_totalAverage += m_lastTime;
 
     ++m_frameCountAverage;
 
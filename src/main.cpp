@@ -13,11 +13,22 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-/*
-  TINY OBJ
-*/
-#define TINYOBJLOADER_IMPLEMENTATION // define this in only *one* .cc
-#include "tiny_obj_loader.h"
+#include "obj_loader.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_stream.hpp"
+#include "mesh_gen.hpp"
+#include "teapot_patches.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_lod.hpp"
+#include "meshlet_cull.hpp"
+#include "edge_table.hpp"
+#include "thread_pool.hpp"
+#include "noise.hpp"
+#include "noise_check.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 using std::string;
 using std::vector;
@@ -29,17 +40,121 @@ using glm::vec3;
 
 
 struct Mesh {
-    std::vector<float> vertices;
-    std::vector<float> normals;
-    std::vector<GLuint> faces;
+    // the vertices, normals and faces. Mapped from the mesh cache file,
+    // or built in memory the first time the .obj is loaded.
+    MeshCache data;
 
     GLuint indexVbo;
     GLuint vertexVbo;
     GLuint normalVbo;
+
+    // the shapes that can be drawn. While the model is streamed in, this is
+    // only the part of it that has been uploaded.
+    std::vector<ObjShape> shapes;
+
+    // once the model is in the cache, it is drawn as these small clusters instead of as whole shapes.
+    std::vector<Meshlet> meshlets;
+
+    // the meshlets of every LOD are a range of meshlets. Empty until the model is in the cache.
+    std::vector<MeshLod> lods;
+    int lod; // the one that is drawn.
+
+    size_t vertexVboSize; // in bytes.
+    size_t normalVboSize; // in bytes.
+    bool quantized;       // true if the vbos hold the compact vertex format of quantize.hpp.
+    bool interleaved;     // true if vertexVbo holds the normals too, in the layouts of mesh_cache.hpp.
+
+    // the arguments of glMultiDrawElementsBaseVertex, one element per meshlet, or per shape.
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+    std::vector<GLint> drawBaseVertices;
+
+    // the edge ids of edge_table.hpp, as buffer textures for the TCS. Empty until the model is in the cache.
+    // The hash table is built by edgeTableThread, and freed once it is uploaded.
+    std::vector<EdgeTableEntry> edgeTable;
+    GLuint edgeTableBuffer;
+    GLuint edgeTableTexture;
+    GLuint edgeLevelBuffer;
+    GLuint edgeLevelTexture;
+    std::vector<float> edgeLevels; // the tessellation level of every edge, updated every frame.
+
+    // for the visibility buffer, the indices with the baseVertex of their shape added, and the
+    // vertices of vertexVbo, as buffer textures. The indices are only there while it is used.
+    GLuint absoluteIndexBuffer;
+    GLuint absoluteIndexTexture;
+    GLuint vertexTexture;
+    GLuint quantizedVertexTexture;
+    bool hasAbsoluteIndices;
+
+    // the octaves of sampleTexture() of every vertex, before they are weighted, computed on the
+    // CPU. Octave i of vertex v is texel v of buffer texture i. They only depend on noiseScale, so
+    // the vertex shader weighs them by the persistence, and more octaves only add new ones.
+    // Allocated for MAX_NOISE_OCTAVES once the model is in the cache and precomputeVertexNoise is first used.
+    std::vector<GLuint> noiseLayerBuffers;
+    std::vector<GLuint> noiseLayerTextures;
+    bool hasNoiseLayers;
+    int numNoiseLayers;    // the octaves that are up to date.
+    float noiseLayerScale; // the noiseScale that they were computed with.
 } mesh;
 
+// write the mesh cache with the codecs of mesh_codec.hpp, so that it takes less space on disk.
+// off unless --compress-cache is given, since a compressed cache has to be decoded on every
+// launch, while an uncompressed one is used straight from the file mapping.
+bool compressMeshCache = false;
+
+// the coarsest LOD is drawn whose error is at most this many pixels on screen.
+const float LOD_PIXEL_ERROR = 1.0f;
+
+// with adaptive tessellation, every edge is cut into pieces of about this many pixels on screen.
+const float EDGE_PIXELS_PER_SEGMENT = 8.0f;
+
+// the noise of the vertices is computed on the thread pool in batches of this many.
+const size_t VERTEX_NOISE_BATCH = 1024;
+
+// the most octaves that the noise can have. simple.vs has an array of this size.
+const int MAX_NOISE_OCTAVES = 10;
+
+// culls the meshlets every frame, and the visible ones are drawn from indirectBuffer.
+MeshletCuller meshletCuller;
+GLuint indirectBuffer;
+
+// glMultiDrawElementsIndirect() is OpenGL 4.3, so it is loaded by hand if the driver has
+// GL_ARB_multi_draw_indirect. Otherwise it is NULL, and every meshlet is a glDrawElementsIndirect().
+typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+MultiDrawElementsIndirectProc multiDrawElementsIndirect = NULL;
+
+// GL_MAX_TEXTURE_BUFFER_SIZE, the most texels a buffer texture can have. The modes
+// that read the model from buffer textures are disabled for models that don't fit.
+GLint maxTextureBufferSize = 0;
+
+// loads the model in the background, while the window and the shaders are created.
+std::thread loaderThread;
+MeshStream meshStream;
+bool loadingModel = false;
+
+// builds the hash table of the edges once the model is in the cache, so that the model is
+// drawn in the meantime. edgeTableBuilt is set when mesh.edgeTable is done.
+std::thread edgeTableThread;
+std::atomic<bool> edgeTableBuilt(false);
+
+// octaves of the noise of the vertices that noiseLayerThread computes, so that changing the
+// noise settings doesn't stall the frame. noiseLayersComputed is set when they are done.
+struct NoiseLayerJob {
+    int firstLayer;
+    int numLayers;
+    float scale;
+    std::vector<float> layers; // numLayers octaves of every vertex, one after the other.
+};
+std::thread noiseLayerThread;
+NoiseLayerJob noiseLayerJob;
+std::atomic<bool> noiseLayersComputed(false);
+
 GLuint vao;
 
+// the Bezier patches of the teapot, drawn instead of the model when useBezierPatches is set.
+GLuint patchVao;
+GLuint patchVbo;
+
 GpuProfiler* profiler;
 
 const int WINDOW_WIDTH = 960;
@@ -56,8 +171,24 @@ glm::vec3 cameraPos;
 glm::mat4 viewMatrix;
 glm::mat4 projectionMatrix;
 
+// vertical field of view, in radians, and distance to the near plane.
+const float CAMERA_FOV = 0.9f;
+const float CAMERA_NEAR = 0.1f;
+
 GLuint tessShader;
 GLuint normalShader;
+GLuint bezierShader;
+GLuint depthShader;
+GLuint visibilityShader;
+GLuint visibilityResolveShader;
+
+// the visibility buffer has the id of the triangle of every pixel, plus one, and 0 where
+// there is none. It is as big as the viewport, and is made again if that changes.
+GLuint visibilityFbo;
+GLuint visibilityIdTexture;
+GLuint visibilityDepthBuffer;
+int visibilityWidth = 0;
+int visibilityHeight = 0;
 
 double prevMouseX = 0;
 double prevMouseY = 0;
@@ -73,9 +204,17 @@ const int RENDER_PROCEDURAL_TEXTURE = 1;
  */
 int renderMode = RENDER_PROCEDURAL_TEXTURE;
 bool useTess = false;
+bool useBezierPatches = false;
 int tessLevel = 1;
 bool drawWireframe = false;
 bool doVertexCalculation = false;
+bool useQuantizedVertices = false;
+bool cullMeshlets = true;
+bool useLods = true;
+bool useAdaptiveTess = false;
+bool useDepthPrePass = false;
+bool useVisibilityBuffer = false;
+bool precomputeVertexNoise = false;
 int noiseOctaves = 4;
 float noiseScale = 2.8f;
 float noisePersistence = 0.3f;
@@ -103,57 +242,505 @@ void UpdateViewMatrix() {
 	);
 }
 
-void LoadModel(void) {
+void SetVertexAttribs() {
+    if(mesh.interleaved) {
+	GLsizei stride = (GLsizei)(mesh.quantized ? INTERLEAVED_QUANTIZED_STRIDE : INTERLEAVED_STRIDE);
+	size_t normalOffset = mesh.quantized ? INTERLEAVED_QUANTIZED_NORMAL_OFFSET : 3 * sizeof(float);
+
+	GL_C(glEnableVertexAttribArray(0));
+	GL_C(glEnableVertexAttribArray(1));
+	GL_C(glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexVbo));
+	if(mesh.quantized) {
+	    GL_C(glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, stride, (void*)0));
+	    GL_C(glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, stride, (void*)normalOffset));
+	} else {
+	    GL_C(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0));
+	    GL_C(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)normalOffset));
+	}
+	return;
+    }
 
-    //
-    // First load the model.
-    //
+    // the quantized values are read as plain integers, and are scaled in the vertex shader.
+    GL_C(glEnableVertexAttribArray(0));
+    GL_C(glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexVbo));
+    if(mesh.quantized)
+	GL_C(glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, 0, (void*)0));
+    else
+	GL_C(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0));
+
+    GL_C(glEnableVertexAttribArray(1));
+    GL_C(glBindBuffer(GL_ARRAY_BUFFER, mesh.normalVbo));
+    if(mesh.quantized)
+	GL_C(glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, 0, (void*)0));
+    else
+	GL_C(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0));
+}
+
+/*
+  Build the draw arguments of all the meshlets, or of all the shapes if there
+  are no meshlets yet, so that they can be drawn with a single call.
+*/
+void UpdateDrawRanges() {
+    size_t numDraws = mesh.meshlets.empty() ? mesh.shapes.size() : mesh.meshlets.size();
+    mesh.drawCounts.resize(numDraws);
+    mesh.drawOffsets.resize(numDraws);
+    mesh.drawBaseVertices.resize(numDraws);
+
+    for(size_t i = 0; i < numDraws; ++i) {
+	if(mesh.meshlets.empty()) {
+	    const ObjShape& shape = mesh.shapes[i];
+	    mesh.drawCounts[i] = (GLsizei)shape.numIndices;
+	    mesh.drawOffsets[i] = (const void*)(sizeof(GLuint) * (size_t)shape.firstIndex);
+	    mesh.drawBaseVertices[i] = (GLint)shape.baseVertex;
+	} else {
+	    const Meshlet& meshlet = mesh.meshlets[i];
+	    mesh.drawCounts[i] = (GLsizei)meshlet.numIndices;
+	    mesh.drawOffsets[i] = (const void*)(sizeof(GLuint) * (size_t)meshlet.firstIndex);
+	    mesh.drawBaseVertices[i] = (GLint)meshlet.baseVertex;
+	}
+    }
+}
+
+/*
+  Reorder the triangles of a model that was just loaded, before it goes into
+  the mesh cache, so the optimization is only done once. First for the
+  vertex cache, and then for less overdraw, since every fragment that is
+  drawn over runs the whole noise function in the fragment shader. Then
+  the vertices are put in the order the triangles use them.
+
+  Last, the LODs are made from the result, and appended to faces and
+  shapes. They use the same vertices, so only their triangles are reordered.
+*/
+void OptimizeMesh(std::vector<float>& vertices, std::vector<float>& normals, std::vector<GLuint>& faces, std::vector<ObjShape>& shapes, std::vector<MeshLod>& lods) {
+    float acmr = ComputeACMR(faces, shapes, VERTEX_CACHE_SIZE);
+    OptimizeVertexCache(faces, shapes, VERTEX_CACHE_SIZE);
+    OptimizeOverdraw(faces, shapes, vertices, VERTEX_CACHE_SIZE, OVERDRAW_THRESHOLD);
+    OptimizeVertexFetch(vertices, normals, faces, shapes);
+    printf("Vertex cache ACMR: %.3f -> %.3f\n", acmr, ComputeACMR(faces, shapes, VERTEX_CACHE_SIZE));
+
+    BuildLodChain(vertices, faces, shapes, lods);
+    std::vector<ObjShape> lodShapes(shapes.begin() + lods[0].numShapes, shapes.end());
+    OptimizeVertexCache(faces, lodShapes, VERTEX_CACHE_SIZE);
+    for(size_t i = 1; i < lods.size(); ++i)
+	printf("LOD %d: %d triangles, error %f\n", (int)i, (int)(lods[i].numIndices / 3), lods[i].error);
+}
+
+/*
+  Build the hash table of the edges in the mesh cache, for UploadEdgeTable().
+  Runs on edgeTableThread, once the model is in the cache.
+*/
+void BuildMeshEdgeTable(void) {
+    if(!BuildEdgeTable(mesh.data.GetPositions(), mesh.data.GetNumVertices(), mesh.data.GetIndices(),
+		       mesh.data.GetShapes(), mesh.data.GetNumShapes(), mesh.data.GetEdges(), mesh.data.GetNumEdges(),
+		       mesh.edgeTable)) {
+	printf("The mesh cache has triangles with vertices that don't exist, Adaptive Tessellation is disabled\n");
+	mesh.edgeTable.clear();
+    }
+    edgeTableBuilt = true;
+}
+
+/*
+  Runs on loaderThread. Maps the mesh cache, or if there is none, parses the
+  .obj and hands the mesh to the main thread through meshStream while it is
+  being parsed.
+*/
+void LoadModelInBackground(std::string inputfile, std::string cachefile) {
+    // parsing the .obj is slow, so only do it if the cache is missing or out of date.
+    if(mesh.data.Open(cachefile.c_str(), inputfile.c_str())) {
+	meshStream.Finish(true);
+	return;
+    }
 
-    std::string inputfile = "teapot.obj";
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<GLuint> faces;
+    std::vector<ObjShape> shapes;
+    std::vector<MeshLod> lods;
 
     std::string err;
-    printf("Loading model: %s", inputfile.c_str() );
-    bool ret = tinyobj::LoadObj(shapes, materials, err, inputfile.c_str());
+    bool ret = LoadObjFile(inputfile.c_str(), vertices, normals, faces, shapes, err, &meshStream);
 
     if (!err.empty()) {
 	printf("%s\n", err.c_str() );
     }
-    if (!ret) {
-	exit(1);
+
+    if(ret) {
+	OptimizeMesh(vertices, normals, faces, shapes, lods);
+
+	if(!mesh.data.Build(inputfile.c_str(), vertices, normals, faces, shapes, lods)) {
+	    printf("Could not build mesh cache for %s\n", inputfile.c_str() );
+	} else if(!mesh.data.Write(cachefile.c_str(), compressMeshCache)) {
+	    printf("Could not write mesh cache %s\n", cachefile.c_str() );
+	}
     }
 
-    mesh.vertices = shapes[0].mesh.positions;
-    mesh.faces = shapes[0].mesh.indices;
-    mesh.normals = shapes[0].mesh.normals;
+    meshStream.Finish(ret);
+}
 
-    //
-    // Then upload the model to OpenGL.
-    //
+/*
+  Start loading the model on loaderThread. This needs no OpenGL context, so it
+  is done first of all, and the loading overlaps with creating the window and
+  compiling the shaders.
+*/
+void StartLoadingModel(const std::string& inputfile) {
 
+    std::string cachefile = inputfile + ".meshcache";
 
-    GL_C(glGenBuffers(1, &mesh.indexVbo));
-    GL_C(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexVbo));
-    GL_C(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)* mesh.faces.size(), mesh.faces.data(), GL_STATIC_DRAW));
+    printf("Loading model: %s\n", inputfile.c_str() );
+
+    loadingModel = true;
+    loaderThread = std::thread(LoadModelInBackground, inputfile, cachefile);
+}
 
+/*
+  Create the empty buffers of the model. They are filled in by UpdateModel().
+*/
+void CreateModelBuffers(void) {
+    GL_C(glGenBuffers(1, &mesh.indexVbo));
     GL_C(glGenBuffers(1, &mesh.vertexVbo));
-    GL_C(glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexVbo));
-    GL_C(glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*mesh.vertices.size(), mesh.vertices.data() , GL_STATIC_DRAW));
+    GL_C(glGenBuffers(1, &mesh.normalVbo));
+    GL_C(glGenBuffers(1, &indirectBuffer));
+
+    GL_C(glGenBuffers(1, &mesh.edgeTableBuffer));
+    GL_C(glGenBuffers(1, &mesh.edgeLevelBuffer));
+    GL_C(glGenTextures(1, &mesh.edgeTableTexture));
+    GL_C(glGenTextures(1, &mesh.edgeLevelTexture));
+
+    GL_C(glGenBuffers(1, &mesh.absoluteIndexBuffer));
+    GL_C(glGenTextures(1, &mesh.absoluteIndexTexture));
+    GL_C(glGenTextures(1, &mesh.vertexTexture));
+    GL_C(glGenTextures(1, &mesh.quantizedVertexTexture));
+    mesh.hasAbsoluteIndices = false;
+
+    mesh.noiseLayerBuffers.resize(MAX_NOISE_OCTAVES);
+    mesh.noiseLayerTextures.resize(MAX_NOISE_OCTAVES);
+    GL_C(glGenBuffers(MAX_NOISE_OCTAVES, mesh.noiseLayerBuffers.data()));
+    GL_C(glGenTextures(MAX_NOISE_OCTAVES, mesh.noiseLayerTextures.data()));
+    mesh.hasNoiseLayers = false;
+    mesh.numNoiseLayers = 0;
+    mesh.noiseLayerScale = 0.0f;
+
+    mesh.vertexVboSize = 0;
+    mesh.normalVboSize = 0;
+    mesh.quantized = false;
+    mesh.interleaved = false;
+    mesh.lod = 0;
+    SetVertexAttribs();
+}
 
+/*
+  Create the buffer of the Bezier patches. It has its own VAO, since it has no normals.
+*/
+void CreatePatchBuffers(void) {
+    std::vector<float> controlPoints;
+    CreateTeapotPatches(controlPoints);
 
-    GL_C(glGenBuffers(1, &mesh.normalVbo));
-    GL_C(glBindBuffer(GL_ARRAY_BUFFER, mesh.normalVbo));
-    GL_C(glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*mesh.normals.size(), mesh.normals.data() , GL_STATIC_DRAW));
+    GL_C(glGenVertexArrays(1, &patchVao));
+    GL_C(glBindVertexArray(patchVao));
 
+    GL_C(glGenBuffers(1, &patchVbo));
+    GL_C(glBindBuffer(GL_ARRAY_BUFFER, patchVbo));
+    GL_C(glBufferData(GL_ARRAY_BUFFER, sizeof(float) * controlPoints.size(), controlPoints.data(), GL_STATIC_DRAW));
     GL_C(glEnableVertexAttribArray(0));
-    GL_C(glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexVbo));
     GL_C(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0));
 
-    GL_C(glEnableVertexAttribArray(1));
+    GL_C(glBindVertexArray(vao));
+}
+
+/*
+  Upload the vertices from the mesh cache, in the format chosen by
+  useQuantizedVertices. The cache has them interleaved already, so the
+  section goes straight into vertexVbo, and normalVbo is no longer used.
+*/
+void UploadVertices(void) {
+    MeshCacheSection section = useQuantizedVertices ? MESH_SECTION_QUANTIZED_VERTICES : MESH_SECTION_VERTICES;
+
+    GL_C(glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexVbo));
+    GL_C(glBufferData(GL_ARRAY_BUFFER, mesh.data.GetSectionSize(section), mesh.data.GetSection(section), GL_STATIC_DRAW));
+
     GL_C(glBindBuffer(GL_ARRAY_BUFFER, mesh.normalVbo));
-    GL_C(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0));
+    GL_C(glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW));
+
+    mesh.vertexVboSize = mesh.data.GetSectionSize(section);
+    mesh.normalVboSize = 0;
+    mesh.quantized = useQuantizedVertices;
+    mesh.interleaved = true;
+
+    SetVertexAttribs();
+
+    // the resolve pass of the visibility buffer reads the vertices as two texels each, in either format.
+    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.vertexTexture));
+    GL_C(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mesh.vertexVbo));
+    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.quantizedVertexTexture));
+    GL_C(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA16I, mesh.vertexVbo));
+}
+
+/*
+  Upload the edge table that BuildMeshEdgeTable() built, and attach the buffers
+  to their textures. The levels are uploaded every frame, by UpdateEdgeLevels().
+  Adaptive Tessellation stays disabled if there is no table, or if it does not
+  fit in a buffer texture.
+*/
+void UploadEdgeTable(void) {
+    std::vector<EdgeTableEntry> table;
+    table.swap(mesh.edgeTable);
+    mesh.edgeLevels.clear();
+    if(table.empty())
+	return;
+
+    size_t numEdges = mesh.data.GetNumEdges();
+    if(table.size() > (size_t)maxTextureBufferSize || numEdges > (size_t)maxTextureBufferSize) {
+	printf("The edge table has %d entries and %d edges, but a buffer texture has at most %d texels. Adaptive Tessellation is disabled\n",
+	       (int)table.size(), (int)numEdges, (int)maxTextureBufferSize);
+	return;
+    }
+
+    GL_C(glBindBuffer(GL_TEXTURE_BUFFER, mesh.edgeTableBuffer));
+    GL_C(glBufferData(GL_TEXTURE_BUFFER, sizeof(EdgeTableEntry) * table.size(), table.data(), GL_STATIC_DRAW));
+    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.edgeTableTexture));
+    GL_C(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32UI, mesh.edgeTableBuffer));
 
+    mesh.edgeLevels.resize(numEdges);
+    GL_C(glBindBuffer(GL_TEXTURE_BUFFER, mesh.edgeLevelBuffer));
+    GL_C(glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * mesh.edgeLevels.size(), NULL, GL_STREAM_DRAW));
+    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.edgeLevelTexture));
+    GL_C(glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, mesh.edgeLevelBuffer));
+}
+
+/*
+  Upload the indices of all the LODs with the baseVertex of their shapes
+  added, so that a triangle can be found from its index alone. The shapes
+  of a LOD are next to each other, so the visibility buffer draws all of
+  it with a single call, and its triangles are numbered from the first.
+*/
+void UploadAbsoluteIndices(void) {
+    const unsigned int* indices = mesh.data.GetIndices();
+    const ObjShape* shapes = mesh.data.GetShapes();
+    std::vector<GLuint> absoluteIndices(mesh.data.GetNumIndices());
+
+    GetThreadPool().ParallelFor(mesh.data.GetNumShapes(), [&](size_t s) {
+	    const ObjShape& shape = shapes[s];
+	    for(size_t i = shape.firstIndex; i < (size_t)shape.firstIndex + shape.numIndices; ++i)
+		absoluteIndices[i] = shape.baseVertex + indices[i];
+	});
+
+    GL_C(glBindBuffer(GL_TEXTURE_BUFFER, mesh.absoluteIndexBuffer));
+    GL_C(glBufferData(GL_TEXTURE_BUFFER, sizeof(GLuint) * absoluteIndices.size(), absoluteIndices.data(), GL_STATIC_DRAW));
+    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.absoluteIndexTexture));
+    GL_C(glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, mesh.absoluteIndexBuffer));
+    mesh.hasAbsoluteIndices = true;
+}
+
+/*
+  The visibility buffer can be used once the model is in the cache, if the
+  indices and the vertices of vertexVbo fit in buffer textures. The
+  vertices are read as texels of four floats, or of four int16.
+*/
+bool CanUseVisibilityBuffer(void) {
+    if(!mesh.interleaved)
+	return false;
+    size_t vertexTexels = mesh.vertexVboSize / (mesh.quantized ? 4 * sizeof(int16_t) : 4 * sizeof(float));
+    return mesh.data.GetNumIndices() <= (size_t)maxTextureBufferSize && vertexTexels <= (size_t)maxTextureBufferSize;
+}
+
+/*
+  The absolute indices are another copy of all the indices, so they are
+  only uploaded while the visibility buffer is on, and freed when it is
+  turned off. Is called every frame.
+*/
+void UpdateAbsoluteIndices(bool needed) {
+    if(needed && !mesh.hasAbsoluteIndices) {
+	UploadAbsoluteIndices();
+    } else if(!needed && mesh.hasAbsoluteIndices) {
+	GL_C(glBindBuffer(GL_TEXTURE_BUFFER, mesh.absoluteIndexBuffer));
+	GL_C(glBufferData(GL_TEXTURE_BUFFER, 0, NULL, GL_STATIC_DRAW));
+	mesh.hasAbsoluteIndices = false;
+    }
+}
+
+/*
+  The noise of the vertices can be precomputed once the model is in the cache,
+  if an octave of every vertex fits in a buffer texture.
+*/
+bool CanPrecomputeVertexNoise(void) {
+    return mesh.interleaved && mesh.data.GetNumVertices() <= (size_t)maxTextureBufferSize;
+}
+
+/*
+  Compute the octaves of sampleTexture() of every vertex that noiseLayerJob
+  asks for, with the noise kernels of noise.hpp, on the thread pool. Runs on
+  noiseLayerThread, and UpdateNoiseLayers() uploads them once they are done.
+*/
+void ComputeNoiseLayers(void) {
+    NoiseLayerJob& job = noiseLayerJob;
+    size_t numVertices = mesh.data.GetNumVertices();
+    job.layers.resize(job.numLayers * numVertices);
+
+    const float* positions = mesh.data.GetPositions();
+    size_t numBatches = (numVertices + VERTEX_NOISE_BATCH - 1) / VERTEX_NOISE_BATCH;
+    GetThreadPool().ParallelFor(numBatches, [&](size_t b) {
+	    size_t begin = b * VERTEX_NOISE_BATCH;
+	    size_t count = std::min(VERTEX_NOISE_BATCH, numVertices - begin);
+
+	    // the kernels want x, y and z in arrays of their own.
+	    float x[VERTEX_NOISE_BATCH];
+	    float y[VERTEX_NOISE_BATCH];
+	    float z[VERTEX_NOISE_BATCH];
+	    for(size_t i = 0; i < count; ++i) {
+		x[i] = positions[3 * (begin + i) + 0];
+		y[i] = positions[3 * (begin + i) + 1];
+		z[i] = positions[3 * (begin + i) + 2];
+	    }
+	    for(int i = 0; i < job.numLayers; ++i)
+		NoiseLayerBatch(x, y, z, count, job.scale, job.firstLayer + i, job.layers.data() + i * numVertices + begin);
+	});
+
+    noiseLayersComputed = true;
+}
+
+/*
+  Upload the octaves that noiseLayerThread has computed, and start computing
+  the ones that are missing for noiseScale and noiseOctaves. Is called every
+  frame that they are drawn with. Only a change of noiseScale, or more
+  octaves than before, costs anything. Returns true if the octaves are up to
+  date, and until then the vertex shader computes the noise itself.
+*/
+bool UpdateNoiseLayers(void) {
+    size_t numVertices = mesh.data.GetNumVertices();
+    if(!mesh.hasNoiseLayers) {
+	for(int i = 0; i < MAX_NOISE_OCTAVES; ++i) {
+	    GL_C(glBindBuffer(GL_TEXTURE_BUFFER, mesh.noiseLayerBuffers[i]));
+	    GL_C(glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * numVertices, NULL, GL_DYNAMIC_DRAW));
+	    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.noiseLayerTextures[i]));
+	    GL_C(glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, mesh.noiseLayerBuffers[i]));
+	}
+	mesh.hasNoiseLayers = true;
+	mesh.numNoiseLayers = 0;
+    }
+
+    if(noiseLayersComputed) {
+	noiseLayerThread.join();
+	noiseLayersComputed = false;
+
+	NoiseLayerJob& job = noiseLayerJob;
+	for(int i = 0; i < job.numLayers; ++i) {
+	    GL_C(glBindBuffer(GL_TEXTURE_BUFFER, mesh.noiseLayerBuffers[job.firstLayer + i]));
+	    GL_C(glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(float) * numVertices, job.layers.data() + i * numVertices));
+	}
+	mesh.numNoiseLayers = job.firstLayer + job.numLayers;
+	mesh.noiseLayerScale = job.scale;
+	std::vector<float>().swap(job.layers);
+    }
+
+    bool upToDate = mesh.noiseLayerScale == noiseScale && noiseOctaves <= mesh.numNoiseLayers;
+    if(!upToDate && !noiseLayerThread.joinable()) {
+	// with the same scale, the octaves that are there stay as they are.
+	noiseLayerJob.firstLayer = mesh.noiseLayerScale == noiseScale ? mesh.numNoiseLayers : 0;
+	noiseLayerJob.numLayers = noiseOctaves - noiseLayerJob.firstLayer;
+	noiseLayerJob.scale = noiseScale;
+	noiseLayerThread = std::thread(ComputeNoiseLayers);
+    }
+    return upToDate;
+}
+
+/*
+  Upload the model from the mesh cache. The arrays are used as they are in the cache.
+*/
+void UploadCachedModel(void) {
+    GL_C(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexVbo));
+    GL_C(glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.data.GetSectionSize(MESH_SECTION_INDICES), mesh.data.GetIndices(), GL_STATIC_DRAW));
+
+    // the shapes of the other LODs are only drawn through their meshlets.
+    mesh.lods.assign(mesh.data.GetLods(), mesh.data.GetLods() + mesh.data.GetNumLods());
+    mesh.shapes.assign(mesh.data.GetShapes(), mesh.data.GetShapes() + mesh.lods[0].numShapes);
+    mesh.meshlets.assign(mesh.data.GetMeshlets(), mesh.data.GetMeshlets() + mesh.data.GetNumMeshlets());
+    mesh.lod = 0;
+    UpdateDrawRanges();
+
+    UploadVertices();
+
+    edgeTableThread = std::thread(BuildMeshEdgeTable);
+}
+
+/*
+  Upload the parts of the model that the loader thread has finished since the
+  last frame. Is called every frame.
+*/
+void UpdateModel() {
+    // the edge table comes after the rest of the model, and then Adaptive Tessellation can be used.
+    if(edgeTableBuilt) {
+	edgeTableThread.join();
+	edgeTableBuilt = false;
+	UploadEdgeTable();
+    }
+
+    if(!loadingModel)
+	return;
+
+    // don't spend too long on uploading, or the frame rate drops while loading.
+    const int MAX_CHUNKS_PER_FRAME = 16;
+
+    MeshStreamChunk chunk;
+    bool resized = false;
+    bool newShapes = false;
+    for(int i = 0; i < MAX_CHUNKS_PER_FRAME && meshStream.Pop(chunk); ++i) {
+	size_t end = chunk.offset + chunk.data.size();
+
+	if(chunk.array == MESH_STREAM_BEGIN) {
+	    // allocate the buffers up front, so that they seldom have to grow.
+	    mesh.vertexVboSize = chunk.numVertices * 3 * sizeof(float);
+	    mesh.normalVboSize = chunk.numVertices * 3 * sizeof(float);
+
+	    GL_C(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexVbo));
+	    GL_C(glBufferData(GL_ELEMENT_ARRAY_BUFFER, chunk.numIndices * sizeof(GLuint), NULL, GL_STATIC_DRAW));
+	    GL_C(glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexVbo));
+	    GL_C(glBufferData(GL_ARRAY_BUFFER, mesh.vertexVboSize, NULL, GL_STATIC_DRAW));
+	    GL_C(glBindBuffer(GL_ARRAY_BUFFER, mesh.normalVbo));
+	    GL_C(glBufferData(GL_ARRAY_BUFFER, mesh.normalVboSize, NULL, GL_STATIC_DRAW));
+	} else if(chunk.array == MESH_STREAM_INDICES) {
+	    GL_C(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexVbo));
+	    GL_C(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, chunk.offset, chunk.data.size(), chunk.data.data()));
+	} else if(chunk.array == MESH_STREAM_SHAPES) {
+	    // the last shape we have may have grown, so it is replaced.
+	    if(end / sizeof(ObjShape) > mesh.shapes.size())
+		mesh.shapes.resize(end / sizeof(ObjShape));
+	    memcpy((char*)mesh.shapes.data() + chunk.offset, chunk.data.data(), chunk.data.size());
+	    newShapes = true;
+	} else {
+	    GLuint& vbo = chunk.array == MESH_STREAM_POSITIONS ? mesh.vertexVbo : mesh.normalVbo;
+	    size_t& vboSize = chunk.array == MESH_STREAM_POSITIONS ? mesh.vertexVboSize : mesh.normalVboSize;
+
+	    // the vertex count was only an estimate, so the buffer may be too small.
+	    if(end > vboSize) {
+		size_t newSize = vboSize * 2 > end ? vboSize * 2 : end;
+		ResizeBuffer(vbo, vboSize, newSize);
+		vboSize = newSize;
+		resized = true;
+	    }
+
+	    GL_C(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+	    GL_C(glBufferSubData(GL_ARRAY_BUFFER, chunk.offset, chunk.data.size(), chunk.data.data()));
+	}
+    }
+
+    if(resized)
+	SetVertexAttribs();
+    if(newShapes)
+	UpdateDrawRanges();
+
+    if(meshStream.IsFinished()) {
+	loaderThread.join();
+	loadingModel = false;
+
+	if(!meshStream.Succeeded()) {
+	    exit(1);
+	}
+	// the cache has the optimized triangle and vertex order, and the chosen vertex format,
+	// so it replaces what was streamed in. Without a cache, the streamed model stays.
+	if(mesh.data.GetNumIndices() > 0) {
+	    UploadCachedModel();
+	}
+    }
 }
 
 void InitGlfw() {
@@ -176,6 +763,11 @@ void InitGlfw() {
     // load GLAD.
     gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
 
+    if(glfwExtensionSupported("GL_ARB_multi_draw_indirect"))
+	multiDrawElementsIndirect = (MultiDrawElementsIndirectProc)glfwGetProcAddress("glMultiDrawElementsIndirect");
+
+    GL_C(glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTextureBufferSize));
+
     // Bind and create VAO, otherwise, we can't do anything in OpenGL.
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
@@ -184,6 +776,335 @@ void InitGlfw() {
     GL_C(glEnable(GL_DEPTH_TEST));
 }
 
+/*
+  Pick the coarsest LOD whose error is at most LOD_PIXEL_ERROR pixels, for a
+  viewport that is viewportHeight pixels high. The error is projected at
+  the point of the bounding sphere of the model that is closest to the camera.
+*/
+int SelectLod(int viewportHeight) {
+    const QuantizationBounds* bounds = mesh.data.GetQuantizationBounds();
+    glm::vec3 size = glm::vec3(bounds->scale[0], bounds->scale[1], bounds->scale[2]) * 65535.0f;
+    glm::vec3 center = glm::vec3(bounds->min[0], bounds->min[1], bounds->min[2]) + 0.5f * size;
+    float radius = 0.5f * glm::length(size);
+
+    float distance = glm::length(cameraPos - center) - radius;
+    if(distance < CAMERA_NEAR)
+	distance = CAMERA_NEAR;
+    float pixelsPerUnit = (float)viewportHeight / (2.0f * tanf(0.5f * CAMERA_FOV) * distance);
+
+    int lod = 0;
+    while(lod + 1 < (int)mesh.lods.size() && mesh.lods[lod + 1].error * pixelsPerUnit <= LOD_PIXEL_ERROR)
+	++lod;
+    return lod;
+}
+
+/*
+  Upload the draws of the meshlets that meshletCuller found visible. They are
+  uploaded every frame, so the GPU only ever sees the meshlets that survived culling.
+*/
+void UploadCulledMeshlets(void) {
+    size_t numCommands = meshletCuller.GetNumCommands();
+
+    // a new buffer every frame, so that the upload does not wait for the draws of the last frame.
+    GL_C(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer));
+    GL_C(glBufferData(GL_DRAW_INDIRECT_BUFFER, numCommands * sizeof(DrawElementsIndirectCommand), meshletCuller.GetCommands(), GL_STREAM_DRAW));
+}
+
+/*
+  Draw the meshlets of the last UploadCulledMeshlets().
+*/
+void DrawCulledMeshlets(GLenum mode) {
+    size_t numCommands = meshletCuller.GetNumCommands();
+    if(numCommands == 0)
+	return;
+
+    GL_C(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer));
+    if(multiDrawElementsIndirect) {
+	GL_C(multiDrawElementsIndirect(mode, GL_UNSIGNED_INT, (void*)0, (GLsizei)numCommands, 0));
+    } else {
+	for(size_t i = 0; i < numCommands; ++i)
+	    GL_C(glDrawElementsIndirect(mode, GL_UNSIGNED_INT, (void*)(i * sizeof(DrawElementsIndirectCommand))));
+    }
+}
+
+/*
+  Compute the tessellation level of every edge of the model for this frame,
+  with the MVP matrix and a viewport of width by height pixels, and upload
+  them for the TCS.
+*/
+void UpdateEdgeLevels(const glm::mat4& MVP, int width, int height) {
+    ComputeEdgeTessLevels(mesh.data.GetEdges(), mesh.edgeLevels.size(), mesh.data.GetPositions(), glm::value_ptr(MVP),
+			  (float)width, (float)height, EDGE_PIXELS_PER_SEGMENT, (float)tessLevel, mesh.edgeLevels.data());
+
+    // orphan the buffer, so that the upload does not wait for the draws of the last frame.
+    GL_C(glBindBuffer(GL_TEXTURE_BUFFER, mesh.edgeLevelBuffer));
+    GL_C(glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * mesh.edgeLevels.size(), mesh.edgeLevels.data(), GL_STREAM_DRAW));
+}
+
+/*
+  Draw the Bezier patches if drawPatches is set, and else the model, with
+  the shader that is in use. If culled is set, only the meshlets of the last
+  UploadCulledMeshlets() are drawn.
+*/
+void DrawModel(bool drawPatches, bool culled) {
+    if(drawPatches) {
+	GL_C(glBindVertexArray(patchVao));
+	GL_C(glPatchParameteri(GL_PATCH_VERTICES, TEAPOT_PATCH_SIZE));
+	GL_C(glDrawArrays(GL_PATCHES, 0, TEAPOT_NUM_PATCHES * TEAPOT_PATCH_SIZE));
+	GL_C(glPatchParameteri(GL_PATCH_VERTICES, 3));
+	GL_C(glBindVertexArray(vao));
+    } else if(culled) {
+	DrawCulledMeshlets(useTess ? GL_PATCHES : GL_TRIANGLES);
+    } else if(!mesh.drawCounts.empty()) {
+	// the draws of the meshlets of the LOD, or of the shapes if there are no meshlets yet.
+	size_t firstDraw = mesh.meshlets.empty() ? 0 : mesh.lods[mesh.lod].firstMeshlet;
+	size_t numDraws = mesh.meshlets.empty() ? mesh.drawCounts.size() : mesh.lods[mesh.lod].numMeshlets;
+
+	// all the meshlets are drawn with one call, no matter how many there are.
+	GL_C(glMultiDrawElementsBaseVertex(
+		 useTess ?  GL_PATCHES: GL_TRIANGLES,
+
+		 mesh.drawCounts.data() + firstDraw, GL_UNSIGNED_INT, mesh.drawOffsets.data() + firstDraw,
+		 (GLsizei)numDraws, mesh.drawBaseVertices.data() + firstDraw));
+    }
+}
+
+/*
+  Draw the depth of the model with depthShader, and set up the depth test
+  so that the next draw of the model only shades the fragments that are
+  visible. The vertex shader is the same as that of normalShader, so the
+  depth comes out exactly the same, and the depth test can be GL_EQUAL.
+  EndDepthPrePass() restores the depth state.
+*/
+void BeginDepthPrePass(const glm::mat4& MVP, bool culled) {
+    GL_C(glUseProgram(depthShader));
+    GL_C(glUniformMatrix4fv(glGetUniformLocation(depthShader, "uMvp"), 1, GL_FALSE, glm::value_ptr(MVP) ));
+    GL_C(glUniform1i(glGetUniformLocation(depthShader, "uDoVertexCalculation"), 0 ));
+    GL_C(glUniform1i(glGetUniformLocation(depthShader, "uQuantized"), mesh.quantized ? 1 : 0  ));
+    if(mesh.quantized) {
+	const QuantizationBounds* bounds = mesh.data.GetQuantizationBounds();
+	GL_C(glUniform3fv(glGetUniformLocation(depthShader, "uBoundsMin"), 1, bounds->min  ));
+	GL_C(glUniform3fv(glGetUniformLocation(depthShader, "uBoundsScale"), 1, bounds->scale  ));
+    }
+
+    GL_C(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+    DrawModel(false, culled);
+    GL_C(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+
+    GL_C(glDepthMask(GL_FALSE));
+    GL_C(glDepthFunc(GL_EQUAL));
+}
+
+void EndDepthPrePass() {
+    GL_C(glDepthMask(GL_TRUE));
+    GL_C(glDepthFunc(GL_LESS));
+}
+
+/*
+  Create the visibility buffer for a viewport of width by height pixels,
+  or make it again if the size has changed.
+*/
+void ResizeVisibilityBuffer(int width, int height) {
+    if(width == visibilityWidth && height == visibilityHeight)
+	return;
+
+    if(visibilityWidth == 0) {
+	GL_C(glGenFramebuffers(1, &visibilityFbo));
+	GL_C(glGenTextures(1, &visibilityIdTexture));
+	GL_C(glGenRenderbuffers(1, &visibilityDepthBuffer));
+    }
+    visibilityWidth = width;
+    visibilityHeight = height;
+
+    // integer textures can not be filtered.
+    GL_C(glBindTexture(GL_TEXTURE_2D, visibilityIdTexture));
+    GL_C(glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL));
+    GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+
+    GL_C(glBindRenderbuffer(GL_RENDERBUFFER, visibilityDepthBuffer));
+    GL_C(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height));
+
+    GL_C(glBindFramebuffer(GL_FRAMEBUFFER, visibilityFbo));
+    GL_C(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, visibilityIdTexture, 0));
+    GL_C(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, visibilityDepthBuffer));
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+	printf("Could not create the visibility buffer\n");
+	exit(1);
+    }
+    GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+/*
+  Draw the model as a visibility buffer, and then shade every pixel of it
+  once, in the viewport that starts viewportX pixels from the left. The
+  cost of the shading then depends neither on the overdraw nor on how small
+  the triangles are. The geometry pass is the whole LOD in one call, so the
+  meshlets are not culled.
+*/
+void DrawVisibilityBuffer(const glm::mat4& MVP, int viewportX, int width, int height) {
+    ResizeVisibilityBuffer(width, height);
+
+    //
+    // the geometry pass, which only writes the id of the triangle.
+    //
+    GL_C(glBindFramebuffer(GL_FRAMEBUFFER, visibilityFbo));
+    GL_C(glViewport(0, 0, width, height));
+    const GLuint noTriangle[4] = { 0, 0, 0, 0 };
+    GL_C(glClearBufferuiv(GL_COLOR, 0, noTriangle));
+    GL_C(glClear(GL_DEPTH_BUFFER_BIT));
+
+    const MeshLod& lod = mesh.lods[mesh.lod];
+    GLuint firstIndex = mesh.data.GetShapes()[lod.firstShape].firstIndex;
+
+    GL_C(glUseProgram(visibilityShader));
+    GL_C(glUniformMatrix4fv(glGetUniformLocation(visibilityShader, "uMvp"), 1, GL_FALSE, glm::value_ptr(MVP) ));
+    GL_C(glUniform1i(glGetUniformLocation(visibilityShader, "uDoVertexCalculation"), 0 ));
+    GL_C(glUniform1ui(glGetUniformLocation(visibilityShader, "uFirstTriangle"), firstIndex / 3 ));
+    GL_C(glUniform1i(glGetUniformLocation(visibilityShader, "uQuantized"), mesh.quantized ? 1 : 0  ));
+    if(mesh.quantized) {
+	const QuantizationBounds* bounds = mesh.data.GetQuantizationBounds();
+	GL_C(glUniform3fv(glGetUniformLocation(visibilityShader, "uBoundsMin"), 1, bounds->min  ));
+	GL_C(glUniform3fv(glGetUniformLocation(visibilityShader, "uBoundsScale"), 1, bounds->scale  ));
+    }
+
+    // the absolute indices need no base vertex, so it is a plain draw.
+    GL_C(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.absoluteIndexBuffer));
+    GL_C(glDrawElements(GL_TRIANGLES, (GLsizei)lod.numIndices, GL_UNSIGNED_INT, (void*)(sizeof(GLuint) * (size_t)firstIndex)));
+    GL_C(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexVbo));
+
+    GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    GL_C(glViewport(viewportX, 0, width, height));
+
+    //
+    // the resolve pass, which runs once per pixel of the viewport.
+    //
+    GLuint shader = visibilityResolveShader;
+    GL_C(glUseProgram(shader));
+
+    GL_C(glActiveTexture(GL_TEXTURE0));
+    GL_C(glBindTexture(GL_TEXTURE_2D, visibilityIdTexture));
+    GL_C(glActiveTexture(GL_TEXTURE1));
+    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.absoluteIndexTexture));
+    GL_C(glActiveTexture(GL_TEXTURE2));
+    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.vertexTexture));
+    GL_C(glActiveTexture(GL_TEXTURE3));
+    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.quantizedVertexTexture));
+    GL_C(glActiveTexture(GL_TEXTURE0));
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uTriangleIds"), 0  ));
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uIndices"), 1  ));
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uVertices"), 2  ));
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uQuantizedVertices"), 3  ));
+
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uQuantized"), mesh.quantized ? 1 : 0  ));
+    const QuantizationBounds* bounds = mesh.data.GetQuantizationBounds();
+    GL_C(glUniform3fv(glGetUniformLocation(shader, "uBoundsMin"), 1, bounds->min  ));
+    GL_C(glUniform3fv(glGetUniformLocation(shader, "uBoundsScale"), 1, bounds->scale  ));
+
+    GL_C(glUniform2f(glGetUniformLocation(shader, "uViewportOrigin"), (float)viewportX, 0.0f  ));
+    GL_C(glUniform2f(glGetUniformLocation(shader, "uViewportSize"), (float)width, (float)height  ));
+    GL_C(glUniformMatrix4fv(glGetUniformLocation(shader, "uInverseMvp"), 1, GL_FALSE, glm::value_ptr(glm::inverse(MVP)) ));
+    GL_C(glUniformMatrix4fv(glGetUniformLocation(shader, "uView"),1, GL_FALSE,  glm::value_ptr(viewMatrix)  ));
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uDrawWireframe"), drawWireframe ? 1 : 0  ));
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uRenderSpecular"), renderMode==RENDER_SPECULAR ? 1 : 0  ));
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uNoiseOctaves"), noiseOctaves  ));
+    GL_C(glUniform1f(glGetUniformLocation(shader, "uNoiseScale"), noiseScale  ));
+    GL_C(glUniform1f(glGetUniformLocation(shader, "uNoisePersistence"), noisePersistence  ));
+
+    // the full screen triangle is always filled, and covers everything.
+    GL_C(glPolygonMode(GL_FRONT_AND_BACK, GL_FILL));
+    GL_C(glDisable(GL_DEPTH_TEST));
+    GL_C(glDrawArrays(GL_TRIANGLES, 0, 3));
+    GL_C(glEnable(GL_DEPTH_TEST));
+}
+
+// the benchmark of the depth pre-pass draws every octave count with and without it, for
+// BENCHMARK_FRAMES frames each. The first frames of each are skipped, since the profiler
+// is a few frames behind.
+const int BENCHMARK_WARMUP_FRAMES = 10;
+const int BENCHMARK_FRAMES = 100;
+const int BENCHMARK_MAX_OCTAVES = 10;
+
+struct DepthPrePassBenchmark {
+    bool running;
+    int step;         // (octaves - 1) * 2, plus one with the pre-pass.
+    int frame;        // of the step.
+    double totalTime; // of the measured frames of the step, in ms.
+    float times[BENCHMARK_MAX_OCTAVES][2];
+
+    // the settings from before the benchmark, that are restored after it.
+    int renderMode;
+    bool useTess;
+    bool doVertexCalculation;
+    bool useDepthPrePass;
+    bool useVisibilityBuffer;
+    int noiseOctaves;
+} benchmark;
+
+void StartBenchmarkStep(int step) {
+    benchmark.step = step;
+    benchmark.frame = 0;
+    benchmark.totalTime = 0.0;
+    noiseOctaves = step / 2 + 1;
+    useDepthPrePass = step % 2 == 1;
+}
+
+/*
+  Start the benchmark. The noise is drawn per fragment, since that is what
+  the pre-pass is for, and without the visibility buffer, which would take
+  the place of the pre-pass.
+*/
+void StartDepthPrePassBenchmark() {
+    benchmark.renderMode = renderMode;
+    benchmark.useTess = useTess;
+    benchmark.doVertexCalculation = doVertexCalculation;
+    benchmark.useDepthPrePass = useDepthPrePass;
+    benchmark.useVisibilityBuffer = useVisibilityBuffer;
+    benchmark.noiseOctaves = noiseOctaves;
+
+    renderMode = RENDER_PROCEDURAL_TEXTURE;
+    useTess = false;
+    doVertexCalculation = false;
+    useVisibilityBuffer = false;
+
+    benchmark.running = true;
+    StartBenchmarkStep(0);
+}
+
+/*
+  Collect the time of the last frame, and move on to the next step of the
+  benchmark once the step has run long enough. Is called every frame, after
+  the profiler has ended the frame. The times are printed at the end.
+*/
+void UpdateDepthPrePassBenchmark() {
+    if(!benchmark.running)
+	return;
+
+    if(benchmark.frame >= BENCHMARK_WARMUP_FRAMES)
+	benchmark.totalTime += profiler->GetLastTime();
+    if(++benchmark.frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES)
+	return;
+
+    benchmark.times[benchmark.step / 2][benchmark.step % 2] = (float)(benchmark.totalTime / BENCHMARK_FRAMES);
+    if(benchmark.step + 1 < 2 * BENCHMARK_MAX_OCTAVES) {
+	StartBenchmarkStep(benchmark.step + 1);
+	return;
+    }
+
+    printf("Depth pre-pass benchmark, ms per frame:\n");
+    printf("Octaves  Single pass  Depth pre-pass\n");
+    for(int i = 0; i < BENCHMARK_MAX_OCTAVES; ++i)
+	printf("%7d  %11.3f  %14.3f\n", i + 1, benchmark.times[i][0], benchmark.times[i][1]);
+
+    renderMode = benchmark.renderMode;
+    useTess = benchmark.useTess;
+    doVertexCalculation = benchmark.doVertexCalculation;
+    useDepthPrePass = benchmark.useDepthPrePass;
+    useVisibilityBuffer = benchmark.useVisibilityBuffer;
+    noiseOctaves = benchmark.noiseOctaves;
+    benchmark.running = false;
+}
+
 void Render() {
     int fbWidth, fbHeight;
     int wWidth, wHeight;
@@ -205,8 +1126,16 @@ void Render() {
     UpdateViewMatrix();
     glm::mat4 MVP = projectionMatrix * viewMatrix;
 
+    // the further away the model is, the coarser the LOD that is drawn.
+    mesh.lod = useLods && !mesh.lods.empty() ? SelectLod(fbHeight) : 0;
+
+    // the patches are evaluated in the tessellation evaluation shader, so they need tessellation.
+    bool drawPatches = useTess && useBezierPatches;
+
     GLuint shader;
-    if(useTess) {
+    if(drawPatches) {
+	shader = bezierShader;
+    } else if(useTess) {
 	shader = tessShader;
     } else {
 	shader = normalShader;
@@ -227,12 +1156,62 @@ void Render() {
     GL_C(glUniform1f(glGetUniformLocation(shader, "uNoiseScale"), noiseScale  ));
     GL_C(glUniform1f(glGetUniformLocation(shader, "uNoisePersistence"), noisePersistence  ));
 
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uQuantized"), mesh.quantized && !drawPatches ? 1 : 0  ));
+    if(mesh.quantized && !drawPatches) {
+	const QuantizationBounds* bounds = mesh.data.GetQuantizationBounds();
+	GL_C(glUniform3fv(glGetUniformLocation(shader, "uBoundsMin"), 1, bounds->min  ));
+	GL_C(glUniform3fv(glGetUniformLocation(shader, "uBoundsScale"), 1, bounds->scale  ));
+    }
+
 
 
     if(useTess) {
 	GL_C(glUniform1f(glGetUniformLocation(shader, "uTessLevel"), (float)tessLevel  ));
+
+	// the edges are only known once the model is in the cache. Then tessLevel is the highest level.
+	bool adaptiveTess = useAdaptiveTess && !drawPatches && !mesh.edgeLevels.empty();
+	GL_C(glUniform1i(glGetUniformLocation(shader, "uAdaptiveTess"), adaptiveTess ? 1 : 0  ));
+	// the samplers have different types, so they may not share a unit even when they are not read.
+	GL_C(glUniform1i(glGetUniformLocation(shader, "uEdgeTable"), 0  ));
+	GL_C(glUniform1i(glGetUniformLocation(shader, "uEdgeLevels"), 1  ));
+	if(adaptiveTess) {
+	    UpdateEdgeLevels(MVP, fbWidth - s, fbHeight);
+
+	    GL_C(glActiveTexture(GL_TEXTURE0));
+	    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.edgeTableTexture));
+	    GL_C(glActiveTexture(GL_TEXTURE1));
+	    GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.edgeLevelTexture));
+	    GL_C(glActiveTexture(GL_TEXTURE0));
+	}
     } else {
 	GL_C(glUniform1i(glGetUniformLocation(shader, "uDoVertexCalculation"),  doVertexCalculation ? 1 : 0 ));
+
+	// the vertices are only known once the model is in the cache, and every octave is a buffer texture
+	// with a texel per vertex. While the octaves are being computed, the noise is computed per vertex.
+	bool precomputedShading = precomputeVertexNoise && doVertexCalculation &&
+	    renderMode == RENDER_PROCEDURAL_TEXTURE && !drawPatches && CanPrecomputeVertexNoise() &&
+	    UpdateNoiseLayers();
+	GL_C(glUniform1i(glGetUniformLocation(shader, "uPrecomputedShading"), precomputedShading ? 1 : 0  ));
+	if(precomputedShading) {
+	    // the same weights as fbm(), so the sum is the same.
+	    float amplitudes[MAX_NOISE_OCTAVES] = {};
+	    float amplitude = 1.0f;
+	    for(int i = 0; i < noiseOctaves; ++i) {
+		amplitudes[i] = amplitude;
+		amplitude *= noisePersistence;
+	    }
+	    GL_C(glUniform1fv(glGetUniformLocation(shader, "uNoiseAmplitudes"), MAX_NOISE_OCTAVES, amplitudes  ));
+
+	    // octave i is on texture unit i.
+	    GLint units[MAX_NOISE_OCTAVES];
+	    for(int i = 0; i < MAX_NOISE_OCTAVES; ++i) {
+		units[i] = i;
+		GL_C(glActiveTexture(GL_TEXTURE0 + i));
+		GL_C(glBindTexture(GL_TEXTURE_BUFFER, mesh.noiseLayerTextures[i]));
+	    }
+	    GL_C(glActiveTexture(GL_TEXTURE0));
+	    GL_C(glUniform1iv(glGetUniformLocation(shader, "uNoiseLayers"), MAX_NOISE_OCTAVES, units  ));
+	}
     }
 
 
@@ -244,12 +1223,35 @@ void Render() {
     else
 	glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
 
+    // with tessellation, the shading is done per vertex in the TES, so overdraw costs little there.
+    bool canUseVisibilityBuffer = useVisibilityBuffer && CanUseVisibilityBuffer();
+    UpdateAbsoluteIndices(canUseVisibilityBuffer);
+    bool visibilityBuffer = canUseVisibilityBuffer && !useTess;
+    bool depthPrePass = useDepthPrePass && !useTess && !visibilityBuffer;
+
+    // the meshlets are culled once, even if they are drawn twice. The visibility buffer draws the whole LOD.
+    bool culled = !drawPatches && !visibilityBuffer && cullMeshlets && !mesh.meshlets.empty();
+    if(culled) {
+	const MeshLod& lod = mesh.lods[mesh.lod];
+	meshletCuller.Cull(mesh.meshlets.data() + lod.firstMeshlet, lod.numMeshlets, glm::value_ptr(MVP), glm::value_ptr(cameraPos));
+	UploadCulledMeshlets();
+    }
+
     profiler->Begin();
 
-    GL_C(glDrawElements(
-	     useTess ?  GL_PATCHES: GL_TRIANGLES,
+    if(visibilityBuffer) {
+	DrawVisibilityBuffer(MVP, s, fbWidth - s, fbHeight);
+    } else {
+	if(depthPrePass) {
+	    BeginDepthPrePass(MVP, culled);
+	    GL_C(glUseProgram(shader));
+	}
+
+	DrawModel(drawPatches, culled);
 
-	     mesh.faces.size() , GL_UNSIGNED_INT, 0));
+	if(depthPrePass)
+	    EndDepthPrePass();
+    }
 
     profiler->End();
 
@@ -273,13 +1275,50 @@ void Render() {
 
 	    ImGui::Checkbox("Wireframe", &drawWireframe);
 
+	    // the vertices can only be converted once the whole model has been loaded into the cache.
+	    if(ImGui::Checkbox("Quantized Vertices", &useQuantizedVertices) && !loadingModel && mesh.data.GetNumVertices() > 0) {
+		UploadVertices();
+	    }
+
+	    // the meshlets are only there once the whole model has been loaded into the cache.
+	    if(!mesh.meshlets.empty()) {
+		ImGui::Checkbox("Cull Meshlets", &cullMeshlets);
+		if(cullMeshlets && !(useTess && useBezierPatches) && !(useVisibilityBuffer && !useTess && CanUseVisibilityBuffer()))
+		    ImGui::Text("Drawn Meshlets: %d / %d", (int)meshletCuller.GetNumCommands(), (int)mesh.lods[mesh.lod].numMeshlets);
+
+		ImGui::Checkbox("Automatic LOD", &useLods);
+		ImGui::Text("LOD %d: %d triangles", mesh.lod, (int)(mesh.lods[mesh.lod].numIndices / 3));
+	    }
+
 	    ImGui::Checkbox("Use Tessellation", &useTess);
 
 	    if(useTess) {
-		ImGui::SliderInt("TessLevel", &tessLevel, 1, 20);
+		ImGui::Checkbox("Bezier Patches", &useBezierPatches);
+		if(!useBezierPatches && !mesh.edgeLevels.empty())
+		    ImGui::Checkbox("Adaptive Tessellation", &useAdaptiveTess);
+
+		// 32 patches need much more tessellation than thousands of triangles.
+		ImGui::SliderInt("TessLevel", &tessLevel, 1, useBezierPatches ? 64 : 20);
 	    } else {
 
 		ImGui::Checkbox("Do Vertex Calculation", &doVertexCalculation);
+		if(doVertexCalculation && CanPrecomputeVertexNoise())
+		    ImGui::Checkbox("Precompute Noise On CPU", &precomputeVertexNoise);
+		else if(doVertexCalculation && mesh.interleaved)
+		    ImGui::Text("Too many vertices to precompute noise");
+		ImGui::Checkbox("Depth Pre-pass", &useDepthPrePass);
+
+		// the triangles are only numbered once the whole model has been loaded into the cache.
+		if(CanUseVisibilityBuffer())
+		    ImGui::Checkbox("Visibility Buffer", &useVisibilityBuffer);
+		else if(mesh.interleaved)
+		    ImGui::Text("Too many triangles for the visibility buffer");
+
+		// the times are printed when it is done.
+		if(benchmark.running)
+		    ImGui::Text("Benchmarking: %d octaves", noiseOctaves);
+		else if(ImGui::Button("Benchmark Depth Pre-pass"))
+		    StartDepthPrePassBenchmark();
 
 	    }
 
@@ -291,7 +1330,7 @@ void Render() {
 
 		ImGui::Text("Noise Settings");
 
-		ImGui::SliderInt("Num Octaves", &noiseOctaves, 1, 10);
+		ImGui::SliderInt("Num Octaves", &noiseOctaves, 1, MAX_NOISE_OCTAVES);
 		ImGui::SliderFloat("Scale", &noiseScale, 1.0f, 10.0f);
 		ImGui::SliderFloat("Persistence", &noisePersistence, 0.0f, 1.0f);
 
@@ -336,13 +1375,148 @@ void HandleInput() {
     }
 }
 
+/*
+  Generate a test mesh of about numTriangles triangles, and write it to
+  outputfile and to its mesh cache, so the next run can load it either way.
+*/
+int GenerateModel(size_t numTriangles, const std::string& outputfile) {
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<GLuint> faces;
+    std::vector<ObjShape> shapes;
+    std::vector<MeshLod> lods;
+    GenerateBumpySphere(numTriangles, vertices, normals, faces, shapes);
+
+    printf("Generated %d triangles in %.1f ms\n", (int)(faces.size() / 3),
+	   std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+
+    std::string err;
+    if(!WriteObjFile(outputfile.c_str(), vertices, normals, faces, shapes, err)) {
+	printf("%s\n", err.c_str() );
+	return EXIT_FAILURE;
+    }
+
+    // the same as loading the .obj would put in the cache.
+    OptimizeMesh(vertices, normals, faces, shapes, lods);
+
+    // the cache stores the time stamp of the .obj, so it has to be built after the .obj is written.
+    std::string cachefile = outputfile + ".meshcache";
+    MeshCache cache;
+    if(!cache.Build(outputfile.c_str(), vertices, normals, faces, shapes, lods) ||
+       !cache.Write(cachefile.c_str(), compressMeshCache)) {
+	printf("Could not write mesh cache %s\n", cachefile.c_str() );
+	return EXIT_FAILURE;
+    }
+
+    printf("Wrote %s and %s in %.1f ms\n", outputfile.c_str(), cachefile.c_str(),
+	   std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+    return EXIT_SUCCESS;
+}
+
+/*
+  Evaluate sampleTexture() of shader_common on the GPU, at the points and
+  parameters of noise_check.hpp, and write a capture of the results to
+  outputfile, for noise_check. Needs the window for the OpenGL context.
+*/
+int CaptureNoise(const std::string& outputfile) {
+    const int numPoints = NOISE_CHECK_WIDTH * NOISE_CHECK_HEIGHT;
+    std::vector<float> points;
+    MakeNoiseCheckPoints(points);
+
+    GLuint shader = LoadNormalShader(LoadFile("fullscreen.vs"), LoadFile("noise_capture.fs"));
+
+    GLuint pointBuffer, pointTexture;
+    GL_C(glGenBuffers(1, &pointBuffer));
+    GL_C(glBindBuffer(GL_TEXTURE_BUFFER, pointBuffer));
+    GL_C(glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * points.size(), points.data(), GL_STATIC_DRAW));
+    GL_C(glGenTextures(1, &pointTexture));
+    GL_C(glBindTexture(GL_TEXTURE_BUFFER, pointTexture));
+    GL_C(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, pointBuffer));
+
+    GLuint fbo, valueTexture;
+    GL_C(glGenTextures(1, &valueTexture));
+    GL_C(glBindTexture(GL_TEXTURE_2D, valueTexture));
+    GL_C(glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, NOISE_CHECK_WIDTH, NOISE_CHECK_HEIGHT, 0, GL_RED, GL_FLOAT, NULL));
+    GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GL_C(glGenFramebuffers(1, &fbo));
+    GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+    GL_C(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, valueTexture, 0));
+    GL_C(glViewport(0, 0, NOISE_CHECK_WIDTH, NOISE_CHECK_HEIGHT));
+    GL_C(glDisable(GL_DEPTH_TEST));
+
+    GL_C(glUseProgram(shader));
+    GL_C(glActiveTexture(GL_TEXTURE0));
+    GL_C(glBindTexture(GL_TEXTURE_BUFFER, pointTexture));
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uPoints"), 0  ));
+    GL_C(glUniform1i(glGetUniformLocation(shader, "uWidth"), NOISE_CHECK_WIDTH  ));
+
+    // in the order of the capture file: scale, then persistence, then octaves.
+    std::vector<float> values;
+    for(float scale : NOISE_CHECK_SCALES) {
+	for(float persistence : NOISE_CHECK_PERSISTENCES) {
+	    for(int octaves = 1; octaves <= NOISE_CHECK_MAX_OCTAVES; ++octaves) {
+		GL_C(glUniform1f(glGetUniformLocation(shader, "uNoiseScale"), scale  ));
+		GL_C(glUniform1i(glGetUniformLocation(shader, "uNoiseOctaves"), octaves  ));
+		GL_C(glUniform1f(glGetUniformLocation(shader, "uNoisePersistence"), persistence  ));
+		GL_C(glDrawArrays(GL_TRIANGLES, 0, 3));
+
+		values.resize(values.size() + numPoints);
+		GL_C(glReadPixels(0, 0, NOISE_CHECK_WIDTH, NOISE_CHECK_HEIGHT, GL_RED, GL_FLOAT, values.data() + values.size() - numPoints));
+	    }
+	}
+    }
+
+    if(!WriteNoiseCapture(outputfile.c_str(), points, values)) {
+	printf("Could not write %s\n", outputfile.c_str() );
+	return EXIT_FAILURE;
+    }
+    printf("Wrote %d noise values to %s\n", (int)values.size(), outputfile.c_str() );
+    return EXIT_SUCCESS;
+}
+
+/*
+  Usage:
+    tess_opt [--compress-cache] [model.obj]           render model.obj, by default teapot.obj.
+    tess_opt [--compress-cache] --generate <triangles> <model.obj>
+                                                      write a test mesh of about that many triangles.
+    tess_opt --capture-noise <noise.bin>              write the noise of the GPU, for noise_check.
+*/
 int main(int argc, char** argv)
 {
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    // --compress-cache applies to the cache written by loading and by --generate.
+    if(argc >= 2 && std::string(argv[1]) == "--compress-cache") {
+	compressMeshCache = true;
+	argv[1] = argv[0];
+	--argc;
+	++argv;
+    }
+
+    if(argc >= 2 && std::string(argv[1]) == "--generate") {
+	if(argc != 4) {
+	    printf("Usage: %s [--compress-cache] --generate <triangles> <model.obj>\n", argv[0]);
+	    return EXIT_FAILURE;
+	}
+	return GenerateModel((size_t)strtoull(argv[2], NULL, 10), argv[3]);
+    }
+
+    if(argc == 3 && std::string(argv[1]) == "--capture-noise") {
+	InitGlfw();
+	int result = CaptureNoise(argv[2]);
+	glfwTerminate();
+	return result;
+    }
+
+    StartLoadingModel(argc >= 2 ? argv[1] : "teapot.obj");
 
     InitGlfw();
 
-    // init ImGui
+    // init ImGui, and create its font atlas now rather than in the first frame.
     ImGui_ImplGlfwGL3_Init(window, true);
+    ImGui_ImplGlfwGL3_CreateDeviceObjects();
 
     normalShader =  LoadNormalShader(LoadFile("simple.vs") ,
 				     LoadFile("simple.fs"));
@@ -354,21 +1528,44 @@ int main(int argc, char** argv)
 	LoadFile("tess.tes")
 	);
 
+    // the same vertex shader as normalShader, so that the depth is the same.
+    depthShader =  LoadNormalShader(LoadFile("simple.vs") ,
+				    LoadFile("depth.fs"));
+
+    visibilityShader =  LoadNormalShader(LoadFile("simple.vs") ,
+					 LoadFile("visibility.fs"));
+    visibilityResolveShader =  LoadNormalShader(LoadFile("fullscreen.vs") ,
+						LoadFile("visibility_resolve.fs"));
+
+    bezierShader =  LoadTessShader(
+	LoadFile("tess.vs"),
+	LoadFile("tess.fs"),
+	LoadFile("bezier.tcs"),
+	LoadFile("bezier.tes")
+	);
+
     // our patches are simply triangles in our case.
     GL_C(glPatchParameteri(GL_PATCH_VERTICES, 3));
 
     // setup projection matrix.
-    projectionMatrix = glm::perspective(0.9f, (float)(WINDOW_WIDTH-GUI_WIDTH) / WINDOW_HEIGHT, 0.1f, 1000.0f);
+    projectionMatrix = glm::perspective(CAMERA_FOV, (float)(WINDOW_WIDTH-GUI_WIDTH) / WINDOW_HEIGHT, CAMERA_NEAR, 1000.0f);
 
-    LoadModel();
+    CreateModelBuffers();
+    CreatePatchBuffers();
 
     profiler = new GpuProfiler;
 
+    // everything else is ready, so wait until there is something of the model to draw.
+    meshStream.Wait();
+    bool firstFrame = true;
+
     while (!glfwWindowShouldClose(window)) {
 
         glfwPollEvents();
         ImGui_ImplGlfwGL3_NewFrame();
 
+	UpdateModel();
+
 	Render();
 
 	HandleInput();
@@ -380,10 +1577,28 @@ int main(int argc, char** argv)
         /* display and process events through callbacks */
         glfwSwapBuffers(window);
 
+	if(firstFrame) {
+	    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	    printf("Time to first frame: %.1f ms\n", ms);
+	    firstFrame = false;
+	}
+
 	// update profiler.
 	profiler->EndFrame();
+
+	UpdateDepthPrePassBenchmark();
     }
 
+    // the window may be closed before the model has finished loading. Then
+    // the loader may be waiting for us to pop chunks, so we stop taking them.
+    meshStream.Close();
+    if(loaderThread.joinable())
+	loaderThread.join();
+    if(edgeTableThread.joinable())
+	edgeTableThread.join();
+    if(noiseLayerThread.joinable())
+	noiseLayerThread.join();
+
     glfwTerminate();
     exit(EXIT_SUCCESS);
 }
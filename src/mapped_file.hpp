@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+  Read-only memory mapping of an entire file. The contents are paged in
+  by the OS on demand, so nothing is copied into user memory up front.
+*/
+class MappedFile
+{
+public:
+    MappedFile ();
+    ~MappedFile ();
+
+    inline bool Open (const char* path);
+    inline void Close ();
+
+    inline const char* GetData () const { return m_data; }
+    inline size_t GetSize () const { return m_size; }
+
+private:
+    // not copyable, since we own the mapping.
+    MappedFile (const MappedFile&);
+    MappedFile& operator= (const MappedFile&);
+
+    const char* m_data;
+    size_t m_size;
+
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_fd;
+#endif
+};
+
+inline MappedFile::MappedFile ()
+    :	m_data(NULL),
+	m_size(0)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE),
+	m_mapping(NULL)
+#else
+	, m_fd(-1)
+#endif
+{
+}
+
+inline MappedFile::~MappedFile () {
+    Close();
+}
+
+inline bool MappedFile::Open (const char* path) {
+    Close();
+
+#ifdef _WIN32
+    // others may write while it is mapped, like MeshCache::Open() refreshing the header of a cache in use.
+    m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			 OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(m_file == INVALID_HANDLE_VALUE) {
+	return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(m_file, &fileSize);
+    m_size = (size_t)fileSize.QuadPart;
+
+    // an empty file can not be mapped, but it is still a valid file.
+    if(m_size == 0) {
+	return true;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(m_mapping == NULL) {
+	Close();
+	return false;
+    }
+    m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    m_fd = open(path, O_RDONLY);
+    if(m_fd < 0) {
+	return false;
+    }
+
+    struct stat st;
+    if(fstat(m_fd, &st) != 0) {
+	Close();
+	return false;
+    }
+    m_size = (size_t)st.st_size;
+
+    if(m_size == 0) {
+	return true;
+    }
+
+    void* p = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if(p == MAP_FAILED) {
+	Close();
+	return false;
+    }
+    // we read the file front to back, so tell the kernel to read ahead aggressively.
+    madvise(p, m_size, MADV_SEQUENTIAL);
+    m_data = (const char*)p;
+#endif
+
+    if(m_data == NULL) {
+	Close();
+	return false;
+    }
+
+    return true;
+}
+
+inline void MappedFile::Close () {
+#ifdef _WIN32
+    if(m_data) UnmapViewOfFile(m_data);
+    if(m_mapping) CloseHandle(m_mapping);
+    if(m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+    m_mapping = NULL;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    if(m_data) munmap((void*)m_data, m_size);
+    if(m_fd >= 0) close(m_fd);
+    m_fd = -1;
+#endif
+    m_data = NULL;
+    m_size = 0;
+}
@@ -0,0 +1,583 @@
+#include "mesh_cache.hpp"
+#include "mesh_codec.hpp"
+#include "mesh_optimize.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static const char MESH_CACHE_MAGIC[8] = { 'T', 'E', 'S', 'S', 'M', 'E', 'S', 'H' };
+
+// every section starts at a multiple of this, so the arrays are aligned to cache lines.
+static const size_t MESH_CACHE_ALIGNMENT = 64;
+
+/*
+  Get the size and modification time(in nanoseconds) of a file.
+*/
+static bool GetFileStamp(const char* path, uint64_t& size, uint64_t& modified) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if(!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+	return false;
+    size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    // FILETIME counts 100 nanosecond intervals.
+    modified = (((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime) * 100;
+#else
+    struct stat st;
+    if(stat(path, &st) != 0)
+	return false;
+    size = (uint64_t)st.st_size;
+#if defined(__APPLE__)
+    modified = (uint64_t)st.st_mtimespec.tv_sec * 1000000000ull + (uint64_t)st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+    modified = (uint64_t)st.st_mtim.tv_sec * 1000000000ull + (uint64_t)st.st_mtim.tv_nsec;
+#else
+    modified = (uint64_t)st.st_mtime * 1000000000ull;
+#endif
+#endif
+    return true;
+}
+
+/*
+  Overwrite sourceModified in the header of the cache file at path, and
+  nothing else. The cache is valid with either time, so it does not matter
+  if the write is cut short.
+*/
+static bool WriteSourceModified(const char* path, uint64_t sourceModified) {
+    FILE* fp = fopen(path, "r+b");
+    if(!fp)
+	return false;
+    bool ok = fseek(fp, (long)offsetof(MeshCacheHeader, sourceModified), SEEK_SET) == 0 &&
+	fwrite(&sourceModified, sizeof(sourceModified), 1, fp) == 1;
+    return fclose(fp) == 0 && ok;
+}
+
+bool HashFileContents(const char* path, uint64_t& hash) {
+    MappedFile file;
+    if(!file.Open(path))
+	return false;
+
+    // FNV-1a, but on 8 bytes at a time, which is plenty to detect an edited file.
+    const uint64_t PRIME = 1099511628211ull;
+    hash = 14695981039346656037ull;
+
+    const char* p = file.GetData();
+    size_t n = file.GetSize();
+    for(; n >= 8; p += 8, n -= 8) {
+	uint64_t word;
+	memcpy(&word, p, 8);
+	hash = (hash ^ word) * PRIME;
+    }
+    for(; n > 0; ++p, --n) {
+	hash = (hash ^ (unsigned char)*p) * PRIME;
+    }
+    hash ^= file.GetSize();
+
+    return true;
+}
+
+/*
+  Place the sections one after another, after the header and the table, and
+  set their offsets. Returns the size of the whole file.
+*/
+static size_t LayOutSections(MeshCacheSectionEntry* table) {
+    size_t size = sizeof(MeshCacheHeader) + MESH_SECTION_COUNT * sizeof(MeshCacheSectionEntry);
+    for(int i = 0; i < MESH_SECTION_COUNT; ++i) {
+	size = (size + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+	table[i].offset = size;
+	size += (size_t)table[i].size;
+    }
+    return size;
+}
+
+// the codec that a section is compressed with, and the size of its vertices.
+static MeshCacheCodec GetSectionCodec(int section, uint32_t& stride) {
+    stride = 0;
+    switch(section) {
+    case MESH_SECTION_INDICES:
+	return MESH_CODEC_INDICES;
+    case MESH_SECTION_POSITIONS:
+	stride = 3 * sizeof(float);
+	return MESH_CODEC_VERTICES;
+    case MESH_SECTION_VERTICES:
+	stride = INTERLEAVED_STRIDE;
+	return MESH_CODEC_VERTICES;
+    case MESH_SECTION_QUANTIZED_VERTICES:
+	stride = INTERLEAVED_QUANTIZED_STRIDE;
+	return MESH_CODEC_VERTICES;
+    default:
+	return MESH_CODEC_NONE;
+    }
+}
+
+MeshCache::MeshCache ()
+    :	m_data(NULL),
+	m_size(0) {
+}
+
+bool MeshCache::Validate () const {
+    if(m_size < sizeof(MeshCacheHeader) + MESH_SECTION_COUNT * sizeof(MeshCacheSectionEntry))
+	return false;
+
+    const MeshCacheHeader* header = (const MeshCacheHeader*)m_data;
+    if(memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+       header->version != MESH_CACHE_VERSION ||
+       header->numSections != MESH_SECTION_COUNT) {
+	return false;
+    }
+
+    const MeshCacheSectionEntry* table = (const MeshCacheSectionEntry*)(m_data + sizeof(MeshCacheHeader));
+    for(int i = 0; i < MESH_SECTION_COUNT; ++i) {
+	if(table[i].offset % MESH_CACHE_ALIGNMENT != 0 ||
+	   table[i].offset > m_size || table[i].size > m_size - table[i].offset) {
+	    return false;
+	}
+
+	uint32_t stride;
+	MeshCacheCodec codec = GetSectionCodec(i, stride);
+	if(table[i].codec == MESH_CODEC_NONE) {
+	    if(table[i].decodedSize != table[i].size)
+		return false;
+	} else if(table[i].codec != (uint32_t)codec || table[i].stride != stride ||
+		  (stride > 0 && table[i].decodedSize % stride != 0)) {
+	    return false;
+	}
+
+	// the sections are decoded into memory of decodedSize, which must be no more than the codec can make.
+	size_t maxRatio = table[i].codec == MESH_CODEC_INDICES ? INDEX_CODEC_MAX_RATIO : VERTEX_CODEC_MAX_RATIO;
+	if(table[i].codec != MESH_CODEC_NONE && table[i].decodedSize / maxRatio > table[i].size)
+	    return false;
+    }
+
+    // the vertex sections are uploaded with numVertices vertices each.
+    size_t numVertices = (size_t)table[MESH_SECTION_POSITIONS].decodedSize / (3 * sizeof(float));
+    if(table[MESH_SECTION_VERTICES].decodedSize != INTERLEAVED_STRIDE * numVertices ||
+       table[MESH_SECTION_QUANTIZED_VERTICES].decodedSize != INTERLEAVED_QUANTIZED_STRIDE * numVertices)
+	return false;
+
+    // the bounds are read whenever the quantized vertices are drawn.
+    if(table[MESH_SECTION_QUANTIZATION_BOUNDS].codec != MESH_CODEC_NONE ||
+       table[MESH_SECTION_QUANTIZATION_BOUNDS].size != sizeof(QuantizationBounds))
+	return false;
+
+    // the shapes are needed to decode the indices, so they are never compressed.
+    // Their indices are checked by ValidateIndices(), once they are decoded.
+    if(table[MESH_SECTION_SHAPES].codec != MESH_CODEC_NONE)
+	return false;
+    const ObjShape* shapes = (const ObjShape*)(m_data + table[MESH_SECTION_SHAPES].offset);
+    size_t numShapes = (size_t)table[MESH_SECTION_SHAPES].size / sizeof(ObjShape);
+    size_t numIndices = (size_t)table[MESH_SECTION_INDICES].decodedSize / sizeof(unsigned int);
+    for(size_t i = 0; i < numShapes; ++i) {
+	if(shapes[i].firstIndex > numIndices || shapes[i].numIndices > numIndices - shapes[i].firstIndex ||
+	   shapes[i].baseVertex > numVertices || shapes[i].numVertices > numVertices - shapes[i].baseVertex)
+	    return false;
+    }
+
+    // and the meshlets are drawn as they are.
+    if(table[MESH_SECTION_MESHLETS].codec != MESH_CODEC_NONE)
+	return false;
+    const Meshlet* meshlets = (const Meshlet*)(m_data + table[MESH_SECTION_MESHLETS].offset);
+    size_t numMeshlets = (size_t)table[MESH_SECTION_MESHLETS].size / sizeof(Meshlet);
+    for(size_t i = 0; i < numMeshlets; ++i) {
+	if(meshlets[i].firstIndex > numIndices || meshlets[i].numIndices > numIndices - meshlets[i].firstIndex ||
+	   meshlets[i].baseVertex > numVertices)
+	    return false;
+    }
+
+    // and the LODs are ranges of both.
+    if(table[MESH_SECTION_LODS].codec != MESH_CODEC_NONE)
+	return false;
+    const MeshLod* lods = (const MeshLod*)(m_data + table[MESH_SECTION_LODS].offset);
+    size_t numLods = (size_t)table[MESH_SECTION_LODS].size / sizeof(MeshLod);
+    if(numLods == 0)
+	return false;
+    for(size_t i = 0; i < numLods; ++i) {
+	if(lods[i].firstShape > numShapes || lods[i].numShapes > numShapes - lods[i].firstShape ||
+	   lods[i].firstMeshlet > numMeshlets || lods[i].numMeshlets > numMeshlets - lods[i].firstMeshlet)
+	    return false;
+    }
+
+    // the edges are read by the GPU, and their hash table is built from them.
+    if(table[MESH_SECTION_EDGES].codec != MESH_CODEC_NONE)
+	return false;
+    const uint32_t* edges = (const uint32_t*)(m_data + table[MESH_SECTION_EDGES].offset);
+    size_t numEdges = (size_t)table[MESH_SECTION_EDGES].size / (2 * sizeof(uint32_t));
+    for(size_t i = 0; i < 2 * numEdges; ++i) {
+	if(edges[i] >= numVertices)
+	    return false;
+    }
+
+    return true;
+}
+
+bool MeshCache::ValidateIndices () const {
+    struct IndexRange {
+	size_t first;
+	size_t count;
+	size_t limit; // every index of the range must be below this.
+    };
+
+    // the ranges are cut into pieces, so that a single big shape is checked in parallel too.
+    const size_t PIECE_SIZE = 64 * 1024;
+    std::vector<IndexRange> pieces;
+    size_t numVertices = GetNumVertices();
+    IndexRange range;
+
+    // the indices of a shape are relative to its baseVertex.
+    for(size_t s = 0; s < GetNumShapes(); ++s) {
+	const ObjShape& shape = GetShapes()[s];
+	for(size_t i = 0; i < shape.numIndices; i += PIECE_SIZE) {
+	    range.first = (size_t)shape.firstIndex + i;
+	    range.count = std::min(PIECE_SIZE, (size_t)shape.numIndices - i);
+	    range.limit = shape.numVertices;
+	    pieces.push_back(range);
+	}
+    }
+
+    // and the meshlets are drawn with their own baseVertex.
+    for(size_t m = 0; m < GetNumMeshlets(); ++m) {
+	const Meshlet& meshlet = GetMeshlets()[m];
+	for(size_t i = 0; i < meshlet.numIndices; i += PIECE_SIZE) {
+	    range.first = (size_t)meshlet.firstIndex + i;
+	    range.count = std::min(PIECE_SIZE, (size_t)meshlet.numIndices - i);
+	    range.limit = numVertices - meshlet.baseVertex;
+	    pieces.push_back(range);
+	}
+    }
+
+    const unsigned int* indices = GetIndices();
+    std::atomic<bool> ok(true);
+    GetThreadPool().ParallelFor(pieces.size(), [&](size_t p) {
+	    const IndexRange& piece = pieces[p];
+	    for(size_t i = piece.first; i < piece.first + piece.count; ++i) {
+		if(indices[i] >= piece.limit) {
+		    ok = false;
+		    return;
+		}
+	    }
+	});
+    return ok;
+}
+
+bool MeshCache::Decode () {
+    MeshCacheHeader header;
+    MeshCacheSectionEntry table[MESH_SECTION_COUNT];
+    memcpy(&header, m_data, sizeof(header));
+    memcpy(table, m_data + sizeof(header), sizeof(table));
+
+    MeshCacheSectionEntry decodedTable[MESH_SECTION_COUNT];
+    for(int i = 0; i < MESH_SECTION_COUNT; ++i) {
+	decodedTable[i] = table[i];
+	decodedTable[i].size = decodedTable[i].decodedSize;
+	decodedTable[i].codec = MESH_CODEC_NONE;
+	decodedTable[i].stride = 0;
+    }
+    std::vector<char> memory(LayOutSections(decodedTable), 0);
+    memcpy(&memory[0], &header, sizeof(header));
+    memcpy(&memory[sizeof(header)], decodedTable, sizeof(decodedTable));
+
+    const ObjShape* shapes = (const ObjShape*)(m_data + table[MESH_SECTION_SHAPES].offset);
+    size_t numShapes = (size_t)table[MESH_SECTION_SHAPES].size / sizeof(ObjShape);
+
+    for(int i = 0; i < MESH_SECTION_COUNT; ++i) {
+	const unsigned char* src = (const unsigned char*)m_data + table[i].offset;
+	size_t srcSize = (size_t)table[i].size;
+	char* dst = &memory[0] + decodedTable[i].offset;
+
+	if(table[i].codec == MESH_CODEC_NONE) {
+	    memcpy(dst, src, srcSize);
+	} else if(table[i].codec == MESH_CODEC_VERTICES) {
+	    if(!DecodeVertexBuffer(dst, (size_t)(table[i].decodedSize / table[i].stride), table[i].stride, src, srcSize))
+		return false;
+	} else if(table[i].codec == MESH_CODEC_INDICES) {
+	    // every shape was coded by itself, so they can be decoded in parallel.
+	    if(srcSize < sizeof(uint64_t) * numShapes)
+		return false;
+	    const unsigned char* streams = src + sizeof(uint64_t) * numShapes;
+	    size_t streamsSize = srcSize - sizeof(uint64_t) * numShapes;
+
+	    std::atomic<bool> ok(true);
+	    GetThreadPool().ParallelFor(numShapes, [&](size_t s) {
+		    uint64_t begin = 0;
+		    uint64_t end;
+		    if(s > 0)
+			memcpy(&begin, src + sizeof(uint64_t) * (s - 1), sizeof(begin));
+		    memcpy(&end, src + sizeof(uint64_t) * s, sizeof(end));
+
+		    bool decoded = begin <= end && end <= streamsSize &&
+			DecodeIndexBuffer((unsigned int*)dst + shapes[s].firstIndex, shapes[s].numIndices,
+					  streams + begin, (size_t)(end - begin));
+		    if(!decoded)
+			ok = false;
+		});
+	    if(!ok)
+		return false;
+	}
+    }
+
+    m_file.Close();
+    m_memory.swap(memory);
+    m_data = m_memory.data();
+    m_size = m_memory.size();
+    return true;
+}
+
+bool MeshCache::Open (const char* path, const char* sourcePath) {
+    m_memory.clear();
+    m_data = NULL;
+    m_size = 0;
+
+    uint64_t sourceSize, sourceModified;
+    if(!GetFileStamp(sourcePath, sourceSize, sourceModified))
+	return false;
+
+    if(!m_file.Open(path))
+	return false;
+    m_data = m_file.GetData();
+    m_size = m_file.GetSize();
+
+    if(!Validate()) {
+	m_file.Close();
+	m_data = NULL;
+	m_size = 0;
+	return false;
+    }
+
+    const MeshCacheSectionEntry* table = (const MeshCacheSectionEntry*)(m_data + sizeof(MeshCacheHeader));
+    bool compressed = false;
+    for(int i = 0; i < MESH_SECTION_COUNT; ++i)
+	compressed = compressed || table[i].codec != MESH_CODEC_NONE;
+
+    const MeshCacheHeader* header = (const MeshCacheHeader*)m_data;
+    bool valid = header->sourceSize == sourceSize;
+
+    // if only the time changed, the file may just have been touched or checked out again.
+    // Then compare the contents before we throw away the cache.
+    bool touched = false;
+    if(valid && header->sourceModified != sourceModified) {
+	uint64_t hash;
+	valid = HashFileContents(sourcePath, hash) && hash == header->sourceHash;
+	touched = valid;
+    }
+
+    // a compressed cache is only decoded once we know that it is up to date.
+    if(valid && compressed)
+	valid = Decode();
+    if(valid)
+	valid = ValidateIndices();
+
+    // store the new time, so that the next launch does not hash the source again.
+    // If the cache can't be written to, it just does.
+    if(valid && touched)
+	WriteSourceModified(path, sourceModified);
+
+    if(!valid) {
+	m_file.Close();
+	m_memory.clear();
+	m_data = NULL;
+	m_size = 0;
+    }
+    return valid;
+}
+
+bool MeshCache::Build (
+    const char* sourcePath,
+    const std::vector<float>& positions,
+    const std::vector<float>& normals,
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    const std::vector<MeshLod>& lods) {
+
+    m_file.Close();
+
+    MeshCacheHeader header;
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    header.version = MESH_CACHE_VERSION;
+    header.numSections = MESH_SECTION_COUNT;
+    if(!GetFileStamp(sourcePath, header.sourceSize, header.sourceModified) ||
+       !HashFileContents(sourcePath, header.sourceHash)) {
+	return false;
+    }
+
+    const void* sectionData[MESH_SECTION_COUNT];
+    MeshCacheSectionEntry table[MESH_SECTION_COUNT];
+
+    sectionData[MESH_SECTION_POSITIONS] = positions.data();
+    table[MESH_SECTION_POSITIONS].size = sizeof(float) * positions.size();
+    sectionData[MESH_SECTION_INDICES] = indices.data();
+    table[MESH_SECTION_INDICES].size = sizeof(unsigned int) * indices.size();
+    sectionData[MESH_SECTION_SHAPES] = shapes.data();
+    table[MESH_SECTION_SHAPES].size = sizeof(ObjShape) * shapes.size();
+
+    // the vertices are interleaved here, so that they can be uploaded from the mapped file as they are.
+    size_t numVertices = positions.size() / 3;
+    bool hasNormals = normals.size() == positions.size();
+    std::vector<char> vertices(INTERLEAVED_STRIDE * numVertices);
+    VertexAttribute attributes[] = {
+	{ positions.data(), 3 * sizeof(float) },
+	{ hasNormals ? normals.data() : NULL, 3 * sizeof(float) }
+    };
+    InterleaveVertices(attributes, 2, numVertices, INTERLEAVED_STRIDE, vertices.data());
+    sectionData[MESH_SECTION_VERTICES] = vertices.data();
+    table[MESH_SECTION_VERTICES].size = vertices.size();
+
+    QuantizationBounds bounds;
+    std::vector<uint16_t> quantizedPositions(3 * numVertices);
+    QuantizePositions(positions.data(), numVertices, bounds, quantizedPositions.data());
+    std::vector<int16_t> octNormals;
+    if(hasNormals) {
+	octNormals.resize(2 * numVertices);
+	OctEncodeNormals(normals.data(), numVertices, octNormals.data());
+    }
+    std::vector<char> quantizedVertices(INTERLEAVED_QUANTIZED_STRIDE * numVertices);
+    VertexAttribute quantizedAttributes[] = {
+	{ quantizedPositions.data(), 3 * sizeof(uint16_t) },
+	{ NULL, INTERLEAVED_QUANTIZED_NORMAL_OFFSET - 3 * sizeof(uint16_t) },
+	{ hasNormals ? octNormals.data() : NULL, 2 * sizeof(int16_t) }
+    };
+    InterleaveVertices(quantizedAttributes, 3, numVertices, INTERLEAVED_QUANTIZED_STRIDE, quantizedVertices.data());
+
+    sectionData[MESH_SECTION_QUANTIZATION_BOUNDS] = &bounds;
+    table[MESH_SECTION_QUANTIZATION_BOUNDS].size = sizeof(bounds);
+    sectionData[MESH_SECTION_QUANTIZED_VERTICES] = quantizedVertices.data();
+    table[MESH_SECTION_QUANTIZED_VERTICES].size = quantizedVertices.size();
+
+    std::vector<Meshlet> meshlets;
+    BuildMeshlets(positions, indices, shapes, meshlets);
+    sectionData[MESH_SECTION_MESHLETS] = meshlets.data();
+    table[MESH_SECTION_MESHLETS].size = sizeof(Meshlet) * meshlets.size();
+
+    // the meshlets are in the order of the shapes, so the meshlets of a LOD are the ones that start in its indices.
+    std::vector<MeshLod> lodMeshlets(lods);
+    if(lodMeshlets.empty()) {
+	size_t numIndices = 0;
+	for(size_t s = 0; s < shapes.size(); ++s)
+	    numIndices += shapes[s].numIndices;
+	MeshLod model = { 0, (uint32_t)shapes.size(), 0, 0, (uint32_t)numIndices, 0.0f };
+	lodMeshlets.push_back(model);
+    }
+    size_t m = 0;
+    for(size_t l = 0; l < lodMeshlets.size(); ++l) {
+	MeshLod& lod = lodMeshlets[l];
+	size_t end = 0;
+	for(uint32_t s = lod.firstShape; s < lod.firstShape + lod.numShapes; ++s)
+	    end = std::max(end, (size_t)shapes[s].firstIndex + shapes[s].numIndices);
+
+	lod.firstMeshlet = (uint32_t)m;
+	while(m < meshlets.size() && meshlets[m].firstIndex < end)
+	    ++m;
+	lod.numMeshlets = (uint32_t)m - lod.firstMeshlet;
+    }
+    sectionData[MESH_SECTION_LODS] = lodMeshlets.data();
+    table[MESH_SECTION_LODS].size = sizeof(MeshLod) * lodMeshlets.size();
+
+    std::vector<uint32_t> edges;
+    BuildEdges(positions.data(), positions.size() / 3, indices.data(), shapes.data(), shapes.size(), edges);
+    sectionData[MESH_SECTION_EDGES] = edges.data();
+    table[MESH_SECTION_EDGES].size = sizeof(uint32_t) * edges.size();
+
+    for(int i = 0; i < MESH_SECTION_COUNT; ++i) {
+	table[i].decodedSize = table[i].size;
+	table[i].codec = MESH_CODEC_NONE;
+	table[i].stride = 0;
+    }
+
+    m_memory.assign(LayOutSections(table), 0);
+    memcpy(&m_memory[0], &header, sizeof(header));
+    memcpy(&m_memory[sizeof(header)], table, sizeof(table));
+    for(int i = 0; i < MESH_SECTION_COUNT; ++i) {
+	if(table[i].size > 0)
+	    memcpy(&m_memory[(size_t)table[i].offset], sectionData[i], (size_t)table[i].size);
+    }
+
+    m_data = m_memory.data();
+    m_size = m_memory.size();
+    return true;
+}
+
+bool MeshCache::Write (const char* path, bool compress) const {
+    if(!m_data)
+	return false;
+
+    const char* data = m_data;
+    size_t size = m_size;
+
+    //
+    // Compress the sections into a new file image. m_data itself always stays uncompressed.
+    //
+    std::vector<unsigned char> compressed;
+    if(compress) {
+	MeshCacheSectionEntry table[MESH_SECTION_COUNT];
+	memcpy(table, m_data + sizeof(MeshCacheHeader), sizeof(table));
+
+	std::vector<unsigned char> encoded[MESH_SECTION_COUNT];
+	for(int i = 0; i < MESH_SECTION_COUNT; ++i) {
+	    const void* section = GetSection((MeshCacheSection)i);
+	    size_t sectionSize = GetSectionSize((MeshCacheSection)i);
+
+	    uint32_t stride;
+	    MeshCacheCodec codec = GetSectionCodec(i, stride);
+	    if(codec == MESH_CODEC_VERTICES) {
+		EncodeVertexBuffer(section, sectionSize / stride, stride, encoded[i]);
+	    } else if(codec == MESH_CODEC_INDICES) {
+		size_t numShapes = GetNumShapes();
+		encoded[i].resize(sizeof(uint64_t) * numShapes);
+		for(size_t s = 0; s < numShapes; ++s) {
+		    EncodeIndexBuffer(GetIndices() + GetShapes()[s].firstIndex, GetShapes()[s].numIndices, encoded[i]);
+		    uint64_t end = encoded[i].size() - sizeof(uint64_t) * numShapes;
+		    memcpy(&encoded[i][sizeof(uint64_t) * s], &end, sizeof(end));
+		}
+	    } else {
+		encoded[i].assign((const unsigned char*)section, (const unsigned char*)section + sectionSize);
+	    }
+
+	    table[i].size = encoded[i].size();
+	    table[i].codec = codec;
+	    table[i].stride = stride;
+	}
+
+	compressed.assign(LayOutSections(table), 0);
+	memcpy(&compressed[0], m_data, sizeof(MeshCacheHeader));
+	memcpy(&compressed[sizeof(MeshCacheHeader)], table, sizeof(table));
+	for(int i = 0; i < MESH_SECTION_COUNT; ++i) {
+	    if(!encoded[i].empty())
+		memcpy(&compressed[(size_t)table[i].offset], encoded[i].data(), encoded[i].size());
+	}
+
+	data = (const char*)compressed.data();
+	size = compressed.size();
+    }
+
+    std::string tempPath = std::string(path) + ".tmp";
+
+    FILE* fp = fopen(tempPath.c_str(), "wb");
+    if(!fp)
+	return false;
+
+    bool ok = fwrite(data, 1, size, fp) == size;
+    ok = fclose(fp) == 0 && ok;
+
+    if(ok) {
+#ifdef _WIN32
+	ok = MoveFileExA(tempPath.c_str(), path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	ok = rename(tempPath.c_str(), path) == 0;
+#endif
+    }
+
+    if(!ok)
+	remove(tempPath.c_str());
+    return ok;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "edge_table.hpp"
+#include "mapped_file.hpp"
+#include "mesh_lod.hpp"
+#include "meshlets.hpp"
+#include "obj_loader.hpp"
+#include "quantize.hpp"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+  A binary version of a mesh, that is saved next to the .obj it was made from.
+
+  The file is a header followed by a table of sections, and every section
+  is an array that starts on a 64 byte boundary. Since the layout in the
+  file is the layout that OpenGL wants, a mapped cache file can be handed
+  straight to glBufferData.
+
+  The header stores the size, modification time and a hash of the source
+  file, so the cache is thrown away as soon as the source changes.
+
+  The cache can also be written compressed with the codecs of mesh_codec.hpp.
+  Then the sections are decoded into memory when the cache is opened.
+*/
+
+const uint32_t MESH_CACHE_VERSION = 13;
+
+// the vertex sections have the position and normal of every vertex next to
+// each other, and the strides are powers of two so that no vertex straddles
+// two cache lines: 12 bytes of position and 12 of normal, and 6 bytes of
+// quantized position, two of padding and 4 of normal.
+const size_t INTERLEAVED_STRIDE = 32;
+const size_t INTERLEAVED_QUANTIZED_STRIDE = 16;
+const size_t INTERLEAVED_QUANTIZED_NORMAL_OFFSET = 8;
+
+enum MeshCacheSection {
+    MESH_SECTION_POSITIONS = 0, // float xyz per vertex, for the CPU.
+    MESH_SECTION_VERTICES = 1,  // INTERLEAVED_STRIDE bytes per vertex, float position and normal.
+    MESH_SECTION_INDICES = 2,   // uint32 per index, three per triangle.
+    MESH_SECTION_SHAPES = 3,    // ObjShape per shape, of all the LODs in order.
+
+    // the compact vertex format of quantize.hpp.
+    MESH_SECTION_QUANTIZATION_BOUNDS = 4, // one QuantizationBounds.
+    MESH_SECTION_QUANTIZED_VERTICES = 5,  // INTERLEAVED_QUANTIZED_STRIDE bytes per vertex, uint16 position and int16 normal.
+
+    MESH_SECTION_MESHLETS = 6,  // Meshlet per meshlet, of all the shapes in order.
+    MESH_SECTION_LODS = 7,      // MeshLod per level of detail, at least one.
+
+    // the edges of edge_table.hpp, of all the LODs. Their hash table is built when the cache is loaded.
+    MESH_SECTION_EDGES = 8,     // uint32 pair of vertices per edge.
+
+    MESH_SECTION_COUNT
+};
+
+struct MeshCacheHeader {
+    char magic[8];           // "TESSMESH"
+    uint32_t version;        // MESH_CACHE_VERSION
+    uint32_t numSections;    // MESH_SECTION_COUNT
+    uint64_t sourceSize;     // size in bytes of the source file.
+    uint64_t sourceModified; // modification time of the source file, in nanoseconds.
+    uint64_t sourceHash;     // HashFileContents() of the source file.
+};
+
+enum MeshCacheCodec {
+    MESH_CODEC_NONE = 0,
+    MESH_CODEC_INDICES = 1,  // EncodeIndexBuffer() of every shape, after a table with the end of each shape.
+    MESH_CODEC_VERTICES = 2  // EncodeVertexBuffer().
+};
+
+struct MeshCacheSectionEntry {
+    uint64_t offset;      // from the beginning of the file.
+    uint64_t size;        // in bytes, as stored in the file.
+    uint64_t decodedSize; // in bytes, once decoded.
+    uint32_t codec;       // MeshCacheCodec.
+    uint32_t stride;      // bytes per vertex, for MESH_CODEC_VERTICES.
+};
+
+class MeshCache
+{
+public:
+    MeshCache ();
+
+    /*
+      Map the cache file at path. Fails if the file is missing or broken,
+      or if it was not made from the current version of sourcePath.
+    */
+    bool Open (const char* path, const char* sourcePath);
+
+    /*
+      Build the cache in memory from a mesh that was loaded from sourcePath.
+      The interleaved vertices, both plain and quantized, and the meshlets
+      are made from the mesh. If normals is empty, the normals are zero. lods
+      are from BuildLodChain(), and if there are none, the mesh is its only LOD.
+    */
+    bool Build (
+	const char* sourcePath,
+	const std::vector<float>& positions,
+	const std::vector<float>& normals,
+	const std::vector<unsigned int>& indices,
+	const std::vector<ObjShape>& shapes,
+	const std::vector<MeshLod>& lods);
+
+    // write the cache to path. The file is replaced atomically, so a crash never leaves a broken cache behind.
+    // If compress is set, the index and vertex sections are compressed.
+    bool Write (const char* path, bool compress = false) const;
+
+    inline const float* GetPositions () const { return (const float*)GetSection(MESH_SECTION_POSITIONS); }
+    inline const unsigned int* GetIndices () const { return (const unsigned int*)GetSection(MESH_SECTION_INDICES); }
+    inline const ObjShape* GetShapes () const { return (const ObjShape*)GetSection(MESH_SECTION_SHAPES); }
+    inline const QuantizationBounds* GetQuantizationBounds () const { return (const QuantizationBounds*)GetSection(MESH_SECTION_QUANTIZATION_BOUNDS); }
+    inline const Meshlet* GetMeshlets () const { return (const Meshlet*)GetSection(MESH_SECTION_MESHLETS); }
+    inline const MeshLod* GetLods () const { return (const MeshLod*)GetSection(MESH_SECTION_LODS); }
+    inline const uint32_t* GetEdges () const { return (const uint32_t*)GetSection(MESH_SECTION_EDGES); }
+
+    inline size_t GetNumVertices () const { return GetSectionSize(MESH_SECTION_POSITIONS) / (3 * sizeof(float)); }
+    inline size_t GetNumIndices () const { return GetSectionSize(MESH_SECTION_INDICES) / sizeof(unsigned int); }
+    inline size_t GetNumShapes () const { return GetSectionSize(MESH_SECTION_SHAPES) / sizeof(ObjShape); }
+    inline size_t GetNumMeshlets () const { return GetSectionSize(MESH_SECTION_MESHLETS) / sizeof(Meshlet); }
+    inline size_t GetNumLods () const { return GetSectionSize(MESH_SECTION_LODS) / sizeof(MeshLod); }
+    inline size_t GetNumEdges () const { return GetSectionSize(MESH_SECTION_EDGES) / (2 * sizeof(uint32_t)); }
+
+    inline const void* GetSection (MeshCacheSection section) const;
+    inline size_t GetSectionSize (MeshCacheSection section) const;
+
+private:
+    // check that the header, the section table and the sections of m_data that are never compressed make sense.
+    bool Validate () const;
+
+    // check that every index of m_data, once decoded, is in the vertices of its shape and of its meshlet.
+    bool ValidateIndices () const;
+
+    // decode the compressed sections of m_data into m_memory.
+    bool Decode ();
+
+    // not copyable, since the section pointers point into m_memory.
+    MeshCache (const MeshCache&);
+    MeshCache& operator= (const MeshCache&);
+
+    MappedFile m_file;          // the cache when it is loaded from disk,
+    std::vector<char> m_memory; // or when it has been built in memory.
+
+    const char* m_data;
+    size_t m_size;
+};
+
+inline const void* MeshCache::GetSection (MeshCacheSection section) const {
+    if(!m_data)
+	return NULL;
+    const MeshCacheSectionEntry* table = (const MeshCacheSectionEntry*)(m_data + sizeof(MeshCacheHeader));
+    return m_data + table[section].offset;
+}
+
+inline size_t MeshCache::GetSectionSize (MeshCacheSection section) const {
+    if(!m_data)
+	return 0;
+    const MeshCacheSectionEntry* table = (const MeshCacheSectionEntry*)(m_data + sizeof(MeshCacheHeader));
+    return (size_t)table[section].size;
+}
+
+/*
+  A 64-bit hash of the contents of the file, used to tell whether the file
+  changed even when its modification time did not.
+*/
+bool HashFileContents(const char* path, uint64_t& hash);
@@ -0,0 +1,568 @@
+#include "mesh_codec.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_CODEC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//
+// Index codec.
+//
+
+// the triangles are coded in segments of this many, that are decoded in parallel.
+static const size_t INDEX_SEGMENT_SIZE = 64 * 1024;
+
+static const int INDEX_FIFO_SIZE = 16;
+
+// in a triangle code, the upper four bits are the edge, or this if no edge was found.
+static const int INDEX_CODE_NO_EDGE = 15;
+// and the lower four bits are the third vertex, which is one of these, or 1 + a vertex fifo entry.
+static const int INDEX_CODE_NEXT = 0;
+static const int INDEX_CODE_EXPLICIT = 15;
+
+/*
+  The recent edges and vertices, that the encoder and decoder both keep track of.
+*/
+struct IndexCodecState {
+    unsigned int edges[INDEX_FIFO_SIZE][2];
+    unsigned int vertices[INDEX_FIFO_SIZE];
+    unsigned int edgeHead;
+    unsigned int vertexHead;
+
+    unsigned int next; // the vertex that is used for the first time next, if the vertices are in first use order.
+    unsigned int last; // the last explicitly coded vertex.
+
+    IndexCodecState (unsigned int next_)
+	:	edgeHead(0),
+		vertexHead(0),
+		next(next_),
+		last(0) {
+	memset(edges, 0, sizeof(edges));
+	memset(vertices, 0, sizeof(vertices));
+    }
+
+    inline void PushEdge (unsigned int a, unsigned int b) {
+	edges[edgeHead & (INDEX_FIFO_SIZE - 1)][0] = a;
+	edges[edgeHead & (INDEX_FIFO_SIZE - 1)][1] = b;
+	++edgeHead;
+    }
+
+    inline void PushVertex (unsigned int v) {
+	vertices[vertexHead & (INDEX_FIFO_SIZE - 1)] = v;
+	++vertexHead;
+    }
+
+    // the edge that was pushed the given number of edges ago.
+    inline const unsigned int* GetEdge (int distance) const {
+	return edges[(edgeHead - 1 - distance) & (INDEX_FIFO_SIZE - 1)];
+    }
+
+    inline unsigned int GetVertex (int distance) const {
+	return vertices[(vertexHead - 1 - distance) & (INDEX_FIFO_SIZE - 1)];
+    }
+
+    inline int FindEdge (unsigned int a, unsigned int b) const {
+	for(int d = 0; d < INDEX_CODE_NO_EDGE; ++d) {
+	    const unsigned int* e = GetEdge(d);
+	    if(e[0] == a && e[1] == b)
+		return d;
+	}
+	return -1;
+    }
+
+    inline int FindVertex (unsigned int v) const {
+	for(int d = 0; d < INDEX_CODE_EXPLICIT - 1; ++d) {
+	    if(GetVertex(d) == v)
+		return d;
+	}
+	return -1;
+    }
+};
+
+static inline void WriteVarint(unsigned int v, std::vector<unsigned char>& out) {
+    while(v >= 0x80) {
+	out.push_back((unsigned char)(v | 0x80));
+	v >>= 7;
+    }
+    out.push_back((unsigned char)v);
+}
+
+static inline bool ReadVarint(const unsigned char*& p, const unsigned char* end, unsigned int& v) {
+    v = 0;
+    for(int shift = 0; shift < 35; shift += 7) {
+	if(p == end)
+	    return false;
+	unsigned char b = *p++;
+	v |= (unsigned int)(b & 0x7F) << shift;
+	if(b < 0x80)
+	    return true;
+    }
+    return false;
+}
+
+// code the difference between two vertices, so that small differences of either sign are small numbers.
+static inline unsigned int ZigZag(unsigned int v, unsigned int last) {
+    int d = (int)(v - last);
+    return ((unsigned int)d << 1) ^ (unsigned int)(d >> 31);
+}
+
+static inline unsigned int UnZigZag(unsigned int z, unsigned int last) {
+    return last + ((z >> 1) ^ (0u - (z & 1)));
+}
+
+/*
+  Encode the triangles of one segment. Codes go into codes, and explicit vertices into data.
+*/
+static void EncodeIndexSegment(
+    const unsigned int* indices, size_t numTriangles, IndexCodecState& state,
+    std::vector<unsigned char>& codes, std::vector<unsigned char>& data) {
+
+    for(size_t t = 0; t < numTriangles; ++t) {
+	const unsigned int* tri = indices + 3 * t;
+
+	// look for a rotation of the triangle that starts with a recent edge.
+	int edge = -1;
+	unsigned int x = 0, y = 0, z = 0;
+	for(int r = 0; r < 3 && edge < 0; ++r) {
+	    x = tri[r];
+	    y = tri[(r + 1) % 3];
+	    z = tri[(r + 2) % 3];
+	    edge = state.FindEdge(x, y);
+	}
+
+	if(edge >= 0) {
+	    int third;
+	    int fifo = z == state.next ? -1 : state.FindVertex(z);
+	    if(z == state.next) {
+		third = INDEX_CODE_NEXT;
+		++state.next;
+	    } else if(fifo >= 0) {
+		third = 1 + fifo;
+	    } else {
+		third = INDEX_CODE_EXPLICIT;
+		WriteVarint(ZigZag(z, state.last), data);
+		state.last = z;
+	    }
+	    codes.push_back((unsigned char)((edge << 4) | third));
+
+	    // the neighbours of the two new edges see them the other way around.
+	    state.PushEdge(z, y);
+	    state.PushEdge(x, z);
+	    if(fifo < 0)
+		state.PushVertex(z);
+	} else {
+	    // the lower bits say which of the vertices are the next new vertex.
+	    int flags = 0;
+	    for(int k = 0; k < 3; ++k) {
+		if(tri[k] == state.next) {
+		    flags |= 1 << k;
+		    ++state.next;
+		} else {
+		    WriteVarint(ZigZag(tri[k], state.last), data);
+		    state.last = tri[k];
+		}
+	    }
+	    codes.push_back((unsigned char)((INDEX_CODE_NO_EDGE << 4) | flags));
+
+	    state.PushEdge(tri[1], tri[0]);
+	    state.PushEdge(tri[2], tri[1]);
+	    state.PushEdge(tri[0], tri[2]);
+	    state.PushVertex(tri[0]);
+	    state.PushVertex(tri[1]);
+	    state.PushVertex(tri[2]);
+	}
+    }
+}
+
+static bool DecodeIndexSegment(
+    unsigned int* out, size_t numTriangles, IndexCodecState& state,
+    const unsigned char* codes, const unsigned char* data, const unsigned char* end) {
+
+    for(size_t t = 0; t < numTriangles; ++t) {
+	unsigned int* tri = out + 3 * t;
+	int edge = codes[t] >> 4;
+	int third = codes[t] & 15;
+
+	if(edge != INDEX_CODE_NO_EDGE) {
+	    const unsigned int* e = state.GetEdge(edge);
+	    unsigned int x = e[0];
+	    unsigned int y = e[1];
+	    unsigned int z;
+
+	    if(third == INDEX_CODE_NEXT) {
+		z = state.next++;
+	    } else if(third == INDEX_CODE_EXPLICIT) {
+		unsigned int d;
+		if(!ReadVarint(data, end, d))
+		    return false;
+		z = UnZigZag(d, state.last);
+		state.last = z;
+	    } else {
+		z = state.GetVertex(third - 1);
+	    }
+
+	    tri[0] = x;
+	    tri[1] = y;
+	    tri[2] = z;
+
+	    state.PushEdge(z, y);
+	    state.PushEdge(x, z);
+	    if(third == INDEX_CODE_NEXT || third == INDEX_CODE_EXPLICIT)
+		state.PushVertex(z);
+	} else {
+	    for(int k = 0; k < 3; ++k) {
+		if(third & (1 << k)) {
+		    tri[k] = state.next++;
+		} else {
+		    unsigned int d;
+		    if(!ReadVarint(data, end, d))
+			return false;
+		    tri[k] = UnZigZag(d, state.last);
+		    state.last = tri[k];
+		}
+	    }
+
+	    state.PushEdge(tri[1], tri[0]);
+	    state.PushEdge(tri[2], tri[1]);
+	    state.PushEdge(tri[0], tri[2]);
+	    state.PushVertex(tri[0]);
+	    state.PushVertex(tri[1]);
+	    state.PushVertex(tri[2]);
+	}
+    }
+
+    return true;
+}
+
+/*
+  The encoded indices are a table with the end of every segment, followed by
+  the segments. A segment is the value of state.next where it starts, the
+  triangle codes, and then the explicit vertices.
+*/
+void EncodeIndexBuffer(const unsigned int* indices, size_t numIndices, std::vector<unsigned char>& out) {
+    size_t numTriangles = numIndices / 3;
+    size_t numSegments = (numTriangles + INDEX_SEGMENT_SIZE - 1) / INDEX_SEGMENT_SIZE;
+
+    size_t tableOffset = out.size();
+    out.resize(tableOffset + sizeof(uint64_t) * numSegments);
+    size_t segmentsOffset = out.size();
+
+    // the segments are coded one after another, since each one starts where the previous left next.
+    unsigned int next = 0;
+    std::vector<unsigned char> codes;
+    std::vector<unsigned char> data;
+    for(size_t s = 0; s < numSegments; ++s) {
+	size_t first = s * INDEX_SEGMENT_SIZE;
+	size_t count = numTriangles - first < INDEX_SEGMENT_SIZE ? numTriangles - first : INDEX_SEGMENT_SIZE;
+
+	IndexCodecState state(next);
+	codes.clear();
+	data.clear();
+	EncodeIndexSegment(indices + 3 * first, count, state, codes, data);
+
+	WriteVarint(next, out);
+	next = state.next;
+	out.insert(out.end(), codes.begin(), codes.end());
+	out.insert(out.end(), data.begin(), data.end());
+
+	uint64_t end = out.size() - segmentsOffset;
+	memcpy(&out[tableOffset + sizeof(uint64_t) * s], &end, sizeof(end));
+    }
+}
+
+bool DecodeIndexBuffer(unsigned int* out, size_t numIndices, const unsigned char* data, size_t size) {
+    if(numIndices % 3 != 0)
+	return false;
+    size_t numTriangles = numIndices / 3;
+    size_t numSegments = (numTriangles + INDEX_SEGMENT_SIZE - 1) / INDEX_SEGMENT_SIZE;
+
+    if(size < sizeof(uint64_t) * numSegments)
+	return false;
+    const unsigned char* segments = data + sizeof(uint64_t) * numSegments;
+    size_t segmentsSize = size - sizeof(uint64_t) * numSegments;
+
+    std::atomic<bool> ok(true);
+    GetThreadPool().ParallelFor(numSegments, [&](size_t s) {
+	    uint64_t begin = 0;
+	    uint64_t end;
+	    if(s > 0)
+		memcpy(&begin, data + sizeof(uint64_t) * (s - 1), sizeof(begin));
+	    memcpy(&end, data + sizeof(uint64_t) * s, sizeof(end));
+
+	    size_t first = s * INDEX_SEGMENT_SIZE;
+	    size_t count = numTriangles - first < INDEX_SEGMENT_SIZE ? numTriangles - first : INDEX_SEGMENT_SIZE;
+
+	    const unsigned char* p = segments + begin;
+	    const unsigned char* pEnd = segments + end;
+	    unsigned int next;
+	    if(begin > end || end > segmentsSize || !ReadVarint(p, pEnd, next) || (size_t)(pEnd - p) < count) {
+		ok = false;
+		return;
+	    }
+
+	    IndexCodecState state(next);
+	    if(!DecodeIndexSegment(out + 3 * first, count, state, p, p + count, pEnd))
+		ok = false;
+	});
+
+    return ok;
+}
+
+//
+// Vertex codec.
+//
+
+// the vertices are coded in blocks of this many, that are decoded in parallel.
+static const size_t VERTEX_BLOCK_SIZE = 1024;
+static const size_t VERTEX_GROUP_SIZE = 16;
+static const size_t VERTEX_GROUPS_PER_BLOCK = VERTEX_BLOCK_SIZE / VERTEX_GROUP_SIZE;
+
+// the blocks are handed to the threads this many at a time.
+static const size_t VERTEX_BLOCKS_PER_TASK = 16;
+
+// the decoder keeps this many planes of a block on the stack.
+static const size_t VERTEX_PLANES_PER_PASS = 16;
+
+// bytes of packed data of a group, for each of the four group widths.
+static const size_t VERTEX_GROUP_BYTES[4] = { 0, 4, 8, 16 };
+
+/*
+  Encode one block. Every byte plane is a header with two bits per group,
+  that give the width of the group, followed by the packed groups.
+*/
+static void EncodeVertexBlock(const unsigned char* vertices, size_t numVertices, size_t stride, std::vector<unsigned char>& out) {
+    size_t numGroups = (numVertices + VERTEX_GROUP_SIZE - 1) / VERTEX_GROUP_SIZE;
+    unsigned char plane[VERTEX_BLOCK_SIZE];
+
+    for(size_t k = 0; k < stride; ++k) {
+	// delta code from the previous vertex, and zigzag so that small negative deltas are small.
+	unsigned char prev = 0;
+	for(size_t i = 0; i < numVertices; ++i) {
+	    unsigned char v = vertices[i * stride + k];
+	    unsigned char d = (unsigned char)(v - prev);
+	    plane[i] = (unsigned char)((d << 1) ^ (unsigned char)((signed char)d >> 7));
+	    prev = v;
+	}
+	memset(plane + numVertices, 0, numGroups * VERTEX_GROUP_SIZE - numVertices);
+
+	size_t header = out.size();
+	out.resize(header + (numGroups + 3) / 4, 0);
+
+	for(size_t g = 0; g < numGroups; ++g) {
+	    const unsigned char* group = plane + g * VERTEX_GROUP_SIZE;
+
+	    unsigned char maxValue = 0;
+	    for(size_t i = 0; i < VERTEX_GROUP_SIZE; ++i)
+		maxValue = group[i] > maxValue ? group[i] : maxValue;
+	    int width = maxValue == 0 ? 0 : maxValue < 4 ? 1 : maxValue < 16 ? 2 : 3;
+	    out[header + g / 4] |= (unsigned char)(width << (2 * (g % 4)));
+
+	    // the layouts are chosen so that the decoder can unpack them with shifts and unpacks.
+	    if(width == 1) {
+		// byte j holds values j, j+4, j+8 and j+12.
+		for(size_t j = 0; j < 4; ++j)
+		    out.push_back((unsigned char)(group[j] | (group[j + 4] << 2) | (group[j + 8] << 4) | (group[j + 12] << 6)));
+	    } else if(width == 2) {
+		// byte j holds values j and j+8.
+		for(size_t j = 0; j < 8; ++j)
+		    out.push_back((unsigned char)(group[j] | (group[j + 8] << 4)));
+	    } else if(width == 3) {
+		out.insert(out.end(), group, group + VERTEX_GROUP_SIZE);
+	    }
+	}
+    }
+}
+
+#ifdef MESH_CODEC_SSE2
+
+/*
+  Unpack a group of 16 deltas, and add them up on top of the last value of
+  the previous group, which is in every byte of prev.
+*/
+static inline __m128i DecodeVertexGroup(int width, const unsigned char* p, __m128i prev) {
+    __m128i z;
+    if(width == 0) {
+	z = _mm_setzero_si128();
+    } else if(width == 1) {
+	int packed;
+	memcpy(&packed, p, sizeof(packed));
+	__m128i v = _mm_cvtsi32_si128(packed);
+	__m128i mask = _mm_set1_epi8(3);
+	__m128i a = _mm_and_si128(v, mask);
+	__m128i b = _mm_and_si128(_mm_srli_epi16(v, 2), mask);
+	__m128i c = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+	__m128i d = _mm_and_si128(_mm_srli_epi16(v, 6), mask);
+	z = _mm_unpacklo_epi64(_mm_unpacklo_epi32(a, b), _mm_unpacklo_epi32(c, d));
+    } else if(width == 2) {
+	__m128i v = _mm_loadl_epi64((const __m128i*)p);
+	__m128i mask = _mm_set1_epi8(15);
+	z = _mm_unpacklo_epi64(_mm_and_si128(v, mask), _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+    } else {
+	z = _mm_loadu_si128((const __m128i*)p);
+    }
+
+    // undo the zigzag.
+    __m128i d = _mm_xor_si128(
+	_mm_and_si128(_mm_srli_epi16(z, 1), _mm_set1_epi8(0x7F)),
+	_mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi8(1))));
+
+    // prefix sum of the deltas.
+    d = _mm_add_epi8(d, _mm_slli_si128(d, 1));
+    d = _mm_add_epi8(d, _mm_slli_si128(d, 2));
+    d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+    d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+    return _mm_add_epi8(d, prev);
+}
+
+#else
+
+static inline void DecodeVertexGroup(int width, const unsigned char* p, unsigned char& prev, unsigned char* out) {
+    for(size_t i = 0; i < VERTEX_GROUP_SIZE; ++i) {
+	unsigned char z;
+	if(width == 0)
+	    z = 0;
+	else if(width == 1)
+	    z = (p[i % 4] >> (2 * (i / 4))) & 3;
+	else if(width == 2)
+	    z = (p[i % 8] >> (4 * (i / 8))) & 15;
+	else
+	    z = p[i];
+
+	prev = (unsigned char)(prev + ((z >> 1) ^ (0u - (z & 1))));
+	out[i] = prev;
+    }
+}
+
+#endif
+
+static bool DecodeVertexBlock(unsigned char* vertices, size_t numVertices, size_t stride, const unsigned char* p, const unsigned char* end) {
+    size_t numGroups = (numVertices + VERTEX_GROUP_SIZE - 1) / VERTEX_GROUP_SIZE;
+    size_t headerSize = (numGroups + 3) / 4;
+
+    // the planes are decoded a few at a time, and then interleaved into the
+    // vertices, so that the vertices are written in order.
+    unsigned char planes[VERTEX_PLANES_PER_PASS][VERTEX_BLOCK_SIZE];
+
+    for(size_t firstPlane = 0; firstPlane < stride; firstPlane += VERTEX_PLANES_PER_PASS) {
+	size_t numPlanes = stride - firstPlane < VERTEX_PLANES_PER_PASS ? stride - firstPlane : VERTEX_PLANES_PER_PASS;
+
+	for(size_t k = 0; k < numPlanes; ++k) {
+	    unsigned char* plane = planes[k];
+
+	    if((size_t)(end - p) < headerSize)
+		return false;
+	    const unsigned char* header = p;
+	    p += headerSize;
+
+	    // check that all the groups of the plane are there, so that they can be unpacked without checks.
+	    size_t planeSize = 0;
+	    for(size_t g = 0; g < numGroups; ++g)
+		planeSize += VERTEX_GROUP_BYTES[(header[g / 4] >> (2 * (g % 4))) & 3];
+	    if((size_t)(end - p) < planeSize)
+		return false;
+
+#ifdef MESH_CODEC_SSE2
+	    __m128i prev = _mm_setzero_si128();
+	    for(size_t g = 0; g < numGroups; ++g) {
+		int width = (header[g / 4] >> (2 * (g % 4))) & 3;
+		__m128i v = DecodeVertexGroup(width, p, prev);
+		_mm_storeu_si128((__m128i*)(plane + g * VERTEX_GROUP_SIZE), v);
+		p += VERTEX_GROUP_BYTES[width];
+
+		// broadcast the last byte to all bytes.
+		prev = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_unpackhi_epi8(v, v), 0xFF), 0xFF);
+	    }
+#else
+	    unsigned char prev = 0;
+	    for(size_t g = 0; g < numGroups; ++g) {
+		int width = (header[g / 4] >> (2 * (g % 4))) & 3;
+		DecodeVertexGroup(width, p, prev, plane + g * VERTEX_GROUP_SIZE);
+		p += VERTEX_GROUP_BYTES[width];
+	    }
+#endif
+	}
+
+	for(size_t i = 0; i < numVertices; ++i) {
+	    unsigned char* vertex = vertices + i * stride + firstPlane;
+	    for(size_t k = 0; k < numPlanes; ++k)
+		vertex[k] = planes[k][i];
+	}
+    }
+
+    return true;
+}
+
+/*
+  The encoded vertices are a table with the end of every block, followed by
+  the blocks.
+*/
+void EncodeVertexBuffer(const void* vertices, size_t numVertices, size_t stride, std::vector<unsigned char>& out) {
+    size_t numBlocks = (numVertices + VERTEX_BLOCK_SIZE - 1) / VERTEX_BLOCK_SIZE;
+    size_t numTasks = (numBlocks + VERTEX_BLOCKS_PER_TASK - 1) / VERTEX_BLOCKS_PER_TASK;
+
+    // encode the blocks in parallel, and then stitch them together.
+    std::vector<std::vector<unsigned char> > encoded(numTasks);
+    std::vector<std::vector<uint64_t> > blockSizes(numTasks);
+    GetThreadPool().ParallelFor(numTasks, [&](size_t t) {
+	    for(size_t b = t * VERTEX_BLOCKS_PER_TASK; b < numBlocks && b < (t + 1) * VERTEX_BLOCKS_PER_TASK; ++b) {
+		size_t first = b * VERTEX_BLOCK_SIZE;
+		size_t count = numVertices - first < VERTEX_BLOCK_SIZE ? numVertices - first : VERTEX_BLOCK_SIZE;
+
+		size_t begin = encoded[t].size();
+		EncodeVertexBlock((const unsigned char*)vertices + first * stride, count, stride, encoded[t]);
+		blockSizes[t].push_back(encoded[t].size() - begin);
+	    }
+	});
+
+    size_t tableOffset = out.size();
+    out.resize(tableOffset + sizeof(uint64_t) * numBlocks);
+
+    uint64_t end = 0;
+    size_t b = 0;
+    for(size_t t = 0; t < numTasks; ++t) {
+	for(size_t i = 0; i < blockSizes[t].size(); ++i, ++b) {
+	    end += blockSizes[t][i];
+	    memcpy(&out[tableOffset + sizeof(uint64_t) * b], &end, sizeof(end));
+	}
+	out.insert(out.end(), encoded[t].begin(), encoded[t].end());
+    }
+}
+
+bool DecodeVertexBuffer(void* out, size_t numVertices, size_t stride, const unsigned char* data, size_t size) {
+    size_t numBlocks = (numVertices + VERTEX_BLOCK_SIZE - 1) / VERTEX_BLOCK_SIZE;
+    size_t numTasks = (numBlocks + VERTEX_BLOCKS_PER_TASK - 1) / VERTEX_BLOCKS_PER_TASK;
+
+    if(size < sizeof(uint64_t) * numBlocks)
+	return false;
+    const unsigned char* blocks = data + sizeof(uint64_t) * numBlocks;
+    size_t blocksSize = size - sizeof(uint64_t) * numBlocks;
+
+    std::atomic<bool> ok(true);
+    GetThreadPool().ParallelFor(numTasks, [&](size_t t) {
+	    for(size_t b = t * VERTEX_BLOCKS_PER_TASK; b < numBlocks && b < (t + 1) * VERTEX_BLOCKS_PER_TASK; ++b) {
+		uint64_t begin = 0;
+		uint64_t end;
+		if(b > 0)
+		    memcpy(&begin, data + sizeof(uint64_t) * (b - 1), sizeof(begin));
+		memcpy(&end, data + sizeof(uint64_t) * b, sizeof(end));
+		if(begin > end || end > blocksSize) {
+		    ok = false;
+		    return;
+		}
+
+		size_t first = b * VERTEX_BLOCK_SIZE;
+		size_t count = numVertices - first < VERTEX_BLOCK_SIZE ? numVertices - first : VERTEX_BLOCK_SIZE;
+		if(!DecodeVertexBlock((unsigned char*)out + first * stride, count, stride, blocks + begin, blocks + end)) {
+		    ok = false;
+		    return;
+		}
+	    }
+	});
+
+    return ok;
+}
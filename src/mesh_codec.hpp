@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*
+  Lossless compression of index and vertex arrays, used to make the mesh
+  cache smaller on disk.
+
+  The index codec codes every triangle against the edges and vertices of the
+  triangles just before it. For most triangles this takes a single byte, and
+  it works best when the triangles are in vertex cache order and the vertices
+  are numbered in order of first use, like LoadObjFile() creates them.
+  Triangles may come back rotated, e.g. (b, c, a) instead of (a, b, c),
+  which keeps their winding.
+
+  The vertex codec splits the vertices into blocks, and every block into byte
+  planes: the first bytes of all the vertices, then the second bytes, and so
+  on. Each plane is delta coded from vertex to vertex, and the deltas are
+  packed with 0, 2, 4 or 8 bits each, in groups of 16. Unpacking a group is a
+  few SSE2 instructions, and the blocks are decoded in parallel.
+*/
+
+// the most bytes that the codecs decode from a byte of their output, which is what a corrupt
+// file can claim at most: every triangle takes at least one byte, and every byte plane of the
+// vertices takes at least two bits per group of 16 vertices.
+const size_t INDEX_CODEC_MAX_RATIO = 3 * sizeof(unsigned int);
+const size_t VERTEX_CODEC_MAX_RATIO = 64;
+
+// append the compressed form of numIndices indices to out.
+void EncodeIndexBuffer(const unsigned int* indices, size_t numIndices, std::vector<unsigned char>& out);
+
+// decode numIndices indices from [data, data+size). Returns false if the data is broken.
+bool DecodeIndexBuffer(unsigned int* out, size_t numIndices, const unsigned char* data, size_t size);
+
+// append the compressed form of numVertices vertices of stride bytes to out.
+void EncodeVertexBuffer(const void* vertices, size_t numVertices, size_t stride, std::vector<unsigned char>& out);
+
+// decode numVertices vertices of stride bytes from [data, data+size). Returns false if the data is broken.
+bool DecodeVertexBuffer(void* out, size_t numVertices, size_t stride, const unsigned char* data, size_t size);
@@ -0,0 +1,240 @@
+#include "mesh_gen.hpp"
+#include "normals.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <stdint.h>
+
+// the lines of the .obj are formatted in blocks of this many, that are handled in parallel.
+static const size_t OBJ_WRITE_BLOCK_SIZE = 64 * 1024;
+
+// longest line that is written: "f " and three corners of two 20 digit indices.
+static const size_t OBJ_MAX_LINE_LENGTH = 160;
+
+static const float PI = 3.14159265358979f;
+
+/*
+  Distance from the center of the sphere, in the direction (x, y, z).
+  A few octaves of bumps, each about a third the size of the previous.
+*/
+static float BumpyRadius(float x, float y, float z) {
+    static const float FREQUENCY[] = { 4.0f, 11.0f, 29.0f, 71.0f };
+    static const float AMPLITUDE[] = { 0.06f, 0.02f, 0.007f, 0.002f };
+
+    float r = 1.0f;
+    for(int i = 0; i < 4; ++i) {
+	float f = FREQUENCY[i];
+	r += AMPLITUDE[i] * std::sin(f * x + 1.3f * i) * std::sin(f * y + 0.7f * i) * std::sin(f * z + 2.1f * i);
+    }
+    return r;
+}
+
+void GenerateBumpySphere(
+    size_t numTriangles,
+    std::vector<float>& positions,
+    std::vector<float>& normals,
+    std::vector<unsigned int>& indices,
+    std::vector<ObjShape>& shapes) {
+
+    ThreadPool& pool = GetThreadPool();
+
+    //
+    // With r bands of latitude and 2r columns of longitude there are 4r(r-1)
+    // triangles: a fan at each pole, and two per quad in between.
+    //
+    size_t bands = (size_t)(0.5 + 0.5 * std::sqrt(1.0 + (double)numTriangles));
+    if(bands < 2)
+	bands = 2;
+    size_t columns = 2 * bands;
+    size_t numVertices = 2 + (bands - 1) * columns;
+
+    positions.resize(3 * numVertices);
+    indices.resize(6 * columns * (bands - 1));
+
+    // vertex 0 is the north pole, then come the rings from north to south, then the south pole.
+    pool.ParallelFor(bands + 1, [&](size_t band) {
+	    size_t first = band == 0 ? 0 : band == bands ? numVertices - 1 : 1 + (band - 1) * columns;
+	    size_t count = band == 0 || band == bands ? 1 : columns;
+
+	    float theta = PI * band / bands;
+	    for(size_t j = 0; j < count; ++j) {
+		float phi = 2.0f * PI * j / columns;
+		float x = std::sin(theta) * std::cos(phi);
+		float y = std::cos(theta);
+		float z = std::sin(theta) * std::sin(phi);
+		float r = BumpyRadius(x, y, z);
+
+		float* p = &positions[3 * (first + j)];
+		p[0] = r * x;
+		p[1] = r * y;
+		p[2] = r * z;
+	    }
+	});
+
+    // band i holds the triangles between ring i-1 and ring i, counter-clockwise from the outside.
+    pool.ParallelFor(bands, [&](size_t band) {
+	    unsigned int* out = &indices[band == 0 ? 0 : 3 * (columns + 2 * columns * (band - 1))];
+	    unsigned int north = (unsigned int)(band == 0 ? 0 : 1 + (band - 1) * columns);
+	    unsigned int south = (unsigned int)(band == bands - 1 ? numVertices - 1 : 1 + band * columns);
+
+	    for(size_t j = 0; j < columns; ++j) {
+		unsigned int k = (unsigned int)j;
+		unsigned int l = (unsigned int)((j + 1) % columns);
+
+		if(band == 0) {
+		    *out++ = north; *out++ = south + l; *out++ = south + k;
+		} else if(band == bands - 1) {
+		    *out++ = north + k; *out++ = north + l; *out++ = south;
+		} else {
+		    *out++ = north + k; *out++ = north + l; *out++ = south + l;
+		    *out++ = north + k; *out++ = south + l; *out++ = south + k;
+		}
+	    }
+	});
+
+    normals.resize(3 * numVertices);
+    ComputeSmoothNormals(positions.data(), numVertices, indices.data(), indices.size(), normals.data());
+
+    ObjShape shape;
+    shape.firstIndex = 0;
+    shape.numIndices = (unsigned int)indices.size();
+    shape.baseVertex = 0;
+    shape.numVertices = (unsigned int)numVertices;
+    shapes.assign(1, shape);
+}
+
+static char* FormatUInt(char* p, uint64_t u) {
+    char digits[20];
+    int n = 0;
+    do {
+	digits[n++] = (char)('0' + u % 10);
+	u /= 10;
+    } while(u != 0);
+
+    while(n > 0)
+	*p++ = digits[--n];
+    return p;
+}
+
+// same as "%.6f", but much faster, and only for floats that are not huge.
+static char* FormatFloat(char* p, float f) {
+    double d = f;
+    if(d < 0.0) {
+	*p++ = '-';
+	d = -d;
+    }
+    uint64_t fixed = (uint64_t)(d * 1e6 + 0.5);
+    p = FormatUInt(p, fixed / 1000000);
+    *p++ = '.';
+
+    uint64_t fraction = fixed % 1000000;
+    for(uint64_t digit = 100000; digit != 0; digit /= 10)
+	*p++ = (char)('0' + fraction / digit % 10);
+    return p;
+}
+
+/*
+  Write count lines, formatted by formatLine(p, i), which writes line i at p,
+  and returns the end of the line. The blocks of a batch are formatted in
+  parallel, and then written out in order.
+*/
+static bool WriteLines(FILE* fp, size_t count, const std::function<char*(char*, size_t)>& formatLine) {
+    ThreadPool& pool = GetThreadPool();
+    size_t numBlocks = (count + OBJ_WRITE_BLOCK_SIZE - 1) / OBJ_WRITE_BLOCK_SIZE;
+    size_t batchSize = (size_t)pool.GetNumThreads() * 4;
+
+    std::vector<std::vector<char> > text(batchSize);
+    for(size_t batch = 0; batch < numBlocks; batch += batchSize) {
+	size_t numBatchBlocks = numBlocks - batch < batchSize ? numBlocks - batch : batchSize;
+
+	pool.ParallelFor(numBatchBlocks, [&](size_t b) {
+		size_t begin = (batch + b) * OBJ_WRITE_BLOCK_SIZE;
+		size_t end = begin + OBJ_WRITE_BLOCK_SIZE < count ? begin + OBJ_WRITE_BLOCK_SIZE : count;
+
+		text[b].resize((end - begin) * OBJ_MAX_LINE_LENGTH);
+		char* p = text[b].data();
+		for(size_t i = begin; i < end; ++i)
+		    p = formatLine(p, i);
+		text[b].resize(p - text[b].data());
+	    });
+
+	for(size_t b = 0; b < numBatchBlocks; ++b) {
+	    if(fwrite(text[b].data(), 1, text[b].size(), fp) != text[b].size())
+		return false;
+	}
+    }
+    return true;
+}
+
+bool WriteObjFile(
+    const char* path,
+    const std::vector<float>& positions,
+    const std::vector<float>& normals,
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    std::string& err) {
+
+    FILE* fp = fopen(path, "wb");
+    if(!fp) {
+	err += "Cannot open file for writing [" + std::string(path) + "]\n";
+	return false;
+    }
+
+    bool hasNormals = !normals.empty();
+    bool ok = true;
+
+    for(size_t s = 0; ok && s < shapes.size(); ++s) {
+	const ObjShape& shape = shapes[s];
+	ok = fprintf(fp, "o shape%d\n", (int)s) > 0;
+
+	// .obj indices are global and one-based.
+	const float* v = positions.data() + 3 * (size_t)shape.baseVertex;
+	const float* vn = normals.data() + 3 * (size_t)shape.baseVertex;
+	const unsigned int* f = indices.data() + shape.firstIndex;
+	uint64_t base = (uint64_t)shape.baseVertex + 1;
+
+	ok = ok && WriteLines(fp, shape.numVertices, [&](char* p, size_t i) {
+		*p++ = 'v';
+		for(int c = 0; c < 3; ++c) {
+		    *p++ = ' ';
+		    p = FormatFloat(p, v[3 * i + c]);
+		}
+		*p++ = '\n';
+		return p;
+	    });
+
+	ok = ok && (!hasNormals || WriteLines(fp, shape.numVertices, [&](char* p, size_t i) {
+		    *p++ = 'v';
+		    *p++ = 'n';
+		    for(int c = 0; c < 3; ++c) {
+			*p++ = ' ';
+			p = FormatFloat(p, vn[3 * i + c]);
+		    }
+		    *p++ = '\n';
+		    return p;
+		}));
+
+	ok = ok && WriteLines(fp, shape.numIndices / 3, [&](char* p, size_t i) {
+		*p++ = 'f';
+		for(int c = 0; c < 3; ++c) {
+		    uint64_t index = base + f[3 * i + c];
+		    *p++ = ' ';
+		    p = FormatUInt(p, index);
+		    if(hasNormals) {
+			*p++ = '/';
+			*p++ = '/';
+			p = FormatUInt(p, index);
+		    }
+		}
+		*p++ = '\n';
+		return p;
+	    });
+    }
+
+    ok = fclose(fp) == 0 && ok;
+    if(!ok)
+	err += "Could not write file [" + std::string(path) + "]\n";
+    return ok;
+}
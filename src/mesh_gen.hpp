@@ -0,0 +1,37 @@
+#pragma once
+
+#include "obj_loader.hpp"
+
+#include <string>
+#include <vector>
+
+/*
+  Generates test meshes of any size, so the loader, the mesh cache and the
+  renderer can be measured on more than the one teapot.
+
+  The mesh is a sphere of radius about one, the size of the teapot, with
+  bumps of a few sizes on it, so it is smooth enough to look like a real
+  model at every size. It is a latitude/longitude grid with one vertex at
+  each pole, and about numTriangles triangles in one shape. The vertices
+  are made row by row, and the normals with ComputeSmoothNormals().
+*/
+void GenerateBumpySphere(
+    size_t numTriangles,
+    std::vector<float>& positions,
+    std::vector<float>& normals,
+    std::vector<unsigned int>& indices,
+    std::vector<ObjShape>& shapes);
+
+/*
+  Writes a mesh, in the form LoadObjFile() creates it, to an .obj file, with
+  one 'o' group per shape. The lines are formatted in parallel.
+
+  Returns false and writes a message into err if the file could not be written.
+*/
+bool WriteObjFile(
+    const char* path,
+    const std::vector<float>& positions,
+    const std::vector<float>& normals,
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    std::string& err);
@@ -0,0 +1,580 @@
+#include "mesh_lod.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// the edges on the border of a shape weigh this much more than its triangles, so that the outline keeps its shape.
+static const double BORDER_EDGE_WEIGHT = 10.0;
+
+// no shape is simplified to fewer triangles than this.
+static const size_t LOD_MIN_TRIANGLES = 16;
+
+static const unsigned int NO_VERTEX = (unsigned int)-1;
+
+// the twin of a vertex that shares its position with more than one other vertex.
+static const unsigned int MANY_VERTICES = (unsigned int)-2;
+
+/*
+  The weighted sum of the squared distances from a point to a set of planes,
+  as the symmetric 4x4 matrix of Garland and Heckbert.
+*/
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22; // n n^T,
+    double b0, b1, b2;                   // n d,
+    double c;                            // and d^2, summed over the planes, times their weights.
+    double weight;
+
+    Quadric () : a00(0.0), a01(0.0), a02(0.0), a11(0.0), a12(0.0), a22(0.0), b0(0.0), b1(0.0), b2(0.0), c(0.0), weight(0.0) {}
+
+    // add the plane dot(n, p) + d = 0, where n has unit length.
+    inline void AddPlane (const double* n, double d, double w) {
+	a00 += w * n[0] * n[0]; a01 += w * n[0] * n[1]; a02 += w * n[0] * n[2];
+	a11 += w * n[1] * n[1]; a12 += w * n[1] * n[2]; a22 += w * n[2] * n[2];
+	b0 += w * n[0] * d; b1 += w * n[1] * d; b2 += w * n[2] * d;
+	c += w * d * d;
+	weight += w;
+    }
+
+    inline void Add (const Quadric& q) {
+	a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+	b0 += q.b0; b1 += q.b1; b2 += q.b2;
+	c += q.c;
+	weight += q.weight;
+    }
+
+    inline double Error (const float* p) const {
+	double x = p[0], y = p[1], z = p[2];
+	double e =
+	    a00 * x * x + a11 * y * y + a22 * z * z +
+	    2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+	    2.0 * (b0 * x + b1 * y + b2 * z) + c;
+	return e > 0.0 ? e : 0.0;
+    }
+};
+
+// which edges of a vertex may be collapsed.
+enum VertexKind {
+    VERTEX_MANIFOLD, // into any of its neighbours.
+    VERTEX_BORDER,   // only along the border.
+    VERTEX_SEAM,     // only along the seam, together with its twin.
+    VERTEX_LOCKED    // not at all.
+};
+
+// moving vertex u onto vertex w, and for seams, its twin onto twinW.
+struct EdgeCollapse {
+    unsigned int u;
+    unsigned int w;
+    unsigned int twinW;
+    float cost;
+};
+
+/*
+  Simplifies the triangles of one shape, with local indices below
+  numVertices, step by step. Every step starts from where the last one
+  stopped, so the quadrics and the error keep accumulating.
+*/
+class ShapeSimplifier {
+public:
+    ShapeSimplifier (const unsigned int* indices, size_t numIndices, const float* positions, size_t numVertices);
+
+    // collapse edges until there are at most targetNumIndices indices, or until no edge can be collapsed.
+    void Simplify (size_t targetNumIndices);
+
+    inline const std::vector<unsigned int>& GetIndices () const { return m_indices; }
+
+    // the square root of the largest mean squared distance from where a vertex was
+    // collapsed into, to the planes that it had before the first step.
+    float GetError () const;
+
+private:
+    void FindTwins ();
+    void UpdateAdjacency ();
+    void ClassifyVertices ();
+
+    // whether some triangle has the directed edge a -> b.
+    inline bool HasEdge (unsigned int a, unsigned int b) const;
+
+    inline unsigned int Resolve (unsigned int v) const {
+	while(m_remap[v] != v)
+	    v = m_remap[v];
+	return v;
+    }
+
+    inline const float* Position (unsigned int v) const { return m_positions + 3 * (size_t)v; }
+
+    // whether u may be moved onto w. For seams, twinW is set to where the twin of u goes.
+    bool CanCollapse (unsigned int u, unsigned int w, unsigned int& twinW) const;
+
+    float CollapseCost (unsigned int u, unsigned int w, unsigned int twinW) const;
+
+    // whether moving u onto w would turn one of the triangles of u over.
+    bool FlipsTriangles (unsigned int u, unsigned int w) const;
+
+    // the number of triangles that moving u onto w removes.
+    size_t CountCollapsedTriangles (unsigned int u, unsigned int w) const;
+
+    std::vector<unsigned int> m_indices;
+    const float* m_positions;
+    size_t m_numVertices;
+    size_t m_numTriangles;
+
+    // the triangles of every vertex, for the indices as they were at the start of the current pass.
+    std::vector<size_t> m_firstTriangle;
+    std::vector<unsigned int> m_vertexTriangles;
+
+    std::vector<unsigned int> m_twin;
+    std::vector<unsigned char> m_kind;
+    std::vector<unsigned int> m_borderNext; // the vertex after this one along the border,
+    std::vector<unsigned int> m_borderPrev; // and the one before it.
+
+    std::vector<Quadric> m_quadrics;
+    std::vector<Quadric> m_originalQuadrics; // of every vertex by itself, so the error is measured against the original surface.
+    std::vector<unsigned int> m_remap;       // what every vertex was collapsed into.
+};
+
+ShapeSimplifier::ShapeSimplifier (const unsigned int* indices, size_t numIndices, const float* positions, size_t numVertices)
+    :	m_indices(indices, indices + numIndices),
+	m_positions(positions),
+	m_numVertices(numVertices),
+	m_numTriangles(numIndices / 3),
+	m_quadrics(numVertices),
+	m_remap(numVertices) {
+
+    for(size_t v = 0; v < numVertices; ++v)
+	m_remap[v] = (unsigned int)v;
+
+    FindTwins();
+    UpdateAdjacency();
+
+    //
+    // Every vertex gets the planes of its triangles, weighted by area, and the
+    // planes that stand on its border edges, at a right angle to the triangle.
+    //
+    for(size_t t = 0; t < m_numTriangles; ++t) {
+	const unsigned int* tri = &m_indices[3 * t];
+	const float* p0 = Position(tri[0]);
+	const float* p1 = Position(tri[1]);
+	const float* p2 = Position(tri[2]);
+
+	double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+	double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+	double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+	double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if(length == 0.0)
+	    continue;
+	for(int c = 0; c < 3; ++c)
+	    n[c] /= length;
+
+	double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+	for(int k = 0; k < 3; ++k)
+	    m_quadrics[tri[k]].AddPlane(n, d, 0.5 * length);
+
+	for(int k = 0; k < 3; ++k) {
+	    unsigned int a = tri[k];
+	    unsigned int b = tri[(k + 1) % 3];
+	    if(HasEdge(b, a))
+		continue;
+
+	    const float* pa = Position(a);
+	    const float* pb = Position(b);
+	    double edge[3] = { (double)pb[0] - pa[0], (double)pb[1] - pa[1], (double)pb[2] - pa[2] };
+	    double en[3] = { edge[1] * n[2] - edge[2] * n[1], edge[2] * n[0] - edge[0] * n[2], edge[0] * n[1] - edge[1] * n[0] };
+	    double enLength = std::sqrt(en[0] * en[0] + en[1] * en[1] + en[2] * en[2]);
+	    if(enLength == 0.0)
+		continue;
+	    for(int c = 0; c < 3; ++c)
+		en[c] /= enLength;
+
+	    double ed = -(en[0] * pa[0] + en[1] * pa[1] + en[2] * pa[2]);
+	    double w = BORDER_EDGE_WEIGHT * (edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+	    m_quadrics[a].AddPlane(en, ed, w);
+	    m_quadrics[b].AddPlane(en, ed, w);
+	}
+    }
+    m_originalQuadrics = m_quadrics;
+}
+
+/*
+  Find the vertices that have the same position as some other vertex, by
+  sorting the vertices by position.
+*/
+void ShapeSimplifier::FindTwins () {
+    std::vector<unsigned int> order(m_numVertices);
+    for(size_t v = 0; v < m_numVertices; ++v)
+	order[v] = (unsigned int)v;
+    std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+	    const float* pa = Position(a);
+	    const float* pb = Position(b);
+	    if(pa[0] != pb[0])
+		return pa[0] < pb[0];
+	    if(pa[1] != pb[1])
+		return pa[1] < pb[1];
+	    return pa[2] < pb[2];
+	});
+
+    m_twin.assign(m_numVertices, NO_VERTEX);
+    for(size_t begin = 0; begin < m_numVertices;) {
+	size_t end = begin + 1;
+	while(end < m_numVertices && memcmp(Position(order[begin]), Position(order[end]), 3 * sizeof(float)) == 0)
+	    ++end;
+
+	if(end - begin == 2) {
+	    m_twin[order[begin]] = order[begin + 1];
+	    m_twin[order[begin + 1]] = order[begin];
+	} else if(end - begin > 2) {
+	    for(size_t i = begin; i < end; ++i)
+		m_twin[order[i]] = MANY_VERTICES;
+	}
+	begin = end;
+    }
+}
+
+void ShapeSimplifier::UpdateAdjacency () {
+    m_firstTriangle.assign(m_numVertices + 1, 0);
+    for(size_t i = 0; i < 3 * m_numTriangles; ++i)
+	++m_firstTriangle[m_indices[i] + 1];
+    for(size_t v = 0; v < m_numVertices; ++v)
+	m_firstTriangle[v + 1] += m_firstTriangle[v];
+
+    m_vertexTriangles.resize(3 * m_numTriangles);
+    std::vector<size_t> next(m_firstTriangle.begin(), m_firstTriangle.end() - 1);
+    for(size_t i = 0; i < 3 * m_numTriangles; ++i)
+	m_vertexTriangles[next[m_indices[i]]++] = (unsigned int)(i / 3);
+}
+
+inline bool ShapeSimplifier::HasEdge (unsigned int a, unsigned int b) const {
+    for(size_t i = m_firstTriangle[a]; i < m_firstTriangle[a + 1]; ++i) {
+	const unsigned int* tri = &m_indices[3 * (size_t)m_vertexTriangles[i]];
+	for(int k = 0; k < 3; ++k) {
+	    if(tri[k] == a && tri[(k + 1) % 3] == b)
+		return true;
+	}
+    }
+    return false;
+}
+
+/*
+  An edge is on the border if no triangle has it the other way around. A
+  vertex with exactly one border edge in and one out is on a single border,
+  and is a seam vertex if it has a twin that also is.
+*/
+void ShapeSimplifier::ClassifyVertices () {
+    std::vector<unsigned char> numOut(m_numVertices, 0);
+    std::vector<unsigned char> numIn(m_numVertices, 0);
+    m_borderNext.assign(m_numVertices, NO_VERTEX);
+    m_borderPrev.assign(m_numVertices, NO_VERTEX);
+
+    for(size_t t = 0; t < m_numTriangles; ++t) {
+	const unsigned int* tri = &m_indices[3 * t];
+	for(int k = 0; k < 3; ++k) {
+	    unsigned int a = tri[k];
+	    unsigned int b = tri[(k + 1) % 3];
+	    if(HasEdge(b, a))
+		continue;
+	    m_borderNext[a] = b;
+	    m_borderPrev[b] = a;
+	    numOut[a] = numOut[a] < 2 ? numOut[a] + 1 : 2;
+	    numIn[b] = numIn[b] < 2 ? numIn[b] + 1 : 2;
+	}
+    }
+
+    m_kind.resize(m_numVertices);
+    for(size_t v = 0; v < m_numVertices; ++v) {
+	unsigned int twin = m_twin[v];
+	if(numOut[v] == 0 && numIn[v] == 0) {
+	    // a vertex with a twin that is not on a border is where two parts of the shape touch.
+	    m_kind[v] = twin == NO_VERTEX ? VERTEX_MANIFOLD : VERTEX_LOCKED;
+	} else if(numOut[v] == 1 && numIn[v] == 1) {
+	    if(twin == NO_VERTEX)
+		m_kind[v] = VERTEX_BORDER;
+	    else if(twin != MANY_VERTICES && numOut[twin] == 1 && numIn[twin] == 1)
+		m_kind[v] = VERTEX_SEAM;
+	    else
+		m_kind[v] = VERTEX_LOCKED;
+	} else {
+	    m_kind[v] = VERTEX_LOCKED;
+	}
+    }
+}
+
+bool ShapeSimplifier::CanCollapse (unsigned int u, unsigned int w, unsigned int& twinW) const {
+    twinW = NO_VERTEX;
+
+    switch(m_kind[u]) {
+    case VERTEX_MANIFOLD:
+	return true;
+    case VERTEX_BORDER:
+	return w == m_borderNext[u] || w == m_borderPrev[u];
+    case VERTEX_SEAM: {
+	if(w != m_borderNext[u] && w != m_borderPrev[u])
+	    return false;
+
+	// the twin has to move along its own border, to the vertex at the same place as w.
+	// If w is the twin, that would be u, and the two would be collapsed into each other.
+	unsigned int twin = m_twin[u];
+	if(twin == w)
+	    return false;
+	unsigned int candidates[2] = { m_borderNext[twin], m_borderPrev[twin] };
+	for(int i = 0; i < 2; ++i) {
+	    if(memcmp(Position(candidates[i]), Position(w), 3 * sizeof(float)) == 0) {
+		twinW = candidates[i];
+		return true;
+	    }
+	}
+	return false;
+    }
+    default:
+	return false;
+    }
+}
+
+float ShapeSimplifier::CollapseCost (unsigned int u, unsigned int w, unsigned int twinW) const {
+    double error = m_quadrics[u].Error(Position(w));
+    double weight = m_quadrics[u].weight;
+    if(twinW != NO_VERTEX) {
+	error += m_quadrics[m_twin[u]].Error(Position(twinW));
+	weight += m_quadrics[m_twin[u]].weight;
+    }
+    return weight > 0.0 ? (float)(error / weight) : 0.0f;
+}
+
+bool ShapeSimplifier::FlipsTriangles (unsigned int u, unsigned int w) const {
+    for(size_t i = m_firstTriangle[u]; i < m_firstTriangle[u + 1]; ++i) {
+	const unsigned int* tri = &m_indices[3 * (size_t)m_vertexTriangles[i]];
+	unsigned int v[3] = { Resolve(tri[0]), Resolve(tri[1]), Resolve(tri[2]) };
+
+	// the triangles that already collapsed, and the ones that this collapse removes, can not flip.
+	if(v[0] == v[1] || v[1] == v[2] || v[2] == v[0] || v[0] == w || v[1] == w || v[2] == w)
+	    continue;
+
+	float before[3];
+	float after[3];
+	for(int pass = 0; pass < 2; ++pass) {
+	    const float* p[3];
+	    for(int k = 0; k < 3; ++k)
+		p[k] = Position(pass == 1 && v[k] == u ? w : v[k]);
+
+	    float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+	    float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+	    float* n = pass == 0 ? before : after;
+	    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+
+	if(before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0f)
+	    return true;
+    }
+    return false;
+}
+
+size_t ShapeSimplifier::CountCollapsedTriangles (unsigned int u, unsigned int w) const {
+    size_t count = 0;
+    for(size_t i = m_firstTriangle[u]; i < m_firstTriangle[u + 1]; ++i) {
+	const unsigned int* tri = &m_indices[3 * (size_t)m_vertexTriangles[i]];
+	unsigned int v[3] = { Resolve(tri[0]), Resolve(tri[1]), Resolve(tri[2]) };
+	if(v[0] != v[1] && v[1] != v[2] && v[2] != v[0] && (v[0] == w || v[1] == w || v[2] == w))
+	    ++count;
+    }
+    return count;
+}
+
+void ShapeSimplifier::Simplify (size_t targetNumIndices) {
+    size_t targetNumTriangles = targetNumIndices / 3;
+    std::vector<EdgeCollapse> collapses;
+    std::vector<bool> touched;
+
+    while(m_numTriangles > targetNumTriangles) {
+	UpdateAdjacency();
+	ClassifyVertices();
+
+	//
+	// Find the cheapest collapse of every vertex.
+	//
+	collapses.clear();
+	for(size_t u = 0; u < m_numVertices; ++u) {
+	    EdgeCollapse best;
+	    best.u = (unsigned int)u;
+	    best.w = NO_VERTEX;
+	    best.cost = 0.0f;
+
+	    for(size_t i = m_firstTriangle[u]; i < m_firstTriangle[u + 1]; ++i) {
+		const unsigned int* tri = &m_indices[3 * (size_t)m_vertexTriangles[i]];
+		for(int k = 0; k < 3; ++k) {
+		    unsigned int w = tri[k];
+		    unsigned int twinW;
+		    if(w == u || !CanCollapse((unsigned int)u, w, twinW))
+			continue;
+
+		    float cost = CollapseCost((unsigned int)u, w, twinW);
+		    if(best.w == NO_VERTEX || cost < best.cost) {
+			best.w = w;
+			best.twinW = twinW;
+			best.cost = cost;
+		    }
+		}
+	    }
+	    if(best.w != NO_VERTEX)
+		collapses.push_back(best);
+	}
+
+	std::sort(collapses.begin(), collapses.end(), [](const EdgeCollapse& a, const EdgeCollapse& b) {
+		return a.cost < b.cost;
+	    });
+
+	//
+	// Do the cheapest ones first. A vertex is only part of one collapse per
+	// pass, so the costs that were found stay right.
+	//
+	touched.assign(m_numVertices, false);
+	size_t numCollapsed = 0;
+	for(size_t c = 0; c < collapses.size() && m_numTriangles > targetNumTriangles; ++c) {
+	    const EdgeCollapse& collapse = collapses[c];
+	    unsigned int u = collapse.u;
+	    unsigned int w = collapse.w;
+	    unsigned int twinU = collapse.twinW != NO_VERTEX ? m_twin[u] : NO_VERTEX;
+	    unsigned int twinW = collapse.twinW;
+
+	    if(touched[u] || touched[w])
+		continue;
+	    if(twinU != NO_VERTEX && (touched[twinU] || touched[twinW]))
+		continue;
+	    if(FlipsTriangles(u, w) || (twinU != NO_VERTEX && FlipsTriangles(twinU, twinW)))
+		continue;
+
+	    m_numTriangles -= CountCollapsedTriangles(u, w);
+	    m_remap[u] = w;
+	    m_quadrics[w].Add(m_quadrics[u]);
+	    touched[u] = touched[w] = true;
+
+	    if(twinU != NO_VERTEX) {
+		m_numTriangles -= CountCollapsedTriangles(twinU, twinW);
+		m_remap[twinU] = twinW;
+		m_quadrics[twinW].Add(m_quadrics[twinU]);
+		touched[twinU] = touched[twinW] = true;
+	    }
+
+	    ++numCollapsed;
+	}
+
+	//
+	// Move the collapsed vertices, and remove the triangles that collapsed with them.
+	//
+	size_t out = 0;
+	for(size_t t = 0; t < m_indices.size() / 3; ++t) {
+	    unsigned int v[3] = { Resolve(m_indices[3 * t + 0]), Resolve(m_indices[3 * t + 1]), Resolve(m_indices[3 * t + 2]) };
+	    if(v[0] == v[1] || v[1] == v[2] || v[2] == v[0])
+		continue;
+	    m_indices[out++] = v[0];
+	    m_indices[out++] = v[1];
+	    m_indices[out++] = v[2];
+	}
+	m_indices.resize(out);
+	m_numTriangles = out / 3;
+
+	if(numCollapsed == 0)
+	    break;
+    }
+}
+
+/*
+  The cost of a collapse only says how far the planes of the vertices that
+  moved are from where they went, so a step of cheap collapses may look
+  better than the step before. Instead, every vertex of the original shape
+  is measured from where it ended up.
+*/
+float ShapeSimplifier::GetError () const {
+    double error = 0.0;
+    for(size_t v = 0; v < m_numVertices; ++v) {
+	const Quadric& q = m_originalQuadrics[v];
+	if(q.weight > 0.0)
+	    error = std::max(error, q.Error(Position(Resolve((unsigned int)v))) / q.weight);
+    }
+    return (float)std::sqrt(error);
+}
+
+void BuildLodChain(
+    const std::vector<float>& positions,
+    std::vector<unsigned int>& indices,
+    std::vector<ObjShape>& shapes,
+    std::vector<MeshLod>& lods) {
+
+    size_t numShapes = shapes.size();
+    size_t numIndices = 0;
+    for(size_t s = 0; s < numShapes; ++s)
+	numIndices += shapes[s].numIndices;
+
+    lods.clear();
+    MeshLod model = { 0, (uint32_t)numShapes, 0, 0, (uint32_t)numIndices, 0.0f };
+    lods.push_back(model);
+
+    //
+    // Every shape is simplified on its own, through all the LODs in turn, and the
+    // shapes in parallel.
+    //
+    const int NUM_STEPS = MAX_MESH_LODS - 1;
+    std::vector<std::vector<unsigned int> > stepIndices(numShapes * NUM_STEPS);
+    std::vector<float> stepErrors(numShapes * NUM_STEPS, 0.0f);
+
+    GetThreadPool().ParallelFor(numShapes, [&](size_t s) {
+	    const ObjShape& shape = shapes[s];
+	    ShapeSimplifier simplifier(indices.data() + shape.firstIndex, shape.numIndices,
+				       positions.data() + 3 * (size_t)shape.baseVertex, shape.numVertices);
+
+	    float numTriangles = (float)(shape.numIndices / 3);
+	    for(int step = 0; step < NUM_STEPS; ++step) {
+		numTriangles *= LOD_TRIANGLE_RATIO;
+		size_t target = std::max((size_t)numTriangles, LOD_MIN_TRIANGLES);
+
+		simplifier.Simplify(3 * target);
+		stepIndices[s * NUM_STEPS + step] = simplifier.GetIndices();
+		stepErrors[s * NUM_STEPS + step] = simplifier.GetError();
+	    }
+	});
+
+    //
+    // Keep the LODs that are enough smaller than the one before. SelectLod()
+    // moves on to the next LOD as long as its error is small enough, so a LOD
+    // is dropped if a coarser one has no more error.
+    //
+    std::vector<int> keptSteps;
+    std::vector<MeshLod> keptLods(1, model);
+    for(int step = 0; step < NUM_STEPS; ++step) {
+	MeshLod lod = { 0, (uint32_t)numShapes, 0, 0, 0, 0.0f };
+	for(size_t s = 0; s < numShapes; ++s) {
+	    lod.numIndices += (uint32_t)stepIndices[s * NUM_STEPS + step].size();
+	    lod.error = std::max(lod.error, stepErrors[s * NUM_STEPS + step]);
+	}
+	if((float)lod.numIndices > LOD_MIN_REDUCTION * (float)keptLods.back().numIndices)
+	    break;
+
+	while(!keptSteps.empty() && lod.error <= keptLods.back().error) {
+	    keptSteps.pop_back();
+	    keptLods.pop_back();
+	}
+	keptSteps.push_back(step);
+	keptLods.push_back(lod);
+    }
+
+    //
+    // and append their shapes.
+    //
+    for(size_t i = 0; i < keptSteps.size(); ++i) {
+	int step = keptSteps[i];
+	MeshLod lod = keptLods[i + 1];
+	lod.firstShape = (uint32_t)shapes.size();
+
+	for(size_t s = 0; s < numShapes; ++s) {
+	    const std::vector<unsigned int>& shapeIndices = stepIndices[s * NUM_STEPS + step];
+
+	    ObjShape shape = shapes[s];
+	    shape.firstIndex = (unsigned int)indices.size();
+	    shape.numIndices = (unsigned int)shapeIndices.size();
+	    indices.insert(indices.end(), shapeIndices.begin(), shapeIndices.end());
+	    shapes.push_back(shape);
+	}
+	lods.push_back(lod);
+    }
+}
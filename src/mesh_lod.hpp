@@ -0,0 +1,49 @@
+#pragma once
+
+#include "obj_loader.hpp"
+
+#include <vector>
+#include <stdint.h>
+
+// the most levels of detail a mesh gets, counting the mesh itself as LOD 0.
+static const int MAX_MESH_LODS = 6;
+
+// every LOD aims for this fraction of the triangles of the LOD before it,
+static const float LOD_TRIANGLE_RATIO = 0.5f;
+
+// and is only kept if it has at most this fraction of them.
+static const float LOD_MIN_REDUCTION = 0.8f;
+
+/*
+  One level of detail. Its triangles are shapes of their own, that are
+  stored after the shapes of the LOD before it, and use the same vertices
+  as the shapes of LOD 0.
+*/
+struct MeshLod {
+    uint32_t firstShape;   // in the shapes of the whole mesh.
+    uint32_t numShapes;
+    uint32_t firstMeshlet; // in the meshlets of the whole mesh, filled in by MeshCache::Build().
+    uint32_t numMeshlets;
+    uint32_t numIndices;   // of all the shapes together.
+    float error;           // about how far the triangles are from those of LOD 0, in model units.
+};
+
+/*
+  Build a chain of ever coarser versions of the mesh, with Garland and
+  Heckbert's "Surface Simplification Using Quadric Error Metrics". Edges are
+  collapsed into one of their vertices, so no vertices are added, and the
+  new triangles and shapes are appended to indices and shapes. lods[0] is
+  the mesh as it was.
+
+  Vertices on the border of a shape only move along the border, and the
+  vertices on seams, where two vertices have the same position but not the
+  same normal, move together with their twin, so no cracks open up.
+
+  The error of a LOD is measured against the original mesh, and the errors
+  strictly increase, since a LOD is dropped if a coarser one has no more error.
+*/
+void BuildLodChain(
+    const std::vector<float>& positions,
+    std::vector<unsigned int>& indices,
+    std::vector<ObjShape>& shapes,
+    std::vector<MeshLod>& lods);
@@ -0,0 +1,442 @@
+#include "mesh_optimize.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+// the scoring constants from Forsyth's article.
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+// vertices with more triangles than this left all get the same valence score.
+static const int MAX_VALENCE = 32;
+
+/*
+  Score tables of a cache size. The cache score is for the position in the
+  cache, and the valence score for the number of triangles left.
+*/
+struct VertexScoreTable {
+    float cache[MAX_VERTEX_CACHE_SIZE];
+    float valence[MAX_VALENCE + 1];
+
+    VertexScoreTable (int cacheSize) {
+	for(int i = 0; i < cacheSize; ++i) {
+	    if(i < 3) {
+		// the vertices of the triangle that was just added. They get a fixed,
+		// lower score, so that long thin strips are not favoured.
+		cache[i] = LAST_TRIANGLE_SCORE;
+	    } else {
+		cache[i] = std::pow(1.0f - (float)(i - 3) / (float)(cacheSize - 3), CACHE_DECAY_POWER);
+	    }
+	}
+	valence[0] = 0.0f;
+	for(int i = 1; i <= MAX_VALENCE; ++i)
+	    valence[i] = VALENCE_BOOST_SCALE * std::pow((float)i, -VALENCE_BOOST_POWER);
+    }
+
+    // a vertex with no triangles left is never looked at again, so its score does not matter.
+    inline float Score (int cachePosition, unsigned int numTriangles) const {
+	if(numTriangles == 0)
+	    return -1.0f;
+	float score = cachePosition < 0 ? 0.0f : cache[cachePosition];
+	return score + valence[numTriangles < (unsigned int)MAX_VALENCE ? numTriangles : MAX_VALENCE];
+    }
+};
+
+/*
+  A FIFO vertex cache, like GPUs have, that can be emptied.
+*/
+class FifoCacheSimulator {
+public:
+    FifoCacheSimulator (size_t numVertices, int cacheSize) : m_pushedAt(numVertices, 0), m_cacheSize(cacheSize), m_misses(0), m_flushedAt(0) {}
+
+    // touch vertex v, and return whether it was a miss.
+    inline bool Touch (unsigned int v) {
+	// a vertex is in the cache if it was pushed since the last flush, and at most cacheSize misses ago.
+	if(m_pushedAt[v] > m_flushedAt && m_misses - m_pushedAt[v] < (size_t)m_cacheSize)
+	    return false;
+	m_pushedAt[v] = ++m_misses;
+	return true;
+    }
+
+    inline void Flush () { m_flushedAt = m_misses; }
+
+private:
+    std::vector<size_t> m_pushedAt;
+    int m_cacheSize;
+    size_t m_misses;
+    size_t m_flushedAt;
+};
+
+/*
+  Optimize the triangles of one shape, with local indices below numVertices.
+*/
+static void OptimizeShape(unsigned int* indices, size_t numIndices, size_t numVertices, int cacheSize, const VertexScoreTable& table) {
+    size_t numTriangles = numIndices / 3;
+    if(numTriangles < 2)
+	return;
+
+    //
+    // Find the triangles of every vertex. The first numLive[v] triangles of
+    // vertex v are the ones that are not added yet.
+    //
+    std::vector<unsigned int> numLive(numVertices, 0);
+    for(size_t i = 0; i < 3 * numTriangles; ++i)
+	++numLive[indices[i]];
+
+    std::vector<size_t> firstTriangle(numVertices + 1);
+    firstTriangle[0] = 0;
+    for(size_t v = 0; v < numVertices; ++v)
+	firstTriangle[v + 1] = firstTriangle[v] + numLive[v];
+
+    std::vector<unsigned int> vertexTriangles(3 * numTriangles);
+    {
+	std::vector<size_t> next(firstTriangle.begin(), firstTriangle.end() - 1);
+	for(size_t i = 0; i < 3 * numTriangles; ++i)
+	    vertexTriangles[next[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    std::vector<float> vertexScore(numVertices);
+    std::vector<int> cachePosition(numVertices, -1);
+    for(size_t v = 0; v < numVertices; ++v)
+	vertexScore[v] = table.Score(-1, numLive[v]);
+
+    // start with the triangle with the highest score, which is next to vertices with few triangles.
+    std::vector<bool> added(numTriangles, false);
+    size_t best = 0;
+    float bestScore = -1.0f;
+    for(size_t t = 0; t < numTriangles; ++t) {
+	const unsigned int* tri = indices + 3 * t;
+	float score = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+	if(score > bestScore) {
+	    bestScore = score;
+	    best = t;
+	}
+    }
+
+    // the cache, with room for the three vertices that are pushed out when a triangle is added.
+    unsigned int cache[MAX_VERTEX_CACHE_SIZE + 3];
+    unsigned int newCache[MAX_VERTEX_CACHE_SIZE + 3];
+    int cacheUsed = 0;
+
+    std::vector<unsigned int> output(3 * numTriangles);
+    size_t nextInOrder = 0; // for when the cache has no triangles left, the first triangle that is not added yet.
+
+    for(size_t out = 0; out < numTriangles; ++out) {
+	if(best == (size_t)-1) {
+	    while(added[nextInOrder])
+		++nextInOrder;
+	    best = nextInOrder;
+	}
+
+	const unsigned int* tri = indices + 3 * best;
+	output[3 * out + 0] = tri[0];
+	output[3 * out + 1] = tri[1];
+	output[3 * out + 2] = tri[2];
+	added[best] = true;
+
+	// the triangle is no longer live for its vertices.
+	for(int k = 0; k < 3; ++k) {
+	    unsigned int v = tri[k];
+	    unsigned int* triangles = &vertexTriangles[firstTriangle[v]];
+	    for(unsigned int i = 0; i < numLive[v]; ++i) {
+		if(triangles[i] == best) {
+		    triangles[i] = triangles[numLive[v] - 1];
+		    triangles[numLive[v] - 1] = (unsigned int)best;
+		    --numLive[v];
+		    break;
+		}
+	    }
+	}
+
+	// the vertices of the triangle move to the front of the cache.
+	int newUsed = 0;
+	for(int k = 0; k < 3; ++k) {
+	    if(k == 0 || (tri[k] != tri[0] && (k == 1 || tri[k] != tri[1])))
+		newCache[newUsed++] = tri[k];
+	}
+	for(int i = 0; i < cacheUsed; ++i) {
+	    unsigned int v = cache[i];
+	    if(v != tri[0] && v != tri[1] && v != tri[2])
+		newCache[newUsed++] = v;
+	}
+
+	// update the scores of the vertices in the cache, and of the ones that were pushed out.
+	for(int i = 0; i < newUsed; ++i) {
+	    unsigned int v = newCache[i];
+	    cachePosition[v] = i < cacheSize ? i : -1;
+	    vertexScore[v] = table.Score(cachePosition[v], numLive[v]);
+	}
+
+	// and find the best triangle of the vertices that are still in the cache.
+	bestScore = -1.0f;
+	best = (size_t)-1;
+	for(int i = 0; i < newUsed; ++i) {
+	    unsigned int v = newCache[i];
+	    const unsigned int* triangles = &vertexTriangles[firstTriangle[v]];
+	    for(unsigned int j = 0; j < numLive[v]; ++j) {
+		unsigned int t = triangles[j];
+		const unsigned int* other = indices + 3 * (size_t)t;
+		float score = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+		if(score > bestScore) {
+		    bestScore = score;
+		    best = t;
+		}
+	    }
+	}
+
+	cacheUsed = newUsed < cacheSize ? newUsed : cacheSize;
+	for(int i = 0; i < cacheUsed; ++i)
+	    cache[i] = newCache[i];
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void OptimizeVertexCache(std::vector<unsigned int>& indices, const std::vector<ObjShape>& shapes, int cacheSize) {
+    if(cacheSize < 4)
+	cacheSize = 4;
+    if(cacheSize > MAX_VERTEX_CACHE_SIZE)
+	cacheSize = MAX_VERTEX_CACHE_SIZE;
+    VertexScoreTable table(cacheSize);
+
+    GetThreadPool().ParallelFor(shapes.size(), [&](size_t s) {
+	    const ObjShape& shape = shapes[s];
+	    OptimizeShape(indices.data() + shape.firstIndex, shape.numIndices, shape.numVertices, cacheSize, table);
+	});
+}
+
+float ComputeACMR(const std::vector<unsigned int>& indices, const std::vector<ObjShape>& shapes, int cacheSize) {
+    std::atomic<size_t> misses(0);
+    size_t numTriangles = 0;
+
+    GetThreadPool().ParallelFor(shapes.size(), [&](size_t s) {
+	    const ObjShape& shape = shapes[s];
+	    const unsigned int* shapeIndices = indices.data() + shape.firstIndex;
+
+	    FifoCacheSimulator cache(shape.numVertices, cacheSize);
+	    size_t shapeMisses = 0;
+	    for(size_t i = 0; i < shape.numIndices; ++i)
+		shapeMisses += cache.Touch(shapeIndices[i]) ? 1 : 0;
+	    misses += shapeMisses;
+	});
+
+    for(size_t s = 0; s < shapes.size(); ++s)
+	numTriangles += shapes[s].numIndices / 3;
+    return numTriangles == 0 ? 0.0f : (float)misses / (float)numTriangles;
+}
+
+// the triangles [begin, end) of a shape, and the key they are sorted by.
+struct TriangleCluster {
+    size_t begin;
+    size_t end;
+    float sortKey;
+};
+
+/*
+  Optimize the overdraw of one shape, with local indices below numVertices.
+*/
+static void OptimizeShapeOverdraw(unsigned int* indices, size_t numIndices, size_t numVertices, const float* positions, int cacheSize, float threshold) {
+    size_t numTriangles = numIndices / 3;
+    if(numTriangles < 2)
+	return;
+
+    //
+    // Hard boundaries: the triangles where all three vertices miss, which is
+    // where the optimizer started somewhere new.
+    //
+    std::vector<int> misses(numTriangles);
+    std::vector<size_t> hardBoundaries;
+    {
+	FifoCacheSimulator cache(numVertices, cacheSize);
+	for(size_t t = 0; t < numTriangles; ++t) {
+	    const unsigned int* tri = indices + 3 * t;
+	    misses[t] = (int)cache.Touch(tri[0]) + (int)cache.Touch(tri[1]) + (int)cache.Touch(tri[2]);
+	    if(t == 0 || misses[t] == 3)
+		hardBoundaries.push_back(t);
+	}
+	hardBoundaries.push_back(numTriangles);
+    }
+
+    //
+    // Soft boundaries: cut a cluster as soon as it would use the cache almost as
+    // well on its own, starting from an empty cache, as the whole hard cluster.
+    //
+    std::vector<TriangleCluster> clusters;
+    FifoCacheSimulator cache(numVertices, cacheSize);
+    for(size_t h = 0; h + 1 < hardBoundaries.size(); ++h) {
+	size_t begin = hardBoundaries[h];
+	size_t end = hardBoundaries[h + 1];
+
+	int hardMisses = 0;
+	for(size_t t = begin; t < end; ++t)
+	    hardMisses += misses[t];
+	float maxAcmr = threshold * (float)hardMisses / (float)(end - begin);
+
+	TriangleCluster cluster;
+	cluster.begin = begin;
+	cache.Flush();
+	int clusterMisses = 0;
+	for(size_t t = begin; t < end; ++t) {
+	    const unsigned int* tri = indices + 3 * t;
+	    clusterMisses += (int)cache.Touch(tri[0]) + (int)cache.Touch(tri[1]) + (int)cache.Touch(tri[2]);
+
+	    if(t + 1 == end || (float)clusterMisses <= maxAcmr * (float)(t + 1 - cluster.begin)) {
+		cluster.end = t + 1;
+		clusters.push_back(cluster);
+		cluster.begin = t + 1;
+		cache.Flush();
+		clusterMisses = 0;
+	    }
+	}
+    }
+
+    //
+    // Sort the clusters by how much they face away from the center of the shape.
+    // The centers and normals are area weighted.
+    //
+    std::vector<float> clusterCenters(3 * clusters.size(), 0.0f);
+    std::vector<float> clusterNormals(3 * clusters.size(), 0.0f);
+    std::vector<float> clusterAreas(clusters.size(), 0.0f);
+    for(size_t c = 0; c < clusters.size(); ++c) {
+	float* center = &clusterCenters[3 * c];
+	float* normal = &clusterNormals[3 * c];
+
+	for(size_t t = clusters[c].begin; t < clusters[c].end; ++t) {
+	    const float* p0 = positions + 3 * (size_t)indices[3 * t + 0];
+	    const float* p1 = positions + 3 * (size_t)indices[3 * t + 1];
+	    const float* p2 = positions + 3 * (size_t)indices[3 * t + 2];
+
+	    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+	    float n[3] = {
+		e1[1] * e2[2] - e1[2] * e2[1],
+		e1[2] * e2[0] - e1[0] * e2[2],
+		e1[0] * e2[1] - e1[1] * e2[0]
+	    };
+	    float area = 0.5f * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+	    for(int k = 0; k < 3; ++k) {
+		center[k] += area * (p0[k] + p1[k] + p2[k]) / 3.0f;
+		normal[k] += n[k];
+	    }
+	    clusterAreas[c] += area;
+	}
+    }
+
+    float shapeCenter[3] = { 0.0f, 0.0f, 0.0f };
+    float shapeArea = 0.0f;
+    for(size_t c = 0; c < clusters.size(); ++c) {
+	for(int k = 0; k < 3; ++k)
+	    shapeCenter[k] += clusterCenters[3 * c + k];
+	shapeArea += clusterAreas[c];
+    }
+    for(int k = 0; k < 3; ++k)
+	shapeCenter[k] = shapeArea > 0.0f ? shapeCenter[k] / shapeArea : 0.0f;
+
+    for(size_t c = 0; c < clusters.size(); ++c) {
+	const float* normal = &clusterNormals[3 * c];
+	float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+	float key = 0.0f;
+	if(clusterAreas[c] > 0.0f && length > 0.0f) {
+	    for(int k = 0; k < 3; ++k)
+		key += (clusterCenters[3 * c + k] / clusterAreas[c] - shapeCenter[k]) * normal[k] / length;
+	}
+	clusters[c].sortKey = key;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const TriangleCluster& a, const TriangleCluster& b) {
+	    return a.sortKey > b.sortKey;
+	});
+
+    std::vector<unsigned int> output;
+    output.reserve(3 * numTriangles);
+    for(size_t c = 0; c < clusters.size(); ++c)
+	output.insert(output.end(), indices + 3 * clusters[c].begin, indices + 3 * clusters[c].end);
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void OptimizeOverdraw(
+    std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    const std::vector<float>& positions,
+    int cacheSize,
+    float threshold) {
+
+    GetThreadPool().ParallelFor(shapes.size(), [&](size_t s) {
+	    const ObjShape& shape = shapes[s];
+	    OptimizeShapeOverdraw(indices.data() + shape.firstIndex, shape.numIndices, shape.numVertices,
+				  positions.data() + 3 * (size_t)shape.baseVertex, cacheSize, threshold);
+	});
+}
+
+void OptimizeVertexFetch(
+    std::vector<float>& positions,
+    std::vector<float>& normals,
+    std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes) {
+
+    GetThreadPool().ParallelFor(shapes.size(), [&](size_t s) {
+	    const ObjShape& shape = shapes[s];
+	    unsigned int* shapeIndices = indices.data() + shape.firstIndex;
+
+	    // the new number of every vertex.
+	    const unsigned int UNUSED = (unsigned int)-1;
+	    std::vector<unsigned int> remap(shape.numVertices, UNUSED);
+	    unsigned int next = 0;
+	    for(size_t i = 0; i < shape.numIndices; ++i) {
+		unsigned int& v = remap[shapeIndices[i]];
+		if(v == UNUSED)
+		    v = next++;
+		shapeIndices[i] = v;
+	    }
+	    for(size_t v = 0; v < shape.numVertices; ++v) {
+		if(remap[v] == UNUSED)
+		    remap[v] = next++;
+	    }
+
+	    std::vector<float> old;
+	    for(int array = 0; array < 2; ++array) {
+		std::vector<float>& values = array == 0 ? positions : normals;
+		if(values.empty())
+		    continue;
+		float* shapeValues = values.data() + 3 * (size_t)shape.baseVertex;
+
+		old.assign(shapeValues, shapeValues + 3 * (size_t)shape.numVertices);
+		for(size_t v = 0; v < shape.numVertices; ++v) {
+		    for(int c = 0; c < 3; ++c)
+			shapeValues[3 * (size_t)remap[v] + c] = old[3 * v + c];
+		}
+	    }
+	});
+}
+
+// the vertices are interleaved in blocks of this many, that are handled in parallel.
+static const size_t INTERLEAVE_BLOCK_SIZE = 64 * 1024;
+
+void InterleaveVertices(const VertexAttribute* attributes, int numAttributes, size_t numVertices, size_t stride, void* out) {
+    size_t numBlocks = (numVertices + INTERLEAVE_BLOCK_SIZE - 1) / INTERLEAVE_BLOCK_SIZE;
+
+    GetThreadPool().ParallelFor(numBlocks, [&](size_t b) {
+	    size_t begin = b * INTERLEAVE_BLOCK_SIZE;
+	    size_t end = begin + INTERLEAVE_BLOCK_SIZE < numVertices ? begin + INTERLEAVE_BLOCK_SIZE : numVertices;
+	    char* dst = (char*)out + begin * stride;
+	    memset(dst, 0, (end - begin) * stride);
+
+	    size_t offset = 0;
+	    for(int a = 0; a < numAttributes; ++a) {
+		const VertexAttribute& attribute = attributes[a];
+		if(attribute.data) {
+		    const char* src = (const char*)attribute.data + begin * attribute.size;
+		    for(size_t v = 0; v < end - begin; ++v)
+			memcpy(dst + v * stride + offset, src + v * attribute.size, attribute.size);
+		}
+		offset += attribute.size;
+	    }
+	});
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "obj_loader.hpp"
+
+#include <vector>
+
+/*
+  Load time passes that reorder a mesh, in the form LoadObjFile() creates it,
+  so that it is faster to draw. Each shape is handled on its own, and the
+  shapes are handled in parallel.
+*/
+
+// the largest post-transform vertex cache that OptimizeVertexCache() can optimize for.
+static const int MAX_VERTEX_CACHE_SIZE = 64;
+
+// the settings that tess_opt optimizes its meshes with, and mesh_report reports on.
+// The triangles are ordered for a post-transform vertex cache of this many vertices.
+// The order is stored in the mesh cache, so delete it after changing this.
+static const int VERTEX_CACHE_SIZE = 16;
+
+// to reduce overdraw, the triangles may be reordered so that the ACMR gets this much worse.
+static const float OVERDRAW_THRESHOLD = 1.05f;
+
+/*
+  Reorder the triangles of every shape so that the post-transform vertex
+  cache of the GPU is used well, with Tom Forsyth's "Linear-Speed Vertex
+  Cache Optimisation". Every vertex gets a score from its position in a
+  simulated LRU cache of cacheSize vertices, and from how many triangles it
+  still has left, and the triangle with the highest score goes next.
+
+  The triangles themselves are not changed, only their order.
+*/
+void OptimizeVertexCache(std::vector<unsigned int>& indices, const std::vector<ObjShape>& shapes, int cacheSize);
+
+/*
+  The average cache miss ratio of the mesh: the number of vertices the
+  vertex shader has to run for, per triangle, with a FIFO cache of cacheSize
+  vertices, like GPUs have. 0.5 is the best possible for a big regular mesh,
+  and 3 the worst.
+*/
+float ComputeACMR(const std::vector<unsigned int>& indices, const std::vector<ObjShape>& shapes, int cacheSize);
+
+/*
+  Reorder the triangles of every shape to reduce overdraw, like the second
+  half of Sander et al.'s "Fast Triangle Reordering for Vertex Locality and
+  Reduced Overdraw". Meant to run after OptimizeVertexCache().
+
+  The triangles are split into clusters, first wherever the simulated cache
+  starts over, and then wherever a cluster has an ACMR no more than
+  threshold times that of the cluster it is cut from, so the vertex cache is
+  used almost as well as before. The clusters are then sorted so that the
+  ones that face away from the center of the shape come first, since those
+  tend to hide the rest from any viewpoint, and so early-Z can reject more
+  of the fragments drawn after them.
+*/
+void OptimizeOverdraw(
+    std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    const std::vector<float>& positions,
+    int cacheSize,
+    float threshold);
+
+/*
+  Renumber the vertices of every shape in the order the triangles first use
+  them, and move them in the arrays to match, so the GPU reads the vertex
+  buffer mostly front to back. Meant to run after the triangles have their
+  final order. Vertices that no triangle uses end up last. normals may be
+  empty.
+*/
+void OptimizeVertexFetch(
+    std::vector<float>& positions,
+    std::vector<float>& normals,
+    std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes);
+
+// one array of InterleaveVertices(), of size bytes per vertex. If data is NULL, zeros are written.
+struct VertexAttribute {
+    const void* data;
+    size_t size;
+};
+
+/*
+  Interleave numAttributes arrays into out, with stride bytes per vertex,
+  so that all the attributes of a vertex are read from the same cache line.
+  The bytes after the last attribute are zeroed.
+*/
+void InterleaveVertices(const VertexAttribute* attributes, int numAttributes, size_t numVertices, size_t stride, void* out);
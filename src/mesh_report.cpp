@@ -0,0 +1,314 @@
+#include "mesh_report.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+// the vertex fetches read cache lines of this many bytes, through a cache of this many lines.
+static const size_t FETCH_LINE_SIZE = 64;
+static const size_t FETCH_CACHE_LINES = 128;
+
+/*
+  A FIFO cache of ids below numIds. An id is in the cache if it was pushed
+  at most cacheSize misses ago.
+*/
+class FifoCache {
+public:
+    FifoCache (size_t numIds, size_t cacheSize) : m_pushedAt(numIds, 0), m_cacheSize(cacheSize), m_misses(0) {}
+
+    // touch id, and return whether it was a miss.
+    inline bool Touch (size_t id) {
+	if(m_pushedAt[id] > 0 && m_misses - m_pushedAt[id] < m_cacheSize)
+	    return false;
+	m_pushedAt[id] = ++m_misses;
+	return true;
+    }
+
+private:
+    std::vector<size_t> m_pushedAt;
+    size_t m_cacheSize;
+    size_t m_misses;
+};
+
+/*
+  An LRU cache. The caches are small, so it is simply an array with the
+  most recently used id first.
+*/
+class LruCache {
+public:
+    LruCache (size_t cacheSize) : m_cacheSize(cacheSize) {}
+
+    // touch id, and return whether it was a miss.
+    inline bool Touch (unsigned int id) {
+	std::vector<unsigned int>::iterator it = std::find(m_ids.begin(), m_ids.end(), id);
+	bool miss = it == m_ids.end();
+	if(miss) {
+	    if(m_ids.size() < m_cacheSize)
+		m_ids.push_back(id);
+	    it = m_ids.end() - 1;
+	}
+	std::rotate(m_ids.begin(), it, it + 1);
+	m_ids[0] = id;
+	return miss;
+    }
+
+private:
+    std::vector<unsigned int> m_ids;
+    size_t m_cacheSize;
+};
+
+VertexCacheStats AnalyzeVertexCache(
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    VertexCacheKind kind,
+    int cacheSize) {
+
+    std::atomic<size_t> misses(0);
+    std::atomic<size_t> usedVertices(0);
+
+    GetThreadPool().ParallelFor(shapes.size(), [&](size_t s) {
+	    const ObjShape& shape = shapes[s];
+	    const unsigned int* shapeIndices = indices.data() + shape.firstIndex;
+
+	    FifoCache fifo(kind == VERTEX_CACHE_FIFO ? shape.numVertices : 0, cacheSize);
+	    LruCache lru(cacheSize);
+	    std::vector<bool> used(shape.numVertices, false);
+	    size_t shapeMisses = 0;
+	    size_t shapeUsed = 0;
+	    for(size_t i = 0; i < shape.numIndices; ++i) {
+		unsigned int v = shapeIndices[i];
+		bool miss = kind == VERTEX_CACHE_FIFO ? fifo.Touch(v) : lru.Touch(v);
+		shapeMisses += miss ? 1 : 0;
+		if(!used[v]) {
+		    used[v] = true;
+		    ++shapeUsed;
+		}
+	    }
+	    misses += shapeMisses;
+	    usedVertices += shapeUsed;
+	});
+
+    size_t numTriangles = 0;
+    for(size_t s = 0; s < shapes.size(); ++s)
+	numTriangles += shapes[s].numIndices / 3;
+
+    VertexCacheStats stats;
+    stats.kind = kind;
+    stats.cacheSize = cacheSize;
+    stats.acmr = numTriangles == 0 ? 0.0f : (float)misses / (float)numTriangles;
+    stats.atvr = usedVertices == 0 ? 0.0f : (float)misses / (float)usedVertices;
+    return stats;
+}
+
+static inline void Cross(const float* a, const float* b, float* out) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline void Normalize(float* v) {
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for(int k = 0; k < 3; ++k)
+	v[k] /= length;
+}
+
+// whether the edge from a to b is a top or a left edge of a counter-clockwise triangle, with y up.
+static inline bool IsTopLeft(const float* a, const float* b) {
+    return (a[1] == b[1] && b[0] < a[0]) || b[1] < a[1];
+}
+
+/*
+  Draw the triangles into depth, of resolution by resolution pixels, and
+  return the number of fragments that passed the depth test. screen has x
+  and y in pixels and the depth, per vertex.
+*/
+static size_t RasterizeTriangles(
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    const std::vector<float>& screen,
+    int resolution,
+    std::vector<float>& depth) {
+
+    size_t passed = 0;
+    for(size_t s = 0; s < shapes.size(); ++s) {
+	const ObjShape& shape = shapes[s];
+	const unsigned int* shapeIndices = indices.data() + shape.firstIndex;
+
+	for(size_t t = 0; t < shape.numIndices / 3; ++t) {
+	    const float* p[3];
+	    for(int k = 0; k < 3; ++k)
+		p[k] = &screen[3 * ((size_t)shape.baseVertex + shapeIndices[3 * t + k])];
+
+	    // the back faces, and the ones that cover no area, are culled.
+	    float area = (p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) - (p[1][1] - p[0][1]) * (p[2][0] - p[0][0]);
+	    if(area <= 0.0f)
+		continue;
+
+	    float minX = std::min(p[0][0], std::min(p[1][0], p[2][0]));
+	    float maxX = std::max(p[0][0], std::max(p[1][0], p[2][0]));
+	    float minY = std::min(p[0][1], std::min(p[1][1], p[2][1]));
+	    float maxY = std::max(p[0][1], std::max(p[1][1], p[2][1]));
+	    int x0 = std::max((int)std::ceil(minX - 0.5f), 0);
+	    int x1 = std::min((int)std::floor(maxX - 0.5f), resolution - 1);
+	    int y0 = std::max((int)std::ceil(minY - 0.5f), 0);
+	    int y1 = std::min((int)std::floor(maxY - 0.5f), resolution - 1);
+
+	    bool topLeft[3];
+	    for(int k = 0; k < 3; ++k)
+		topLeft[k] = IsTopLeft(p[(k + 1) % 3], p[(k + 2) % 3]);
+
+	    for(int y = y0; y <= y1; ++y) {
+		for(int x = x0; x <= x1; ++x) {
+		    float px = x + 0.5f;
+		    float py = y + 0.5f;
+
+		    // w[k] is the weight of vertex k, from the edge across from it.
+		    float w[3];
+		    bool inside = true;
+		    for(int k = 0; k < 3 && inside; ++k) {
+			const float* a = p[(k + 1) % 3];
+			const float* b = p[(k + 2) % 3];
+			w[k] = (b[0] - a[0]) * (py - a[1]) - (b[1] - a[1]) * (px - a[0]);
+			inside = w[k] > 0.0f || (w[k] == 0.0f && topLeft[k]);
+		    }
+		    if(!inside)
+			continue;
+
+		    float z = (w[0] * p[0][2] + w[1] * p[1][2] + w[2] * p[2][2]) / area;
+		    float& d = depth[(size_t)y * resolution + x];
+		    if(z < d) {
+			d = z;
+			++passed;
+		    }
+		}
+	    }
+	}
+    }
+    return passed;
+}
+
+OverdrawStats AnalyzeOverdraw(
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    const std::vector<float>& positions,
+    int numDirections,
+    int resolution) {
+
+    size_t numVertices = positions.size() / 3;
+
+    // every view is fitted to the bounding sphere of the mesh.
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    float radius = 0.0f;
+    if(numVertices > 0) {
+	float lo[3], hi[3];
+	for(int k = 0; k < 3; ++k)
+	    lo[k] = hi[k] = positions[k];
+	for(size_t v = 0; v < numVertices; ++v) {
+	    for(int k = 0; k < 3; ++k) {
+		lo[k] = std::min(lo[k], positions[3 * v + k]);
+		hi[k] = std::max(hi[k], positions[3 * v + k]);
+	    }
+	}
+	for(int k = 0; k < 3; ++k)
+	    center[k] = 0.5f * (lo[k] + hi[k]);
+	for(size_t v = 0; v < numVertices; ++v) {
+	    float d[3] = { positions[3 * v] - center[0], positions[3 * v + 1] - center[1], positions[3 * v + 2] - center[2] };
+	    radius = std::max(radius, std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+	}
+    }
+    if(radius == 0.0f)
+	radius = 1.0f;
+
+    std::atomic<size_t> passed(0);
+    std::atomic<size_t> covered(0);
+
+    GetThreadPool().ParallelFor((size_t)numDirections, [&](size_t i) {
+	    // the camera sits on a Fibonacci spiral around the mesh, and looks at its center.
+	    const float GOLDEN_ANGLE = 2.39996323f;
+	    float z = 1.0f - (2.0f * i + 1.0f) / numDirections;
+	    float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+	    float back[3] = { r * std::cos(GOLDEN_ANGLE * i), z, r * std::sin(GOLDEN_ANGLE * i) };
+
+	    float forward[3] = { -back[0], -back[1], -back[2] };
+	    float worldUp[3] = { 0.0f, 1.0f, 0.0f };
+	    if(std::fabs(forward[1]) > 0.99f) {
+		worldUp[1] = 0.0f;
+		worldUp[2] = 1.0f;
+	    }
+	    float right[3], up[3];
+	    Cross(forward, worldUp, right);
+	    Normalize(right);
+	    Cross(right, forward, up);
+
+	    float pixelsPerUnit = 0.5f * resolution / radius;
+	    std::vector<float> screen(3 * numVertices);
+	    for(size_t v = 0; v < numVertices; ++v) {
+		float d[3] = { positions[3 * v] - center[0], positions[3 * v + 1] - center[1], positions[3 * v + 2] - center[2] };
+		screen[3 * v + 0] = 0.5f * resolution + pixelsPerUnit * (d[0] * right[0] + d[1] * right[1] + d[2] * right[2]);
+		screen[3 * v + 1] = 0.5f * resolution + pixelsPerUnit * (d[0] * up[0] + d[1] * up[1] + d[2] * up[2]);
+		screen[3 * v + 2] = radius - (d[0] * back[0] + d[1] * back[1] + d[2] * back[2]);
+	    }
+
+	    std::vector<float> depth((size_t)resolution * resolution, std::numeric_limits<float>::infinity());
+	    passed += RasterizeTriangles(indices, shapes, screen, resolution, depth);
+
+	    size_t directionCovered = 0;
+	    for(size_t p = 0; p < depth.size(); ++p)
+		directionCovered += depth[p] != std::numeric_limits<float>::infinity() ? 1 : 0;
+	    covered += directionCovered;
+	});
+
+    OverdrawStats stats;
+    stats.numDirections = numDirections;
+    stats.resolution = resolution;
+    stats.overdraw = covered == 0 ? 0.0f : (float)passed / (float)covered;
+    return stats;
+}
+
+VertexFetchStats AnalyzeVertexFetch(
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    size_t stride,
+    int cacheSize) {
+
+    std::atomic<size_t> fetchedLines(0);
+    std::atomic<size_t> usedVertices(0);
+
+    GetThreadPool().ParallelFor(shapes.size(), [&](size_t s) {
+	    const ObjShape& shape = shapes[s];
+	    const unsigned int* shapeIndices = indices.data() + shape.firstIndex;
+
+	    // the lines are counted from the first line of the shape.
+	    size_t begin = (size_t)shape.baseVertex * stride;
+	    size_t firstLine = begin / FETCH_LINE_SIZE;
+	    size_t numLines = (begin + (size_t)shape.numVertices * stride + FETCH_LINE_SIZE - 1) / FETCH_LINE_SIZE - firstLine;
+
+	    FifoCache vertexCache(shape.numVertices, cacheSize);
+	    FifoCache lineCache(numLines, FETCH_CACHE_LINES);
+	    std::vector<bool> used(shape.numVertices, false);
+	    size_t shapeLines = 0;
+	    size_t shapeUsed = 0;
+	    for(size_t i = 0; i < shape.numIndices; ++i) {
+		unsigned int v = shapeIndices[i];
+		if(!used[v]) {
+		    used[v] = true;
+		    ++shapeUsed;
+		}
+		if(!vertexCache.Touch(v))
+		    continue;
+
+		size_t offset = begin + (size_t)v * stride;
+		for(size_t line = offset / FETCH_LINE_SIZE; line <= (offset + stride - 1) / FETCH_LINE_SIZE; ++line)
+		    shapeLines += lineCache.Touch(line - firstLine) ? 1 : 0;
+	    }
+	    fetchedLines += shapeLines;
+	    usedVertices += shapeUsed;
+	});
+
+    VertexFetchStats stats;
+    stats.stride = stride;
+    stats.efficiency = fetchedLines == 0 ? 0.0f : (float)(usedVertices * stride) / (float)(fetchedLines * FETCH_LINE_SIZE);
+    return stats;
+}
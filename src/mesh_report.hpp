@@ -0,0 +1,71 @@
+#pragma once
+
+#include "obj_loader.hpp"
+
+#include <vector>
+
+/*
+  Measures of how well the triangle and vertex order of a mesh suits the
+  GPU, computed without one, so that the passes of mesh_optimize.hpp can be
+  compared. Every shape is a draw of its own, so the simulated caches start
+  out empty for every shape.
+*/
+
+enum VertexCacheKind {
+    VERTEX_CACHE_FIFO = 0, // like the post-transform caches of most GPUs.
+    VERTEX_CACHE_LRU = 1   // what OptimizeVertexCache() assumes.
+};
+
+struct VertexCacheStats {
+    VertexCacheKind kind;
+    int cacheSize;
+    float acmr; // vertex shader runs per triangle. 0.5 is the best possible for a big regular mesh, and 3 the worst.
+    float atvr; // vertex shader runs per vertex that is used. 1 is the best possible.
+};
+
+/*
+  Simulate a post-transform vertex cache of cacheSize vertices over the
+  triangles of every shape, in the order they are drawn.
+*/
+VertexCacheStats AnalyzeVertexCache(
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    VertexCacheKind kind,
+    int cacheSize);
+
+struct OverdrawStats {
+    int numDirections;
+    int resolution;
+    float overdraw; // fragments that pass the depth test per covered pixel, over all directions. 1 is the best possible.
+};
+
+/*
+  Rasterize the mesh in software, from numDirections directions spread
+  evenly around it, into a depth buffer of resolution by resolution pixels
+  with an orthographic camera. The triangles are drawn in order, with back
+  face culling like the renderer, and every fragment that passes the depth
+  test is counted, since it would run the fragment shader with early-Z.
+*/
+OverdrawStats AnalyzeOverdraw(
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    const std::vector<float>& positions,
+    int numDirections,
+    int resolution);
+
+struct VertexFetchStats {
+    size_t stride;    // bytes per vertex.
+    float efficiency; // bytes of the vertices that are used, per byte read from memory. 1 is the best possible.
+};
+
+/*
+  Simulate the vertex fetches of the GPU, for interleaved vertices of
+  stride bytes. A vertex is only fetched when it misses a FIFO
+  post-transform cache of cacheSize vertices, and the fetches read whole
+  cache lines through a small cache of lines.
+*/
+VertexFetchStats AnalyzeVertexFetch(
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    size_t stride,
+    int cacheSize);
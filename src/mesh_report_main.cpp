@@ -0,0 +1,163 @@
+#include "obj_loader.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_report.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+  A headless tool that reports how well the layout of a mesh suits the GPU,
+  as JSON on stdout, so that layout optimizations can be compared without
+  one. The layout of the .obj, as it is parsed, is reported, and then the
+  layout after every pass that tess_opt runs on it before it goes into the
+  mesh cache, in the same order and with the same settings. If the mesh
+  cache of the .obj is up to date, the layout that tess_opt draws from it
+  is reported last.
+*/
+
+// the vertex cache sizes that are simulated. OptimizeVertexCache() is run for VERTEX_CACHE_SIZE by tess_opt.
+const int REPORT_CACHE_SIZES[] = { 8, 16, 32, 64 };
+
+// the fetches are simulated with the post-transform cache of this size.
+const int FETCH_CACHE_SIZE = 16;
+
+// the strides of the interleaved vertex formats of tess_opt, quantized and not.
+const size_t REPORT_STRIDES[] = { INTERLEAVED_QUANTIZED_STRIDE, INTERLEAVED_STRIDE };
+
+const int DEFAULT_OVERDRAW_DIRECTIONS = 16;
+const int DEFAULT_OVERDRAW_RESOLUTION = 256;
+
+// write str as a JSON string, since paths may have backslashes in them.
+void WriteJsonString(FILE* out, const char* str) {
+    fputc('"', out);
+    for(const char* c = str; *c; ++c) {
+	if(*c == '"' || *c == '\\')
+	    fputc('\\', out);
+	fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+void WriteLayoutReport(
+    FILE* out,
+    const char* name,
+    const std::vector<float>& positions,
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    int numDirections,
+    int resolution) {
+
+    size_t numTriangles = 0;
+    for(size_t s = 0; s < shapes.size(); ++s)
+	numTriangles += shapes[s].numIndices / 3;
+
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"layout\": \"%s\",\n", name);
+    fprintf(out, "      \"vertices\": %zu,\n", positions.size() / 3);
+    fprintf(out, "      \"triangles\": %zu,\n", numTriangles);
+    fprintf(out, "      \"shapes\": %zu,\n", shapes.size());
+
+    fprintf(out, "      \"vertex_cache\": [\n");
+    const int numSizes = (int)(sizeof(REPORT_CACHE_SIZES) / sizeof(REPORT_CACHE_SIZES[0]));
+    for(int kind = VERTEX_CACHE_FIFO; kind <= VERTEX_CACHE_LRU; ++kind) {
+	for(int i = 0; i < numSizes; ++i) {
+	    VertexCacheStats stats = AnalyzeVertexCache(indices, shapes, (VertexCacheKind)kind, REPORT_CACHE_SIZES[i]);
+	    bool last = kind == VERTEX_CACHE_LRU && i == numSizes - 1;
+	    fprintf(out, "        { \"kind\": \"%s\", \"size\": %d, \"acmr\": %.4f, \"atvr\": %.4f }%s\n",
+		    kind == VERTEX_CACHE_FIFO ? "fifo" : "lru", stats.cacheSize, stats.acmr, stats.atvr, last ? "" : ",");
+	}
+    }
+    fprintf(out, "      ],\n");
+
+    OverdrawStats overdraw = AnalyzeOverdraw(indices, shapes, positions, numDirections, resolution);
+    fprintf(out, "      \"overdraw\": { \"directions\": %d, \"resolution\": %d, \"overdraw\": %.4f },\n",
+	    overdraw.numDirections, overdraw.resolution, overdraw.overdraw);
+
+    fprintf(out, "      \"vertex_fetch\": [\n");
+    const int numStrides = (int)(sizeof(REPORT_STRIDES) / sizeof(REPORT_STRIDES[0]));
+    for(int i = 0; i < numStrides; ++i) {
+	VertexFetchStats stats = AnalyzeVertexFetch(indices, shapes, REPORT_STRIDES[i], FETCH_CACHE_SIZE);
+	fprintf(out, "        { \"stride\": %zu, \"efficiency\": %.4f }%s\n", stats.stride, stats.efficiency, i == numStrides - 1 ? "" : ",");
+    }
+    fprintf(out, "      ]\n");
+    fprintf(out, "    }");
+}
+
+/*
+  Usage:
+    mesh_report [--directions <n>] [--resolution <pixels>] <model.obj>
+*/
+int main(int argc, char** argv)
+{
+    int numDirections = DEFAULT_OVERDRAW_DIRECTIONS;
+    int resolution = DEFAULT_OVERDRAW_RESOLUTION;
+    const char* inputfile = NULL;
+
+    for(int i = 1; i < argc; ++i) {
+	if(strcmp(argv[i], "--directions") == 0 && i + 1 < argc) {
+	    numDirections = atoi(argv[++i]);
+	} else if(strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+	    resolution = atoi(argv[++i]);
+	} else if(!inputfile && argv[i][0] != '-') {
+	    inputfile = argv[i];
+	} else {
+	    inputfile = NULL;
+	    break;
+	}
+    }
+    if(!inputfile || numDirections < 1 || resolution < 1) {
+	fprintf(stderr, "Usage: %s [--directions <n>] [--resolution <pixels>] <model.obj>\n", argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<unsigned int> indices;
+    std::vector<ObjShape> shapes;
+    std::string err;
+    if(!LoadObjFile(inputfile, positions, normals, indices, shapes, err)) {
+	fprintf(stderr, "%s\n", err.c_str());
+	return EXIT_FAILURE;
+    }
+
+    printf("{\n");
+    printf("  \"model\": ");
+    WriteJsonString(stdout, inputfile);
+    printf(",\n");
+    printf("  \"layouts\": [\n");
+    WriteLayoutReport(stdout, "obj", positions, indices, shapes, numDirections, resolution);
+
+    // the passes of OptimizeMesh() in main.cpp. The LODs that it builds after them don't change LOD 0.
+    OptimizeVertexCache(indices, shapes, VERTEX_CACHE_SIZE);
+    printf(",\n");
+    WriteLayoutReport(stdout, "optimize_vertex_cache", positions, indices, shapes, numDirections, resolution);
+
+    OptimizeOverdraw(indices, shapes, positions, VERTEX_CACHE_SIZE, OVERDRAW_THRESHOLD);
+    printf(",\n");
+    WriteLayoutReport(stdout, "optimize_overdraw", positions, indices, shapes, numDirections, resolution);
+
+    OptimizeVertexFetch(positions, normals, indices, shapes);
+    printf(",\n");
+    WriteLayoutReport(stdout, "optimize_vertex_fetch", positions, indices, shapes, numDirections, resolution);
+
+    // the cache is only reported if it is up to date, and only LOD 0, which is what is drawn up close.
+    std::string cachefile = std::string(inputfile) + ".meshcache";
+    MeshCache cache;
+    if(cache.Open(cachefile.c_str(), inputfile)) {
+	const MeshLod& lod = cache.GetLods()[0];
+	positions.assign(cache.GetPositions(), cache.GetPositions() + 3 * cache.GetNumVertices());
+	indices.assign(cache.GetIndices(), cache.GetIndices() + cache.GetNumIndices());
+	shapes.assign(cache.GetShapes() + lod.firstShape, cache.GetShapes() + lod.firstShape + lod.numShapes);
+
+	printf(",\n");
+	WriteLayoutReport(stdout, "cache", positions, indices, shapes, numDirections, resolution);
+    }
+
+    printf("\n  ]\n");
+    printf("}\n");
+    return EXIT_SUCCESS;
+}
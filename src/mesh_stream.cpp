@@ -0,0 +1,114 @@
+#include "mesh_stream.hpp"
+
+#include <utility>
+
+MeshStream::MeshStream ()
+    :	m_finished(false),
+	m_succeeded(false),
+	m_closed(false) {
+}
+
+void MeshStream::Begin (size_t numIndices, size_t numVertices) {
+    MeshStreamChunk chunk;
+    chunk.array = MESH_STREAM_BEGIN;
+    chunk.offset = 0;
+    chunk.numIndices = numIndices;
+    chunk.numVertices = numVertices;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_chunks.push_back(std::move(chunk));
+    m_changed.notify_all();
+}
+
+void MeshStream::Append (
+    const std::vector<float>& positions, size_t firstPosition, size_t endPosition,
+    const std::vector<float>& normals, size_t firstNormal, size_t endNormal,
+    const std::vector<unsigned int>& indices, size_t firstIndex, size_t endIndex,
+    const std::vector<ObjShape>& shapes, size_t firstShape) {
+
+    // the vertices go first, since the indices refer to them.
+    if(endPosition > firstPosition)
+	Push(MESH_STREAM_POSITIONS, sizeof(float) * firstPosition,
+	     &positions[firstPosition], sizeof(float) * (endPosition - firstPosition));
+    if(endNormal > firstNormal)
+	Push(MESH_STREAM_NORMALS, sizeof(float) * firstNormal,
+	     &normals[firstNormal], sizeof(float) * (endNormal - firstNormal));
+    if(endIndex > firstIndex)
+	Push(MESH_STREAM_INDICES, sizeof(unsigned int) * firstIndex,
+	     &indices[firstIndex], sizeof(unsigned int) * (endIndex - firstIndex));
+    if(shapes.size() > firstShape)
+	Push(MESH_STREAM_SHAPES, sizeof(ObjShape) * firstShape,
+	     &shapes[firstShape], sizeof(ObjShape) * (shapes.size() - firstShape));
+}
+
+void MeshStream::Push (MeshStreamArray array, size_t offset, const void* data, size_t size) {
+    const char* bytes = (const char*)data;
+
+    for(size_t begin = 0; begin < size; begin += MESH_STREAM_CHUNK_SIZE) {
+	size_t n = size - begin < MESH_STREAM_CHUNK_SIZE ? size - begin : MESH_STREAM_CHUNK_SIZE;
+
+	// wait until there is room. There is only one loader thread pushing, so there still is after the copy.
+	{
+	    std::unique_lock<std::mutex> lock(m_mutex);
+	    while(m_chunks.size() >= MESH_STREAM_MAX_CHUNKS && !m_closed)
+		m_changed.wait(lock);
+	    if(m_closed)
+		return;
+	}
+
+	// copy outside of the lock, so that the GL thread is never kept waiting.
+	MeshStreamChunk chunk;
+	chunk.array = array;
+	chunk.offset = offset + begin;
+	chunk.data.assign(bytes + begin, bytes + begin + n);
+	chunk.numIndices = 0;
+	chunk.numVertices = 0;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_chunks.push_back(std::move(chunk));
+	m_changed.notify_all();
+    }
+}
+
+void MeshStream::Finish (bool succeeded) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished = true;
+    m_succeeded = succeeded;
+    m_changed.notify_all();
+}
+
+void MeshStream::Close () {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_closed = true;
+    m_chunks.clear();
+    m_changed.notify_all();
+}
+
+bool MeshStream::Pop (MeshStreamChunk& chunk) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(m_chunks.empty())
+	return false;
+
+    chunk = std::move(m_chunks.front());
+    m_chunks.pop_front();
+
+    // the loader may be waiting for room.
+    m_changed.notify_all();
+    return true;
+}
+
+void MeshStream::Wait () {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(m_chunks.empty() && !m_finished)
+	m_changed.wait(lock);
+}
+
+bool MeshStream::IsFinished () {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_finished && m_chunks.empty();
+}
+
+bool MeshStream::Succeeded () {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_succeeded;
+}
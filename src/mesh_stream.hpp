@@ -0,0 +1,88 @@
+#pragma once
+
+#include "obj_loader.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+enum MeshStreamArray {
+    MESH_STREAM_BEGIN,     // sizes of the mesh. No data.
+    MESH_STREAM_POSITIONS, // float xyz per vertex.
+    MESH_STREAM_NORMALS,   // float xyz per vertex.
+    MESH_STREAM_INDICES,   // uint32 per index.
+    MESH_STREAM_SHAPES     // ObjShape per shape.
+};
+
+/*
+  A piece of one of the arrays of a mesh that is being loaded.
+*/
+struct MeshStreamChunk {
+    MeshStreamArray array;
+    size_t offset;         // in bytes, from the start of the array.
+    std::vector<char> data;
+
+    // only for MESH_STREAM_BEGIN.
+    size_t numIndices;
+    size_t numVertices;
+};
+
+/*
+  Hands a mesh from the loader threads over to the thread that owns the
+  OpenGL context, in chunks of at most MESH_STREAM_CHUNK_SIZE bytes.
+
+  The loader passes a MeshStream as the sink of LoadObjFile(), and calls
+  Finish() when it is done. The GL thread keeps calling Pop() and uploads
+  every chunk it gets. Vertices always come before the indices that use them,
+  and indices before the shapes that draw them, so all the shapes popped so
+  far can be drawn.
+
+  At most MESH_STREAM_MAX_CHUNKS chunks are held at a time. When the loader
+  gets ahead of the GL thread, it waits, so the stream never holds a second
+  copy of the whole mesh.
+*/
+class MeshStream : public ObjStreamSink
+{
+public:
+    MeshStream ();
+
+    virtual void Begin (size_t numIndices, size_t numVertices);
+    virtual void Append (
+	const std::vector<float>& positions, size_t firstPosition, size_t endPosition,
+	const std::vector<float>& normals, size_t firstNormal, size_t endNormal,
+	const std::vector<unsigned int>& indices, size_t firstIndex, size_t endIndex,
+	const std::vector<ObjShape>& shapes, size_t firstShape);
+
+    // called by the loader once it will not push any more chunks.
+    void Finish (bool succeeded);
+
+    // called by the GL thread once it will not pop any more chunks. The chunks
+    // are dropped, and so are the ones pushed later, so the loader never waits.
+    void Close ();
+
+    // get the oldest chunk. Returns false if there is none right now.
+    bool Pop (MeshStreamChunk& chunk);
+
+    // block until there is a chunk to pop, or until Finish() has been called.
+    void Wait ();
+
+    // true once Finish() has been called, and all chunks have been popped.
+    bool IsFinished ();
+    bool Succeeded ();
+
+private:
+    void Push (MeshStreamArray array, size_t offset, const void* data, size_t size);
+
+    std::deque<MeshStreamChunk> m_chunks;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    bool m_finished;
+    bool m_succeeded;
+    bool m_closed;
+};
+
+const size_t MESH_STREAM_CHUNK_SIZE = 1024 * 1024;
+
+// a few frames of uploads, at the rate UpdateModel() pops them.
+const size_t MESH_STREAM_MAX_CHUNKS = 64;
@@ -0,0 +1,96 @@
+#include "meshlet_cull.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// the meshlets are culled in blocks of this many, that are handled in parallel.
+// A few hundred meshlets are culled faster by one thread than by waking up the rest.
+static const size_t MESHLET_CULL_BLOCK_SIZE = 1024;
+
+/*
+  The six planes of the view frustum, from the rows of the view projection
+  matrix, as in Gribb and Hartmann's "Fast Extraction of Viewing Frustum
+  Planes". The normals point inwards and have unit length, so the dot product
+  with a point is its distance to the plane.
+*/
+static void ExtractFrustumPlanes(const float* m, float planes[6][4]) {
+    for(int i = 0; i < 3; ++i) {
+	for(int c = 0; c < 4; ++c) {
+	    // row i and row 3 of the column-major matrix.
+	    planes[2 * i + 0][c] = m[4 * c + 3] + m[4 * c + i];
+	    planes[2 * i + 1][c] = m[4 * c + 3] - m[4 * c + i];
+	}
+    }
+
+    for(int p = 0; p < 6; ++p) {
+	float length = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+	for(int c = 0; c < 4; ++c)
+	    planes[p][c] /= length;
+    }
+}
+
+static inline bool IsMeshletVisible(const Meshlet& meshlet, const float planes[6][4], const float* cameraPos) {
+    for(int p = 0; p < 6; ++p) {
+	float distance = planes[p][0] * meshlet.center[0] + planes[p][1] * meshlet.center[1] + planes[p][2] * meshlet.center[2] + planes[p][3];
+	if(distance < -meshlet.radius)
+	    return false;
+    }
+
+    // the normal cone test of meshlets.hpp.
+    float d[3] = { meshlet.center[0] - cameraPos[0], meshlet.center[1] - cameraPos[1], meshlet.center[2] - cameraPos[2] };
+    float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    float dot = d[0] * meshlet.coneAxis[0] + d[1] * meshlet.coneAxis[1] + d[2] * meshlet.coneAxis[2];
+    return dot < meshlet.coneCutoff * length + meshlet.radius;
+}
+
+size_t MeshletCuller::Cull (const Meshlet* meshlets, size_t numMeshlets, const float* viewProjection, const float* cameraPos) {
+    float planes[6][4];
+    ExtractFrustumPlanes(viewProjection, planes);
+
+    size_t numBlocks = (numMeshlets + MESHLET_CULL_BLOCK_SIZE - 1) / MESHLET_CULL_BLOCK_SIZE;
+    m_blockCommands.resize(numMeshlets);
+    m_blockCounts.resize(numBlocks + 1);
+    m_commands.resize(numMeshlets);
+
+    //
+    // Cull every block on its own, and compact the visible meshlets to the start of the block.
+    //
+    GetThreadPool().ParallelFor(numBlocks, [&](size_t b) {
+	    size_t begin = b * MESHLET_CULL_BLOCK_SIZE;
+	    size_t end = std::min(begin + MESHLET_CULL_BLOCK_SIZE, numMeshlets);
+
+	    DrawElementsIndirectCommand* commands = &m_blockCommands[begin];
+	    size_t count = 0;
+	    for(size_t i = begin; i < end; ++i) {
+		const Meshlet& meshlet = meshlets[i];
+		if(!IsMeshletVisible(meshlet, planes, cameraPos))
+		    continue;
+
+		DrawElementsIndirectCommand& command = commands[count++];
+		command.count = meshlet.numIndices;
+		command.instanceCount = 1;
+		command.firstIndex = meshlet.firstIndex;
+		command.baseVertex = meshlet.baseVertex;
+		command.baseInstance = 0;
+	    }
+	    m_blockCounts[b + 1] = count;
+	});
+
+    //
+    // Then move the blocks next to each other.
+    //
+    m_blockCounts[0] = 0;
+    for(size_t b = 0; b < numBlocks; ++b)
+	m_blockCounts[b + 1] += m_blockCounts[b];
+
+    GetThreadPool().ParallelFor(numBlocks, [&](size_t b) {
+	    size_t count = m_blockCounts[b + 1] - m_blockCounts[b];
+	    std::copy(m_blockCommands.begin() + b * MESHLET_CULL_BLOCK_SIZE,
+		      m_blockCommands.begin() + b * MESHLET_CULL_BLOCK_SIZE + count,
+		      m_commands.begin() + m_blockCounts[b]);
+	});
+
+    m_numCommands = m_blockCounts[numBlocks];
+    return m_numCommands;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "meshlets.hpp"
+
+#include <vector>
+#include <stdint.h>
+
+/*
+  The layout of one draw of glDrawElementsIndirect() and
+  glMultiDrawElementsIndirect(), as it is in GL_DRAW_INDIRECT_BUFFER.
+*/
+struct DrawElementsIndirectCommand {
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    uint32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+/*
+  Culls the meshlets every frame, on the worker threads, so that the ones
+  that cannot be seen never reach the vertex and tessellation shaders. A
+  meshlet is culled if its bounding sphere is outside of the view frustum,
+  or if its normal cone faces away from the camera.
+
+  The buffers are kept from frame to frame, so that culling allocates
+  nothing once the number of meshlets stops changing.
+*/
+class MeshletCuller {
+public:
+    MeshletCuller () : m_numCommands(0) {}
+
+    /*
+      Cull numMeshlets meshlets against the column-major viewProjection
+      matrix, as seen from cameraPos, and write one command per visible
+      meshlet, in the order the meshlets are in. Returns the number of commands.
+    */
+    size_t Cull (const Meshlet* meshlets, size_t numMeshlets, const float* viewProjection, const float* cameraPos);
+
+    inline const DrawElementsIndirectCommand* GetCommands () const { return m_commands.data(); }
+    inline size_t GetNumCommands () const { return m_numCommands; }
+
+private:
+    // the commands of every block, at the start of the range of the block.
+    std::vector<DrawElementsIndirectCommand> m_blockCommands;
+    std::vector<size_t> m_blockCounts;
+
+    std::vector<DrawElementsIndirectCommand> m_commands;
+    size_t m_numCommands;
+};
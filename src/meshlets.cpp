@@ -0,0 +1,170 @@
+#include "meshlets.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// the triangles of big shapes are split into blocks of this many, that are split into meshlets in parallel.
+static const size_t MESHLET_BLOCK_SIZE = 64 * 1024;
+
+// if the normals of a meshlet are spread over more than about 84 degrees from the axis, the cone is not used.
+static const float MESHLET_MIN_CONE_DOT = 0.1f;
+
+/*
+  Compute the bounding sphere and normal cone of a meshlet, from its triangles.
+  vertices are the unique vertices, local to the shape, and positions are those of the shape.
+*/
+static void ComputeMeshletBounds(Meshlet& meshlet, const unsigned int* vertices, const unsigned int* indices, const float* positions) {
+    // the sphere is around the center of the bounding box, which is close enough to the smallest sphere.
+    float lo[3] = { INFINITY, INFINITY, INFINITY };
+    float hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for(uint32_t i = 0; i < meshlet.numVertices; ++i) {
+	const float* p = positions + 3 * (size_t)vertices[i];
+	for(int c = 0; c < 3; ++c) {
+	    lo[c] = std::fmin(lo[c], p[c]);
+	    hi[c] = std::fmax(hi[c], p[c]);
+	}
+    }
+
+    float radiusSquared = 0.0f;
+    for(int c = 0; c < 3; ++c)
+	meshlet.center[c] = 0.5f * (lo[c] + hi[c]);
+    for(uint32_t i = 0; i < meshlet.numVertices; ++i) {
+	const float* p = positions + 3 * (size_t)vertices[i];
+	float dx = p[0] - meshlet.center[0];
+	float dy = p[1] - meshlet.center[1];
+	float dz = p[2] - meshlet.center[2];
+	radiusSquared = std::fmax(radiusSquared, dx * dx + dy * dy + dz * dz);
+    }
+    meshlet.radius = std::sqrt(radiusSquared);
+
+    // the axis of the cone is the average of the unit normals, and the cone is as wide as the normal furthest from it.
+    size_t numTriangles = meshlet.numIndices / 3;
+    float normals[3 * MESHLET_MAX_TRIANGLES];
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    for(size_t t = 0; t < numTriangles; ++t) {
+	const float* p0 = positions + 3 * (size_t)indices[3 * t + 0];
+	const float* p1 = positions + 3 * (size_t)indices[3 * t + 1];
+	const float* p2 = positions + 3 * (size_t)indices[3 * t + 2];
+
+	float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+	float* n = &normals[3 * t];
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+	float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if(length == 0.0f)
+	    continue; // degenerate triangles face nowhere, and are left out.
+	for(int c = 0; c < 3; ++c) {
+	    n[c] /= length;
+	    axis[c] += n[c];
+	}
+    }
+
+    float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    float minDot = 1.0f;
+    for(int c = 0; c < 3; ++c)
+	meshlet.coneAxis[c] = axisLength > 0.0f ? axis[c] / axisLength : 0.0f;
+    for(size_t t = 0; t < numTriangles; ++t) {
+	const float* n = &normals[3 * t];
+	if(n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f)
+	    continue;
+	minDot = std::fmin(minDot, n[0] * meshlet.coneAxis[0] + n[1] * meshlet.coneAxis[1] + n[2] * meshlet.coneAxis[2]);
+    }
+
+    // the meshlet faces away if the view direction is more than 90 degrees plus the half angle
+    // away from the axis, and -cos(90 degrees + half angle) is the sine of the half angle.
+    if(axisLength == 0.0f || minDot <= MESHLET_MIN_CONE_DOT)
+	meshlet.coneCutoff = 1.0f;
+    else
+	meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+/*
+  Find the vertices of a triangle that are not among the numVertices vertices
+  yet, and write them to newVertices. Returns how many there are.
+*/
+static int FindNewVertices(const unsigned int* tri, const unsigned int* vertices, uint32_t numVertices, unsigned int* newVertices) {
+    int numNew = 0;
+    for(int k = 0; k < 3; ++k) {
+	bool found = false;
+	for(uint32_t i = 0; i < numVertices && !found; ++i)
+	    found = vertices[i] == tri[k];
+	for(int i = 0; i < numNew && !found; ++i)
+	    found = newVertices[i] == tri[k];
+	if(!found)
+	    newVertices[numNew++] = tri[k];
+    }
+    return numNew;
+}
+
+/*
+  Split the triangles [first, last) of a shape into meshlets, and append them to meshlets.
+*/
+static void SplitIntoMeshlets(const ObjShape& shape, size_t first, size_t last, const unsigned int* indices, const float* positions, std::vector<Meshlet>& meshlets) {
+    unsigned int vertices[MESHLET_MAX_VERTICES];
+
+    Meshlet meshlet;
+    meshlet.firstIndex = (uint32_t)(shape.firstIndex + 3 * first);
+    meshlet.numIndices = 0;
+    meshlet.baseVertex = shape.baseVertex;
+    meshlet.numVertices = 0;
+
+    for(size_t t = first; t <= last; ++t) {
+	// the vertices of the triangle that the meshlet does not have yet.
+	unsigned int newVertices[3];
+	int numNew = t < last ? FindNewVertices(indices + 3 * t, vertices, meshlet.numVertices, newVertices) : 0;
+
+	bool full = meshlet.numVertices + numNew > (uint32_t)MESHLET_MAX_VERTICES ||
+	    meshlet.numIndices == 3 * (uint32_t)MESHLET_MAX_TRIANGLES;
+	if((t == last || full) && meshlet.numIndices > 0) {
+	    ComputeMeshletBounds(meshlet, vertices, indices + (meshlet.firstIndex - shape.firstIndex), positions);
+	    meshlets.push_back(meshlet);
+
+	    meshlet.firstIndex += meshlet.numIndices;
+	    meshlet.numIndices = 0;
+	    meshlet.numVertices = 0;
+	}
+	if(t == last)
+	    break;
+
+	// in a new meshlet, all the vertices of the triangle are new.
+	if(meshlet.numVertices == 0)
+	    numNew = FindNewVertices(indices + 3 * t, vertices, 0, newVertices);
+
+	for(int i = 0; i < numNew; ++i)
+	    vertices[meshlet.numVertices++] = newVertices[i];
+	meshlet.numIndices += 3;
+    }
+}
+
+void BuildMeshlets(
+    const std::vector<float>& positions,
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    std::vector<Meshlet>& meshlets) {
+
+    // every shape is split into blocks, and every block into meshlets, in parallel.
+    std::vector<size_t> shapeFirstBlock(shapes.size() + 1, 0);
+    for(size_t s = 0; s < shapes.size(); ++s) {
+	size_t numTriangles = shapes[s].numIndices / 3;
+	shapeFirstBlock[s + 1] = shapeFirstBlock[s] + (numTriangles + MESHLET_BLOCK_SIZE - 1) / MESHLET_BLOCK_SIZE;
+    }
+
+    std::vector<std::vector<Meshlet> > blockMeshlets(shapeFirstBlock.back());
+    GetThreadPool().ParallelFor(blockMeshlets.size(), [&](size_t b) {
+	    size_t s = std::upper_bound(shapeFirstBlock.begin(), shapeFirstBlock.end(), b) - shapeFirstBlock.begin() - 1;
+	    const ObjShape& shape = shapes[s];
+
+	    size_t first = (b - shapeFirstBlock[s]) * MESHLET_BLOCK_SIZE;
+	    size_t last = first + MESHLET_BLOCK_SIZE < shape.numIndices / 3 ? first + MESHLET_BLOCK_SIZE : shape.numIndices / 3;
+	    SplitIntoMeshlets(shape, first, last, indices.data() + shape.firstIndex,
+			      positions.data() + 3 * (size_t)shape.baseVertex, blockMeshlets[b]);
+	});
+
+    meshlets.clear();
+    for(size_t b = 0; b < blockMeshlets.size(); ++b)
+	meshlets.insert(meshlets.end(), blockMeshlets[b].begin(), blockMeshlets[b].end());
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "obj_loader.hpp"
+
+#include <vector>
+#include <stdint.h>
+
+// a meshlet has at most this many unique vertices,
+static const int MESHLET_MAX_VERTICES = 64;
+
+// and at most this many triangles.
+static const int MESHLET_MAX_TRIANGLES = 124;
+
+/*
+  A small cluster of triangles, that is a range of the index buffer of its
+  shape, with bounds so it can be culled on its own.
+
+  The normal cone holds the normals of all the triangles. If the camera is
+  behind all the triangles, which is when
+
+    dot(center - cameraPos, coneAxis) >= coneCutoff * length(center - cameraPos) + radius,
+
+  then the whole meshlet faces away and can be skipped. coneCutoff is the
+  sine of the half angle of the cone, and 1 if the cone is too wide to ever
+  cull anything.
+*/
+struct Meshlet {
+    uint32_t firstIndex;  // in the index buffer of the whole mesh.
+    uint32_t numIndices;  // three per triangle.
+    uint32_t baseVertex;  // of the shape that the meshlet is part of.
+    uint32_t numVertices; // unique vertices used by the triangles.
+
+    float center[3];      // bounding sphere.
+    float radius;
+
+    float coneAxis[3];    // normal cone.
+    float coneCutoff;
+};
+
+/*
+  Split every shape into meshlets of at most MESHLET_MAX_VERTICES vertices
+  and MESHLET_MAX_TRIANGLES triangles. The triangles are taken in the order
+  they are in, so the meshlets are as good as the vertex cache order is.
+  Big shapes are split in parallel.
+*/
+void BuildMeshlets(
+    const std::vector<float>& positions,
+    const std::vector<unsigned int>& indices,
+    const std::vector<ObjShape>& shapes,
+    std::vector<Meshlet>& meshlets);
@@ -0,0 +1,173 @@
+#include "noise.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+static inline float Floor(float a) { return std::floor(a); }
+static inline float Min(float a, float b) { return b < a ? b : a; }
+static inline float Max(float a, float b) { return a < b ? b : a; }
+static inline float Abs(float a) { return std::fabs(a); }
+static inline float Step(float edge, float x) { return x < edge ? 0.0f : 1.0f; }
+
+#include "noise_kernel.hpp"
+
+#ifdef NOISE_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// in noise_sse41.cpp and noise_avx2.cpp. count is a multiple of NOISE_SIMD_WIDTH.
+void SampleTextureSse41(const float* x, const float* y, const float* z, size_t count, float scale, int octaves, float persistence, float* out);
+void SampleTextureAvx2(const float* x, const float* y, const float* z, size_t count, float scale, int octaves, float persistence, float* out);
+void NoiseLayerSse41(const float* x, const float* y, const float* z, size_t count, float scale, int octave, float* out);
+void NoiseLayerAvx2(const float* x, const float* y, const float* z, size_t count, float scale, int octave, float* out);
+
+typedef std::function<void(const float* x, const float* y, const float* z, size_t count, float* out)> SimdBatch;
+
+/*
+  Run simd over all the points. It only takes whole groups of points, so
+  the rest are padded out to a group.
+*/
+static void RunSimdBatch(const float* x, const float* y, const float* z, size_t count, float* out, const SimdBatch& simd) {
+    size_t simdCount = count / NOISE_SIMD_WIDTH * NOISE_SIMD_WIDTH;
+    simd(x, y, z, simdCount, out);
+
+    if(simdCount < count) {
+	float tail[4][NOISE_SIMD_WIDTH] = {};
+	std::copy(x + simdCount, x + count, tail[0]);
+	std::copy(y + simdCount, y + count, tail[1]);
+	std::copy(z + simdCount, z + count, tail[2]);
+	simd(tail[0], tail[1], tail[2], NOISE_SIMD_WIDTH, tail[3]);
+	std::copy(tail[3], tail[3] + (count - simdCount), out + simdCount);
+    }
+}
+
+static bool CpuHasSse41() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 19)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.1") != 0;
+#endif
+}
+
+static bool CpuHasAvx2() {
+#ifdef _MSC_VER
+    // the OS has to save the AVX registers too.
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+    if(!osxsave || (_xgetbv(0) & 6) != 6)
+	return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+bool IsNoiseKernelSupported(NoiseKernel kernel) {
+    switch(kernel) {
+    case NOISE_KERNEL_SCALAR:
+	return true;
+#ifdef NOISE_X86
+    case NOISE_KERNEL_SSE41:
+	return CpuHasSse41();
+    case NOISE_KERNEL_AVX2:
+	return CpuHasAvx2();
+#endif
+    default:
+	return false;
+    }
+}
+
+NoiseKernel GetBestNoiseKernel() {
+    static const NoiseKernel best =
+	IsNoiseKernelSupported(NOISE_KERNEL_AVX2) ? NOISE_KERNEL_AVX2 :
+	IsNoiseKernelSupported(NOISE_KERNEL_SSE41) ? NOISE_KERNEL_SSE41 :
+	NOISE_KERNEL_SCALAR;
+    return best;
+}
+
+const char* GetNoiseKernelName(NoiseKernel kernel) {
+    switch(kernel) {
+    case NOISE_KERNEL_SCALAR:
+	return "scalar";
+    case NOISE_KERNEL_SSE41:
+	return "sse4.1";
+    case NOISE_KERNEL_AVX2:
+	return "avx2";
+    default:
+	return "unknown";
+    }
+}
+
+float SNoise(float x, float y, float z) {
+    return SNoiseKernel(x, y, z);
+}
+
+float Fbm(float x, float y, float z, int octaves, float persistence) {
+    return SampleTextureKernel(x, y, z, 1.0f, octaves, persistence);
+}
+
+float SampleTexture(float x, float y, float z, float scale, int octaves, float persistence) {
+    return SampleTextureKernel(x, y, z, scale, octaves, persistence);
+}
+
+void SampleTextureBatch(
+    const float* x,
+    const float* y,
+    const float* z,
+    size_t count,
+    float scale,
+    int octaves,
+    float persistence,
+    float* out,
+    NoiseKernel kernel) {
+
+#ifdef NOISE_X86
+    if(kernel == NOISE_KERNEL_AVX2 || kernel == NOISE_KERNEL_SSE41) {
+	RunSimdBatch(x, y, z, count, out, [&](const float* bx, const float* by, const float* bz, size_t n, float* bout) {
+		if(kernel == NOISE_KERNEL_AVX2)
+		    SampleTextureAvx2(bx, by, bz, n, scale, octaves, persistence, bout);
+		else
+		    SampleTextureSse41(bx, by, bz, n, scale, octaves, persistence, bout);
+	    });
+	return;
+    }
+#endif
+
+    for(size_t i = 0; i < count; ++i)
+	out[i] = SampleTextureKernel(x[i], y[i], z[i], scale, octaves, persistence);
+}
+
+void NoiseLayerBatch(
+    const float* x,
+    const float* y,
+    const float* z,
+    size_t count,
+    float scale,
+    int octave,
+    float* out,
+    NoiseKernel kernel) {
+
+#ifdef NOISE_X86
+    if(kernel == NOISE_KERNEL_AVX2 || kernel == NOISE_KERNEL_SSE41) {
+	RunSimdBatch(x, y, z, count, out, [&](const float* bx, const float* by, const float* bz, size_t n, float* bout) {
+		if(kernel == NOISE_KERNEL_AVX2)
+		    NoiseLayerAvx2(bx, by, bz, n, scale, octave, bout);
+		else
+		    NoiseLayerSse41(bx, by, bz, n, scale, octave, bout);
+	    });
+	return;
+    }
+#endif
+
+    for(size_t i = 0; i < count; ++i)
+	out[i] = NoiseLayerKernel(x[i], y[i], z[i], scale, octave);
+}
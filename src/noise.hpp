@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+  The noise of shader_common in C++, so that it can be computed, baked and
+  checked without a GPU. snoise(), fbm() and sampleTexture() are mirrored
+  operation by operation, with the same float constants, so the results
+  only differ from the GLSL by how the GPU rounds.
+
+  The batch function takes the points as separate x, y and z arrays, and
+  runs the fastest SIMD kernel that the CPU has, unless told otherwise.
+*/
+
+enum NoiseKernel {
+    NOISE_KERNEL_SCALAR = 0, // the reference, one point at a time.
+    NOISE_KERNEL_SSE41 = 1,  // 8 points at a time, as two halves of 4.
+    NOISE_KERNEL_AVX2 = 2,   // 8 points at a time.
+
+    NOISE_KERNEL_COUNT
+};
+
+// whether the CPU can run kernel. The scalar one always can.
+bool IsNoiseKernelSupported(NoiseKernel kernel);
+
+// the fastest kernel that the CPU can run. Is found once.
+NoiseKernel GetBestNoiseKernel();
+
+const char* GetNoiseKernelName(NoiseKernel kernel);
+
+// snoise() of shader_common, between about -1 and 1.
+float SNoise(float x, float y, float z);
+
+// fbm() of shader_common, between 0 and 1. octaves must be at least 1.
+float Fbm(float x, float y, float z, int octaves, float persistence);
+
+// sampleTexture() of shader_common. All three channels of the GLSL are this value.
+float SampleTexture(float x, float y, float z, float scale, int octaves, float persistence);
+
+/*
+  SampleTexture() of count points, into out. Runs on the calling thread
+  only, so that big batches can be split up by the caller.
+*/
+void SampleTextureBatch(
+    const float* x,
+    const float* y,
+    const float* z,
+    size_t count,
+    float scale,
+    int octaves,
+    float persistence,
+    float* out,
+    NoiseKernel kernel = GetBestNoiseKernel());
+
+/*
+  Octave number octave, from 0, of SampleTexture() of count points, before
+  it is weighted, into out. SampleTexture() is the sum of these times
+  persistence^octave, divided by the sum of those weights. The octaves only
+  depend on the point and the scale, so they can be kept when the
+  persistence or the number of octaves changes. Runs on the calling thread only.
+*/
+void NoiseLayerBatch(
+    const float* x,
+    const float* y,
+    const float* z,
+    size_t count,
+    float scale,
+    int octave,
+    float* out,
+    NoiseKernel kernel = GetBestNoiseKernel());
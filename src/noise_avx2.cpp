@@ -0,0 +1,46 @@
+/*
+  The AVX2 kernel of noise.hpp. Built with the flags for AVX2, and only
+  called when the CPU has it. 8 points are handled at a time.
+*/
+#include "noise_kernel.hpp"
+
+#include <stddef.h>
+
+#ifdef NOISE_X86
+#include <immintrin.h>
+
+struct Avx2Float {
+    __m256 v;
+
+    inline Avx2Float () {}
+    inline Avx2Float (float f) : v(_mm256_set1_ps(f)) {}
+    inline Avx2Float (__m256 a) : v(a) {}
+};
+
+static inline Avx2Float operator+ (Avx2Float a, Avx2Float b) { return _mm256_add_ps(a.v, b.v); }
+static inline Avx2Float operator- (Avx2Float a, Avx2Float b) { return _mm256_sub_ps(a.v, b.v); }
+static inline Avx2Float operator* (Avx2Float a, Avx2Float b) { return _mm256_mul_ps(a.v, b.v); }
+static inline Avx2Float operator/ (Avx2Float a, Avx2Float b) { return _mm256_div_ps(a.v, b.v); }
+static inline Avx2Float Floor(Avx2Float a) { return _mm256_floor_ps(a.v); }
+static inline Avx2Float Min(Avx2Float a, Avx2Float b) { return _mm256_min_ps(a.v, b.v); }
+static inline Avx2Float Max(Avx2Float a, Avx2Float b) { return _mm256_max_ps(a.v, b.v); }
+static inline Avx2Float Abs(Avx2Float a) { return _mm256_and_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF))); }
+static inline Avx2Float Step(Avx2Float edge, Avx2Float x) { return _mm256_and_ps(_mm256_cmp_ps(x.v, edge.v, _CMP_GE_OQ), _mm256_set1_ps(1.0f)); }
+
+void SampleTextureAvx2(const float* x, const float* y, const float* z, size_t count, float scale, int octaves, float persistence, float* out) {
+    for(size_t i = 0; i < count; i += NOISE_SIMD_WIDTH) {
+	Avx2Float v = SampleTextureKernel(Avx2Float(_mm256_loadu_ps(x + i)), Avx2Float(_mm256_loadu_ps(y + i)), Avx2Float(_mm256_loadu_ps(z + i)),
+					  scale, octaves, persistence);
+	_mm256_storeu_ps(out + i, v.v);
+    }
+}
+
+void NoiseLayerAvx2(const float* x, const float* y, const float* z, size_t count, float scale, int octave, float* out) {
+    for(size_t i = 0; i < count; i += NOISE_SIMD_WIDTH) {
+	Avx2Float v = NoiseLayerKernel(Avx2Float(_mm256_loadu_ps(x + i)), Avx2Float(_mm256_loadu_ps(y + i)), Avx2Float(_mm256_loadu_ps(z + i)),
+				       scale, octave);
+	_mm256_storeu_ps(out + i, v.v);
+    }
+}
+
+#endif
@@ -0,0 +1,15 @@
+// evaluates sampleTexture() at the points of uPoints, one per pixel, so that
+// --capture-noise can save what the GPU computes.
+out float value;
+
+uniform samplerBuffer uPoints;
+uniform int uWidth;
+uniform int uNoiseOctaves;
+uniform float uNoiseScale;
+uniform float uNoisePersistence;
+
+void main()
+{
+    int i = int(gl_FragCoord.y) * uWidth + int(gl_FragCoord.x);
+    value = sampleTexture(texelFetch(uPoints, i).xyz, uNoiseScale, uNoiseOctaves, uNoisePersistence).x;
+}
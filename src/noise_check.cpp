@@ -0,0 +1,117 @@
+#include "noise_check.hpp"
+#include "noise.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const char NOISE_CAPTURE_MAGIC[8] = { 'T', 'E', 'S', 'S', 'N', 'O', 'I', 'S' };
+
+void MakeNoiseCheckPoints(std::vector<float>& points) {
+    const int numPoints = NOISE_CHECK_WIDTH * NOISE_CHECK_HEIGHT;
+    points.resize(4 * numPoints);
+    unsigned int seed = 1;
+    for(int i = 0; i < 4 * numPoints; ++i) {
+	seed = seed * 1664525u + 1013904223u;
+	points[i] = (float)(seed >> 8) / 16777216.0f * 4.0f - 2.0f;
+    }
+}
+
+bool WriteNoiseCapture(const char* path, const std::vector<float>& points, const std::vector<float>& values) {
+    const int numScales = (int)(sizeof(NOISE_CHECK_SCALES) / sizeof(NOISE_CHECK_SCALES[0]));
+    const int numPersistences = (int)(sizeof(NOISE_CHECK_PERSISTENCES) / sizeof(NOISE_CHECK_PERSISTENCES[0]));
+
+    NoiseCaptureHeader header;
+    memcpy(header.magic, NOISE_CAPTURE_MAGIC, sizeof(NOISE_CAPTURE_MAGIC));
+    header.version = NOISE_CAPTURE_VERSION;
+    header.numPoints = (uint32_t)(points.size() / 4);
+    header.numScales = numScales;
+    header.numPersistences = numPersistences;
+    header.maxOctaves = NOISE_CHECK_MAX_OCTAVES;
+    header.unused = 0;
+    if(values.size() != (size_t)header.numPoints * numScales * numPersistences * NOISE_CHECK_MAX_OCTAVES)
+	return false;
+
+    FILE* file = fopen(path, "wb");
+    if(!file)
+	return false;
+    bool ok =
+	fwrite(&header, sizeof(header), 1, file) == 1 &&
+	fwrite(NOISE_CHECK_SCALES, sizeof(float), numScales, file) == (size_t)numScales &&
+	fwrite(NOISE_CHECK_PERSISTENCES, sizeof(float), numPersistences, file) == (size_t)numPersistences &&
+	fwrite(points.data(), sizeof(float), points.size(), file) == points.size() &&
+	fwrite(values.data(), sizeof(float), values.size(), file) == values.size();
+    return fclose(file) == 0 && ok;
+}
+
+int CheckNoise(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+	printf("Could not open %s\n", path );
+	return EXIT_FAILURE;
+    }
+
+    NoiseCaptureHeader header;
+    std::vector<float> scales, persistences, points, values;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+	memcmp(header.magic, NOISE_CAPTURE_MAGIC, sizeof(NOISE_CAPTURE_MAGIC)) == 0 &&
+	header.version == NOISE_CAPTURE_VERSION &&
+	header.numPoints > 0 && header.numPoints <= (1u << 24) &&
+	header.numScales <= 256 && header.numPersistences <= 256 &&
+	header.maxOctaves >= 1 && header.maxOctaves <= 64;
+    if(ok) {
+	scales.resize(header.numScales);
+	persistences.resize(header.numPersistences);
+	points.resize(4 * (size_t)header.numPoints);
+	values.resize((size_t)header.numPoints * header.numScales * header.numPersistences * header.maxOctaves);
+	ok = fread(scales.data(), sizeof(float), scales.size(), file) == scales.size() &&
+	    fread(persistences.data(), sizeof(float), persistences.size(), file) == persistences.size() &&
+	    fread(points.data(), sizeof(float), points.size(), file) == points.size() &&
+	    fread(values.data(), sizeof(float), values.size(), file) == values.size();
+    }
+    fclose(file);
+    if(!ok || values.empty()) {
+	printf("%s is not a noise capture of version %d\n", path, (int)NOISE_CAPTURE_VERSION );
+	return EXIT_FAILURE;
+    }
+
+    // the kernels want x, y and z in arrays of their own.
+    size_t numPoints = header.numPoints;
+    std::vector<float> x(numPoints), y(numPoints), z(numPoints), actual(numPoints);
+    for(size_t i = 0; i < numPoints; ++i) {
+	x[i] = points[4 * i + 0];
+	y[i] = points[4 * i + 1];
+	z[i] = points[4 * i + 2];
+    }
+
+    float maxError[NOISE_KERNEL_COUNT] = {};
+    const float* expected = values.data();
+    for(size_t s = 0; s < scales.size(); ++s) {
+	for(size_t p = 0; p < persistences.size(); ++p) {
+	    for(int octaves = 1; octaves <= (int)header.maxOctaves; ++octaves, expected += numPoints) {
+		for(int k = 0; k < NOISE_KERNEL_COUNT; ++k) {
+		    if(!IsNoiseKernelSupported((NoiseKernel)k))
+			continue;
+		    SampleTextureBatch(x.data(), y.data(), z.data(), numPoints, scales[s], octaves, persistences[p], actual.data(), (NoiseKernel)k);
+		    for(size_t i = 0; i < numPoints; ++i)
+			maxError[k] = std::max(maxError[k], std::fabs(actual[i] - expected[i]));
+		}
+	    }
+	}
+    }
+
+    bool passed = true;
+    for(int k = 0; k < NOISE_KERNEL_COUNT; ++k) {
+	if(!IsNoiseKernelSupported((NoiseKernel)k)) {
+	    printf("%s: not supported by this CPU\n", GetNoiseKernelName((NoiseKernel)k) );
+	    continue;
+	}
+	bool kernelPassed = maxError[k] <= NOISE_CHECK_TOLERANCE;
+	printf("%s: max error %g over %d values, %s\n", GetNoiseKernelName((NoiseKernel)k), maxError[k], (int)values.size(),
+	       kernelPassed ? "passed" : "FAILED");
+	passed = passed && kernelPassed;
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+/*
+  The check of noise.hpp against the noise of the GPU. tess_opt
+  --capture-noise evaluates sampleTexture() of shader_common on the GPU at
+  the same points every time, for every octave count and the scales and
+  persistences below, and writes the results to a capture file. noise_check
+  compares every kernel of noise.hpp to such a file, without a GPU, and the
+  capture in data/noise_ref.bin is checked by ctest.
+*/
+
+// the points are rendered as one pixel each, into a viewport of this size.
+static const int NOISE_CHECK_WIDTH = 64;
+static const int NOISE_CHECK_HEIGHT = 16;
+
+static const float NOISE_CHECK_SCALES[] = { 1.0f, 2.8f, 10.0f };
+static const float NOISE_CHECK_PERSISTENCES[] = { 0.3f, 1.0f };
+static const int NOISE_CHECK_MAX_OCTAVES = 10;
+
+// a kernel fails the check if it is further off than this from the capture.
+static const float NOISE_CHECK_TOLERANCE = 1e-3f;
+
+const uint32_t NOISE_CAPTURE_VERSION = 1;
+
+/*
+  A capture file starts with this header, and is followed by the scales and
+  the persistences, then by x, y, z and w of every point, where w is unused,
+  and last by the values. There are numPoints values for every scale, every
+  persistence of that, and every octave count from 1 to maxOctaves of that,
+  in that order.
+*/
+struct NoiseCaptureHeader {
+    char magic[8];            // "TESSNOIS"
+    uint32_t version;         // NOISE_CAPTURE_VERSION
+    uint32_t numPoints;
+    uint32_t numScales;
+    uint32_t numPersistences;
+    uint32_t maxOctaves;
+    uint32_t unused;
+};
+
+// the points of --capture-noise, four floats each, so that they can be uploaded as RGBA32F. They are random, in [-2, 2]^3.
+void MakeNoiseCheckPoints(std::vector<float>& points);
+
+// write a capture of the values at the points of MakeNoiseCheckPoints(), in the order described above.
+bool WriteNoiseCapture(const char* path, const std::vector<float>& points, const std::vector<float>& values);
+
+/*
+  Compare every kernel of noise.hpp that the CPU has to the capture in path,
+  and print the largest error of each. Returns EXIT_SUCCESS if all of them
+  are within NOISE_CHECK_TOLERANCE.
+*/
+int CheckNoise(const char* path);
@@ -0,0 +1,21 @@
+#include "noise_check.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+/*
+  A headless tool that compares the noise kernels of noise.hpp to a capture
+  of the noise of the GPU, so that the port can be checked on machines
+  without one. ctest runs it on data/noise_ref.bin.
+
+  Usage:
+    noise_check <noise.bin>    compare to a capture of tess_opt --capture-noise.
+*/
+int main(int argc, char** argv)
+{
+    if(argc != 2) {
+	fprintf(stderr, "Usage: %s <noise.bin>\n", argv[0]);
+	return EXIT_FAILURE;
+    }
+    return CheckNoise(argv[1]);
+}
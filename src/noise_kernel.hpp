@@ -0,0 +1,172 @@
+#pragma once
+
+/*
+  The noise of shader_common, written once for any type V that holds one or
+  more floats, so that the scalar and the SIMD kernels of noise.cpp do the
+  same operations in the same order as the GLSL. Only included by the
+  noise*.cpp files, after they have defined V and these functions of it:
+
+    V(float)         all lanes set to the value.
+    + - * /          per lane.
+    Floor(a)
+    Min(a, b), Max(a, b), Abs(a)
+    Step(edge, x)    1 where x >= edge, else 0, like step() in GLSL.
+
+  The kernels for instruction sets the compiler is not targeting live in
+  translation units of their own, built with the flags for them. So nothing
+  here may use anything from a header, since an inline function of a header
+  compiled with those flags could be picked by the linker for all the callers.
+*/
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define NOISE_X86 1
+#endif
+
+// the number of points that the SIMD kernels handle at a time.
+static const int NOISE_SIMD_WIDTH = 8;
+
+namespace {
+
+template<typename V>
+inline V Mod289(V x) {
+    return x - Floor(x * V(1.0f / 289.0f)) * V(289.0f);
+}
+
+template<typename V>
+inline V Permute(V x) {
+    return Mod289(((x * V(34.0f)) + V(1.0f)) * x);
+}
+
+template<typename V>
+inline V TaylorInvSqrt(V r) {
+    return V(1.79284291400159f) - V(0.85373472095314f) * r;
+}
+
+/*
+  snoise() of shader_common. The vec4s of the four corners of the simplex
+  are unrolled into one V per corner.
+*/
+template<typename V>
+inline V SNoiseKernel(V vx, V vy, V vz) {
+    const float Cx = 1.0f / 6.0f;
+    const float Cy = 1.0f / 3.0f;
+
+    // First corner
+    V s = vx * V(Cy) + vy * V(Cy) + vz * V(Cy);
+    V ix = Floor(vx + s);
+    V iy = Floor(vy + s);
+    V iz = Floor(vz + s);
+    V t = ix * V(Cx) + iy * V(Cx) + iz * V(Cx);
+    V x0[3] = { vx - ix + t, vy - iy + t, vz - iz + t };
+
+    // Other corners
+    V gx = Step(x0[1], x0[0]);
+    V gy = Step(x0[2], x0[1]);
+    V gz = Step(x0[0], x0[2]);
+    V lx = V(1.0f) - gx;
+    V ly = V(1.0f) - gy;
+    V lz = V(1.0f) - gz;
+    V i1[3] = { Min(gx, lz), Min(gy, lx), Min(gz, ly) };
+    V i2[3] = { Max(gx, lz), Max(gy, lx), Max(gz, ly) };
+
+    V corners[4][3];
+    for(int k = 0; k < 3; ++k) {
+	corners[0][k] = x0[k];
+	corners[1][k] = x0[k] - i1[k] + V(Cx);
+	corners[2][k] = x0[k] - i2[k] + V(Cy);
+	corners[3][k] = x0[k] - V(0.5f);
+    }
+
+    // Permutations
+    ix = Mod289(ix);
+    iy = Mod289(iy);
+    iz = Mod289(iz);
+    V offsets[4][3] = {
+	{ V(0.0f), V(0.0f), V(0.0f) },
+	{ i1[0], i1[1], i1[2] },
+	{ i2[0], i2[1], i2[2] },
+	{ V(1.0f), V(1.0f), V(1.0f) }
+    };
+
+    // Gradients: 7x7 points over a square, mapped onto an octahedron.
+    const float n_ = 0.142857142857f; // 1.0/7.0
+    const float nsx = n_ * 2.0f - 0.0f;
+    const float nsy = n_ * 0.5f - 1.0f;
+    const float nsz = n_ * 1.0f - 0.0f;
+
+    V result = V(0.0f);
+    for(int c = 0; c < 4; ++c) {
+	V p = Permute(Permute(Permute(iz + offsets[c][2]) + iy + offsets[c][1]) + ix + offsets[c][0]);
+
+	V j = p - V(49.0f) * Floor(p * V(nsz) * V(nsz));
+	V x_ = Floor(j * V(nsz));
+	V y_ = Floor(j - V(7.0f) * x_);
+
+	V x = x_ * V(nsx) + V(nsy);
+	V y = y_ * V(nsx) + V(nsy);
+	V h = V(1.0f) - Abs(x) - Abs(y);
+
+	V sh = V(0.0f) - Step(h, V(0.0f));
+	V gradient[3] = {
+	    x + (Floor(x) * V(2.0f) + V(1.0f)) * sh,
+	    y + (Floor(y) * V(2.0f) + V(1.0f)) * sh,
+	    h
+	};
+
+	// Normalise gradients
+	V norm = TaylorInvSqrt(gradient[0] * gradient[0] + gradient[1] * gradient[1] + gradient[2] * gradient[2]);
+
+	// Mix final noise value
+	const V* xc = corners[c];
+	V m = Max(V(0.6f) - (xc[0] * xc[0] + xc[1] * xc[1] + xc[2] * xc[2]), V(0.0f));
+	m = m * m;
+	V d = (gradient[0] * norm) * xc[0] + (gradient[1] * norm) * xc[1] + (gradient[2] * norm) * xc[2];
+	result = result + (m * m) * d;
+    }
+    return V(42.0f) * result;
+}
+
+/*
+  The term of octave in fbm() of sampleTexture(), before it is weighted by
+  its amplitude. Doubling a float is exact, so the point is the same as the
+  one that SampleTextureKernel() gets to after octave doublings, and so is
+  the value.
+*/
+template<typename V>
+inline V NoiseLayerKernel(V px, V py, V pz, float scale, int octave) {
+    float frequency = 1.0f;
+    for(int i = 0; i < octave; ++i)
+	frequency *= 2.0f;
+
+    px = px * V(scale) * V(frequency);
+    py = py * V(scale) * V(frequency);
+    pz = pz * V(scale) * V(frequency);
+    return SNoiseKernel(px, py, pz) * V(0.5f) + V(0.5f);
+}
+
+/*
+  sampleTexture() of shader_common, which is fbm() of the scaled point. All
+  the lanes of the color are the same, so only one is returned.
+*/
+template<typename V>
+inline V SampleTextureKernel(V px, V py, V pz, float scale, int octaves, float persistence) {
+    px = px * V(scale);
+    py = py * V(scale);
+    pz = pz * V(scale);
+
+    V v = V(0.0f);
+    float total = 0.0f;
+    float amplitude = 1.0f;
+    for(int i = 0; i < octaves; ++i) {
+	v = v + V(amplitude) * (SNoiseKernel(px, py, pz) * V(0.5f) + V(0.5f));
+	total += amplitude;
+
+	amplitude *= persistence;
+	px = px * V(2.0f);
+	py = py * V(2.0f);
+	pz = pz * V(2.0f);
+    }
+    return v / V(total);
+}
+
+} // namespace
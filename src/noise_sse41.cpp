@@ -0,0 +1,62 @@
+/*
+  The SSE4.1 kernel of noise.hpp. Built with the flags for SSE4.1, and only
+  called when the CPU has it. 8 points are handled at a time, as two halves,
+  so that the two chains of work can overlap.
+*/
+#include "noise_kernel.hpp"
+
+#include <stddef.h>
+
+#ifdef NOISE_X86
+#include <smmintrin.h>
+
+struct Sse41Float {
+    __m128 lo;
+    __m128 hi;
+
+    inline Sse41Float () {}
+    inline Sse41Float (float f) : lo(_mm_set1_ps(f)), hi(lo) {}
+    inline Sse41Float (__m128 l, __m128 h) : lo(l), hi(h) {}
+};
+
+static inline Sse41Float operator+ (Sse41Float a, Sse41Float b) { return Sse41Float(_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)); }
+static inline Sse41Float operator- (Sse41Float a, Sse41Float b) { return Sse41Float(_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)); }
+static inline Sse41Float operator* (Sse41Float a, Sse41Float b) { return Sse41Float(_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)); }
+static inline Sse41Float operator/ (Sse41Float a, Sse41Float b) { return Sse41Float(_mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi)); }
+static inline Sse41Float Floor(Sse41Float a) { return Sse41Float(_mm_floor_ps(a.lo), _mm_floor_ps(a.hi)); }
+static inline Sse41Float Min(Sse41Float a, Sse41Float b) { return Sse41Float(_mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi)); }
+static inline Sse41Float Max(Sse41Float a, Sse41Float b) { return Sse41Float(_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)); }
+
+static inline Sse41Float Abs(Sse41Float a) {
+    __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    return Sse41Float(_mm_and_ps(a.lo, mask), _mm_and_ps(a.hi, mask));
+}
+
+static inline Sse41Float Step(Sse41Float edge, Sse41Float x) {
+    __m128 one = _mm_set1_ps(1.0f);
+    return Sse41Float(_mm_and_ps(_mm_cmpge_ps(x.lo, edge.lo), one), _mm_and_ps(_mm_cmpge_ps(x.hi, edge.hi), one));
+}
+
+void SampleTextureSse41(const float* x, const float* y, const float* z, size_t count, float scale, int octaves, float persistence, float* out) {
+    for(size_t i = 0; i < count; i += NOISE_SIMD_WIDTH) {
+	Sse41Float px(_mm_loadu_ps(x + i), _mm_loadu_ps(x + i + 4));
+	Sse41Float py(_mm_loadu_ps(y + i), _mm_loadu_ps(y + i + 4));
+	Sse41Float pz(_mm_loadu_ps(z + i), _mm_loadu_ps(z + i + 4));
+	Sse41Float v = SampleTextureKernel(px, py, pz, scale, octaves, persistence);
+	_mm_storeu_ps(out + i, v.lo);
+	_mm_storeu_ps(out + i + 4, v.hi);
+    }
+}
+
+void NoiseLayerSse41(const float* x, const float* y, const float* z, size_t count, float scale, int octave, float* out) {
+    for(size_t i = 0; i < count; i += NOISE_SIMD_WIDTH) {
+	Sse41Float px(_mm_loadu_ps(x + i), _mm_loadu_ps(x + i + 4));
+	Sse41Float py(_mm_loadu_ps(y + i), _mm_loadu_ps(y + i + 4));
+	Sse41Float pz(_mm_loadu_ps(z + i), _mm_loadu_ps(z + i + 4));
+	Sse41Float v = NoiseLayerKernel(px, py, pz, scale, octave);
+	_mm_storeu_ps(out + i, v.lo);
+	_mm_storeu_ps(out + i + 4, v.hi);
+    }
+}
+
+#endif
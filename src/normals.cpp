@@ -0,0 +1,170 @@
+#include "normals.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NORMALS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// below this many vertices or triangles per thread, splitting up the work costs more than it saves.
+static const size_t NORMALS_MIN_TASK_SIZE = 16 * 1024;
+
+/*
+  Add the normal of the triangle at corner c to normal, weighted by the angle at the corner.
+*/
+static inline void AddCornerNormal(const float* positions, size_t numVertices, const unsigned int* indices, size_t c, float* normal) {
+    const unsigned int* tri = indices + c / 3 * 3;
+    size_t k = c % 3;
+    unsigned int i0 = tri[k];
+    unsigned int i1 = tri[(k + 1) % 3];
+    unsigned int i2 = tri[(k + 2) % 3];
+    if(i1 >= numVertices || i2 >= numVertices)
+	return;
+
+    const float* p0 = positions + 3 * (size_t)i0;
+    const float* p1 = positions + 3 * (size_t)i1;
+    const float* p2 = positions + 3 * (size_t)i2;
+
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+    float n[3] = {
+	e1[1] * e2[2] - e1[2] * e2[1],
+	e1[2] * e2[0] - e1[0] * e2[2],
+	e1[0] * e2[1] - e1[1] * e2[0]
+    };
+    float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if(length == 0.0f)
+	return; // degenerate triangle.
+
+    // |e1 x e2| = |e1||e2|sin(angle), and e1 . e2 = |e1||e2|cos(angle).
+    float angle = std::atan2(length, e1[0] * e2[0] + e1[1] * e2[1] + e1[2] * e2[2]);
+    float weight = angle / length;
+
+    normal[0] += n[0] * weight;
+    normal[1] += n[1] * weight;
+    normal[2] += n[2] * weight;
+}
+
+/*
+  Normalize numVertices xyz normals. Zero normals stay zero.
+*/
+static void NormalizeNormals(float* normals, size_t numVertices) {
+    size_t i = 0;
+
+#ifdef NORMALS_SSE2
+    // four normals are twelve floats, that are loaded as three vectors.
+    for(; i + 4 <= numVertices; i += 4) {
+	float* p = normals + 3 * i;
+	__m128 a = _mm_loadu_ps(p + 0); // x0 y0 z0 x1
+	__m128 b = _mm_loadu_ps(p + 4); // y1 z1 x2 y2
+	__m128 c = _mm_loadu_ps(p + 8); // z2 x3 y3 z3
+
+	// gather the components of the four normals.
+	__m128 x = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 3, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)), _MM_SHUFFLE(3, 0, 1, 0));
+	__m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+
+	__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+	__m128 scale = _mm_and_ps(
+	    _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared)),
+	    _mm_cmpgt_ps(lengthSquared, _mm_setzero_ps()));
+
+	// and spread the scales back out over the components.
+	a = _mm_mul_ps(a, _mm_shuffle_ps(scale, scale, _MM_SHUFFLE(1, 0, 0, 0)));
+	b = _mm_mul_ps(b, _mm_shuffle_ps(scale, scale, _MM_SHUFFLE(2, 2, 1, 1)));
+	c = _mm_mul_ps(c, _mm_shuffle_ps(scale, scale, _MM_SHUFFLE(3, 3, 3, 2)));
+
+	_mm_storeu_ps(p + 0, a);
+	_mm_storeu_ps(p + 4, b);
+	_mm_storeu_ps(p + 8, c);
+    }
+#endif
+
+    for(; i < numVertices; ++i) {
+	float* n = normals + 3 * i;
+	float lengthSquared = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+	float scale = lengthSquared > 0.0f ? 1.0f / std::sqrt(lengthSquared) : 0.0f;
+	n[0] *= scale;
+	n[1] *= scale;
+	n[2] *= scale;
+    }
+}
+
+void ComputeSmoothNormals(
+    const float* positions, size_t numVertices,
+    const unsigned int* indices, size_t numIndices,
+    float* normals) {
+
+    ThreadPool& pool = GetThreadPool();
+    size_t numCorners = numIndices / 3 * 3;
+    size_t maxTasks = (size_t)pool.GetNumThreads() * 4;
+
+    //
+    // The vertices are split into ranges, and the triangles into chunks.
+    // Every chunk first sorts its corners by range, and then every range
+    // adds up the normals of its own corners from all the chunks.
+    //
+    size_t numRanges = numVertices / NORMALS_MIN_TASK_SIZE;
+    numRanges = numRanges < 1 ? 1 : numRanges > maxTasks ? maxTasks : numRanges;
+    size_t rangeSize = (numVertices + numRanges - 1) / numRanges;
+
+    size_t numChunks = numCorners / 3 / NORMALS_MIN_TASK_SIZE;
+    numChunks = numChunks < 1 ? 1 : numChunks > maxTasks ? maxTasks : numChunks;
+    size_t chunkSize = (numCorners / 3 + numChunks - 1) / numChunks * 3;
+
+    // count the corners of every chunk in every range.
+    std::vector<size_t> offsets(numChunks * numRanges, 0);
+    pool.ParallelFor(numChunks, [&](size_t chunk) {
+	    size_t* count = &offsets[chunk * numRanges];
+	    size_t end = (chunk + 1) * chunkSize < numCorners ? (chunk + 1) * chunkSize : numCorners;
+	    for(size_t c = chunk * chunkSize; c < end; ++c) {
+		if(indices[c] < numVertices)
+		    ++count[indices[c] / rangeSize];
+	    }
+	});
+
+    // turn the counts into offsets, so that the corners of a range are next to each other.
+    size_t total = 0;
+    for(size_t r = 0; r < numRanges; ++r) {
+	for(size_t chunk = 0; chunk < numChunks; ++chunk) {
+	    size_t count = offsets[chunk * numRanges + r];
+	    offsets[chunk * numRanges + r] = total;
+	    total += count;
+	}
+    }
+    std::vector<size_t> rangeEnds(numRanges);
+    for(size_t r = 0; r < numRanges; ++r)
+	rangeEnds[r] = r + 1 < numRanges ? offsets[r + 1] : total;
+
+    std::vector<uint32_t> corners(total);
+    pool.ParallelFor(numChunks, [&](size_t chunk) {
+	    std::vector<size_t> next(offsets.begin() + chunk * numRanges, offsets.begin() + (chunk + 1) * numRanges);
+	    size_t end = (chunk + 1) * chunkSize < numCorners ? (chunk + 1) * chunkSize : numCorners;
+	    for(size_t c = chunk * chunkSize; c < end; ++c) {
+		if(indices[c] < numVertices)
+		    corners[next[indices[c] / rangeSize]++] = (uint32_t)c;
+	    }
+	});
+
+    // every range now writes only to its own normals.
+    pool.ParallelFor(numRanges, [&](size_t r) {
+	    size_t first = r * rangeSize;
+	    size_t last = (r + 1) * rangeSize < numVertices ? (r + 1) * rangeSize : numVertices;
+	    if(first >= last)
+		return;
+	    memset(normals + 3 * first, 0, sizeof(float) * 3 * (last - first));
+
+	    for(size_t i = offsets[r]; i < rangeEnds[r]; ++i) {
+		size_t c = corners[i];
+		AddCornerNormal(positions, numVertices, indices, c, normals + 3 * (size_t)indices[c]);
+	    }
+
+	    NormalizeNormals(normals + 3 * first, last - first);
+	});
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+  Compute smooth vertex normals for a triangle mesh, for files that have none.
+
+  Every vertex gets the sum of the normals of the triangles around it,
+  weighted by the angle of the triangle at the vertex, so the result does not
+  depend on how finely the triangles around a vertex are split up, nor on
+  their order.
+
+  The work is split up by ranges of vertices, so that every thread writes
+  only to its own normals and needs no atomics.
+
+  normals must have room for 3 * numVertices floats. Vertices that are not
+  used by any triangle get a zero normal.
+*/
+void ComputeSmoothNormals(
+    const float* positions, size_t numVertices,
+    const unsigned int* indices, size_t numIndices,
+    float* normals);
@@ -0,0 +1,918 @@
+#include "obj_loader.hpp"
+#include "mapped_file.hpp"
+#include "normals.hpp"
+#include "thread_pool.hpp"
+#include "unique_ids.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+/*
+  A corner of a face, as written in the file. Indices are zero-based, and -1
+  means that the component is missing.
+*/
+struct ObjIndex {
+    int v;
+    int vt;
+    int vn;
+};
+
+/*
+  Maps every unique corner to its output vertex.
+
+  This is an open addressing hash table with linear probing. Every slot
+  holds the whole key next to the value, so a lookup usually touches a
+  single cache line.
+*/
+class VertexCache
+{
+public:
+    // expectedSize is the number of unique corners we expect; the table grows if there are more.
+    VertexCache (size_t expectedSize);
+
+    // returns the vertex of corner i, or EMPTY if it has not been inserted.
+    inline unsigned int Find (const ObjIndex& i) const;
+    // corner i must not already be in the cache.
+    inline void Insert (const ObjIndex& i, unsigned int vertex);
+
+    static const unsigned int EMPTY = 0xFFFFFFFFu;
+
+    static inline size_t Hash (const ObjIndex& i);
+
+private:
+    struct Slot {
+	ObjIndex key;
+	unsigned int vertex;
+    };
+    inline void Grow ();
+
+    std::vector<Slot> m_slots;
+    size_t m_mask;
+    size_t m_size;
+};
+
+inline VertexCache::VertexCache (size_t expectedSize)
+    :	m_size(0) {
+    // keep the load factor below one half.
+    size_t capacity = 16;
+    while(capacity < 2 * expectedSize)
+	capacity *= 2;
+
+    Slot empty;
+    empty.key.v = empty.key.vt = empty.key.vn = -1;
+    empty.vertex = EMPTY;
+    m_slots.assign(capacity, empty);
+    m_mask = capacity - 1;
+}
+
+inline size_t VertexCache::Hash (const ObjIndex& i) {
+    unsigned int h = (unsigned int)i.v * 0x9E3779B1u;
+    h ^= (unsigned int)i.vt * 0x85EBCA77u;
+    h ^= (unsigned int)i.vn * 0xC2B2AE3Du;
+    // murmur3 finalizer, so that neighbouring indices spread over the table.
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+inline unsigned int VertexCache::Find (const ObjIndex& i) const {
+    for(size_t s = Hash(i) & m_mask; ; s = (s + 1) & m_mask) {
+	const Slot& slot = m_slots[s];
+	if(slot.vertex == EMPTY)
+	    return EMPTY;
+	if(slot.key.v == i.v && slot.key.vt == i.vt && slot.key.vn == i.vn)
+	    return slot.vertex;
+    }
+}
+
+inline void VertexCache::Insert (const ObjIndex& i, unsigned int vertex) {
+    if(2 * (m_size + 1) > m_slots.size())
+	Grow();
+
+    size_t s = Hash(i) & m_mask;
+    while(m_slots[s].vertex != EMPTY)
+	s = (s + 1) & m_mask;
+
+    m_slots[s].key = i;
+    m_slots[s].vertex = vertex;
+    ++m_size;
+}
+
+inline void VertexCache::Grow () {
+    std::vector<Slot> old;
+    old.swap(m_slots);
+
+    Slot empty;
+    empty.key.v = empty.key.vt = empty.key.vn = -1;
+    empty.vertex = EMPTY;
+    m_slots.assign(old.size() * 2, empty);
+    m_mask = m_slots.size() - 1;
+
+    for(size_t i = 0; i < old.size(); ++i) {
+	if(old[i].vertex == EMPTY)
+	    continue;
+	size_t s = Hash(old[i].key) & m_mask;
+	while(m_slots[s].vertex != EMPTY)
+	    s = (s + 1) & m_mask;
+	m_slots[s] = old[i];
+    }
+}
+
+/*
+  What a quick scan of a chunk found, before it is parsed.
+*/
+struct ObjChunkCounts {
+    size_t numV;
+    size_t numVt;
+    size_t numVn;
+    size_t numFaces;
+    size_t numTriangles;
+
+    // for every group or object name line, the number of faces in the chunk before it.
+    std::vector<size_t> groupFaces;
+};
+
+/*
+  The records parsed out of one chunk of the file. The chunks are parsed in
+  parallel, but the scan has already counted the records before every
+  chunk, so negative face indices are made absolute as they are parsed, and
+  the v and vn records are written straight into the arrays of the whole file.
+*/
+struct ObjChunk {
+    // the v, vt and vn records before the chunk, and then before the line that is parsed.
+    // The texcoords themselves are not used, but relative indices need the count.
+    size_t numV;
+    size_t numVt;
+    size_t numVn;
+
+    std::vector<ObjIndex> corners;
+    std::vector<unsigned int> faceSizes;
+};
+
+static inline bool IsSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static inline bool IsDigit(char c) {
+    return (unsigned int)(c - '0') < 10u;
+}
+
+static inline const char* SkipSpace(const char* p, const char* end) {
+    while(p < end && IsSpace(*p))
+	++p;
+    return p;
+}
+
+// advance to the first of ' ', '\t', '\r' or the end of the line.
+static inline const char* SkipToken(const char* p, const char* end) {
+    while(p < end && *p != ' ' && *p != '\t' && *p != '\r')
+	++p;
+    return p;
+}
+
+// like SkipToken(), but also stops at '/'.
+static inline const char* SkipIndex(const char* p, const char* end) {
+    while(p < end && *p != '/' && *p != ' ' && *p != '\t' && *p != '\r')
+	++p;
+    return p;
+}
+
+// Make index zero-based, and also support relative index.
+static inline int FixIndex(int idx, int n) {
+    if(idx > 0)
+	return idx - 1;
+    if(idx == 0)
+	return 0;
+    return n + idx; // negative value = relative
+}
+
+/*
+  Same as atoi(), but bounded by the end of the line.
+*/
+static inline int ParseInt(const char* p, const char* end) {
+    while(p < end && (IsSpace(*p) || *p == '\r'))
+	++p;
+
+    bool negative = false;
+    if(p < end && (*p == '+' || *p == '-')) {
+	negative = *p == '-';
+	++p;
+    }
+
+    unsigned int i = 0;
+    while(p < end && IsDigit(*p)) {
+	i = i * 10 + (unsigned int)(*p - '0');
+	++p;
+    }
+    return negative ? -(int)i : (int)i;
+}
+
+/*
+  This is tinyobj's tryParseDouble(). The arithmetic is kept exactly the
+  same so that we get bit-identical floats, but the powers of ten of the
+  decimal digits are looked up in a table instead of calling pow() for every
+  digit.
+*/
+static bool TryParseDouble(const char* s, const char* sEnd, double* result) {
+    static const int NUM_POWERS = 32;
+    struct NegativePowersOfTen {
+	double p[NUM_POWERS];
+	NegativePowersOfTen() {
+	    for(int i = 0; i < NUM_POWERS; ++i)
+		p[i] = pow(10.0, -i);
+	}
+    };
+    static const NegativePowersOfTen powers;
+
+    if(s >= sEnd)
+	return false;
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    char sign = '+';
+    char expSign = '+';
+    const char* curr = s;
+    int read = 0;
+
+    if(*curr == '+' || *curr == '-') {
+	sign = *curr;
+	curr++;
+    } else if(!IsDigit(*curr)) {
+	return false;
+    }
+
+    // integer part.
+    while(curr != sEnd && IsDigit(*curr)) {
+	mantissa *= 10;
+	mantissa += (int)(*curr - '0');
+	curr++;
+	read++;
+    }
+    if(read == 0)
+	return false;
+
+    // decimal part.
+    if(curr != sEnd && *curr == '.') {
+	curr++;
+	read = 1;
+	while(curr != sEnd && IsDigit(*curr)) {
+	    mantissa += (int)(*curr - '0') * (read < NUM_POWERS ? powers.p[read] : pow(10.0, -read));
+	    read++;
+	    curr++;
+	}
+    }
+
+    // exponent part.
+    if(curr != sEnd && (*curr == 'e' || *curr == 'E')) {
+	curr++;
+	if(curr != sEnd && (*curr == '+' || *curr == '-')) {
+	    expSign = *curr;
+	    curr++;
+	} else if(curr == sEnd || !IsDigit(*curr)) {
+	    // Empty E is not allowed.
+	    return false;
+	}
+
+	read = 0;
+	while(curr != sEnd && IsDigit(*curr)) {
+	    exponent *= 10;
+	    exponent += (int)(*curr - '0');
+	    curr++;
+	    read++;
+	}
+	exponent *= (expSign == '+' ? 1 : -1);
+	if(read == 0)
+	    return false;
+    }
+
+    // pow(5,0) and ldexp(x,0) are exact, so skip them for the common case.
+    if(exponent != 0)
+	mantissa = ldexp(mantissa * pow(5.0, exponent), exponent);
+    *result = (sign == '+' ? 1 : -1) * mantissa;
+    return true;
+}
+
+static inline float ParseFloat(const char*& token, const char* end) {
+    token = SkipSpace(token, end);
+    const char* tokenEnd = SkipToken(token, end);
+    double val = 0.0;
+    TryParseDouble(token, tokenEnd, &val);
+    token = tokenEnd;
+    return (float)val;
+}
+
+static inline void ParseFloat3(const char* token, const char* end, float* out) {
+    out[0] = ParseFloat(token, end);
+    out[1] = ParseFloat(token, end);
+    out[2] = ParseFloat(token, end);
+}
+
+// Parse triples: i, i/j/k, i//k, i/j
+static inline void ParseTriple(const char*& token, const char* end, ObjChunk& chunk) {
+    chunk.corners.push_back(ObjIndex());
+    ObjIndex& vi = chunk.corners.back();
+    vi.v = vi.vt = vi.vn = -1;
+
+    vi.v = FixIndex(ParseInt(token, end), (int)chunk.numV);
+    token = SkipIndex(token, end);
+    if(token == end || *token != '/')
+	return;
+    token++;
+
+    // i//k
+    if(token != end && *token == '/') {
+	token++;
+	vi.vn = FixIndex(ParseInt(token, end), (int)chunk.numVn);
+	token = SkipIndex(token, end);
+	return;
+    }
+
+    // i/j/k or i/j
+    vi.vt = FixIndex(ParseInt(token, end), (int)chunk.numVt);
+    token = SkipIndex(token, end);
+    if(token == end || *token != '/')
+	return;
+
+    // i/j/k
+    token++;
+    vi.vn = FixIndex(ParseInt(token, end), (int)chunk.numVn);
+    token = SkipIndex(token, end);
+}
+
+// Same pointer movement as ParseTriple(), but without parsing the indices.
+static inline void SkipTriple(const char*& token, const char* end) {
+    token = SkipIndex(token, end);
+    if(token == end || *token != '/')
+	return;
+    token++;
+
+    if(token != end && *token == '/') {
+	token++;
+	token = SkipIndex(token, end);
+	return;
+    }
+
+    token = SkipIndex(token, end);
+    if(token == end || *token != '/')
+	return;
+
+    token++;
+    token = SkipIndex(token, end);
+}
+
+/*
+  Step to the next line in [p, chunkEnd). Returns the first non-blank
+  character of the line, and sets lineEnd to the end of the line. Both "\n",
+  "\r\n" and "\r" end a line.
+*/
+static inline const char* NextLine(const char*& p, const char* chunkEnd, const char*& lineEnd) {
+    lineEnd = (const char*)memchr(p, '\n', chunkEnd - p);
+    if(!lineEnd)
+	lineEnd = chunkEnd;
+    const char* cr = (const char*)memchr(p, '\r', lineEnd - p);
+    if(cr)
+	lineEnd = cr;
+
+    const char* token = SkipSpace(p, lineEnd);
+
+    // step past the line terminator.
+    p = lineEnd;
+    if(p < chunkEnd && *p == '\r')
+	++p;
+    if(p < chunkEnd && *p == '\n')
+	++p;
+
+    return token;
+}
+
+/*
+  Count the vertices, faces and triangles in [p, chunkEnd), and find the group
+  lines. This is much cheaper than parsing the chunk, since no numbers are
+  converted.
+*/
+static void ScanChunk(const char* p, const char* chunkEnd, ObjChunkCounts& counts) {
+    counts.numV = 0;
+    counts.numVt = 0;
+    counts.numVn = 0;
+    counts.numFaces = 0;
+    counts.numTriangles = 0;
+    counts.groupFaces.clear();
+
+    while(p < chunkEnd) {
+	const char* lineEnd;
+	const char* token = NextLine(p, chunkEnd, lineEnd);
+
+	if(lineEnd - token < 2)
+	    continue;
+
+	// vertex
+	if(token[0] == 'v' && IsSpace(token[1])) {
+	    ++counts.numV;
+	    continue;
+	}
+
+	// normal
+	if(token[0] == 'v' && token[1] == 'n' && lineEnd - token > 2 && IsSpace(token[2])) {
+	    ++counts.numVn;
+	    continue;
+	}
+
+	// texcoord
+	if(token[0] == 'v' && token[1] == 't' && lineEnd - token > 2 && IsSpace(token[2])) {
+	    ++counts.numVt;
+	    continue;
+	}
+
+	// face
+	if(token[0] == 'f' && IsSpace(token[1])) {
+	    token = SkipSpace(token + 2, lineEnd);
+
+	    size_t numCorners = 0;
+	    while(token < lineEnd) {
+		SkipTriple(token, lineEnd);
+		++numCorners;
+		while(token < lineEnd && (IsSpace(*token) || *token == '\r'))
+		    ++token;
+	    }
+	    ++counts.numFaces;
+	    counts.numTriangles += numCorners >= 3 ? numCorners - 2 : 0;
+	    continue;
+	}
+
+	// group or object name.
+	if((token[0] == 'g' || token[0] == 'o') && IsSpace(token[1])) {
+	    counts.groupFaces.push_back(counts.numFaces);
+	}
+    }
+}
+
+/*
+  Parse all the records in [p, chunkEnd), which must start at the beginning
+  of a line. The counts of chunk must be those of the records before it, and
+  v and vn must have room for all the records of the file.
+*/
+static void ParseChunk(const char* p, const char* chunkEnd, ObjChunk& chunk, float* v, float* vn) {
+    while(p < chunkEnd) {
+	const char* lineEnd;
+	const char* token = NextLine(p, chunkEnd, lineEnd);
+
+	size_t len = lineEnd - token;
+	if(len < 2)
+	    continue; // empty line, or too short to be a record we care about.
+
+	// vertex
+	if(token[0] == 'v' && IsSpace(token[1])) {
+	    ParseFloat3(token + 2, lineEnd, v + 3 * chunk.numV++);
+	    continue;
+	}
+
+	// normal
+	if(token[0] == 'v' && token[1] == 'n' && len > 2 && IsSpace(token[2])) {
+	    ParseFloat3(token + 3, lineEnd, vn + 3 * chunk.numVn++);
+	    continue;
+	}
+
+	// texcoord
+	if(token[0] == 'v' && token[1] == 't' && len > 2 && IsSpace(token[2])) {
+	    ++chunk.numVt;
+	    continue;
+	}
+
+	// face
+	if(token[0] == 'f' && IsSpace(token[1])) {
+	    token = SkipSpace(token + 2, lineEnd);
+
+	    size_t begin = chunk.corners.size();
+	    while(token < lineEnd) {
+		ParseTriple(token, lineEnd, chunk);
+		while(token < lineEnd && (IsSpace(*token) || *token == '\r'))
+		    ++token;
+	    }
+	    chunk.faceSizes.push_back((unsigned int)(chunk.corners.size() - begin));
+	    continue;
+	}
+    }
+}
+
+/*
+  The faces of one shape that are in one chunk. The corners of every
+  segment are numbered on their own, in parallel, and then the segments of
+  a shape are merged into the vertices of the shape.
+*/
+struct ObjSegment {
+    size_t shape;
+    size_t firstFace; // in the chunk.
+    size_t numFaces;
+
+    std::vector<ObjIndex> corners;     // the unique corners, in order of first use.
+    std::vector<unsigned int> indices; // into corners, three per triangle.
+
+    // set if the shape has faces in other chunks too, so that the corners may
+    // have been used before. They are then keys firstKey and on of the merge.
+    bool merged;
+    size_t firstKey;
+
+    size_t numVertices; // the corners that no earlier segment of the shape has used.
+    size_t numIndices;
+    size_t firstVertex; // in the arrays of the whole file.
+    size_t firstIndex;
+};
+
+/*
+  Triangulate the faces of segment as fans, and number their unique
+  corners in order of first use. face is moved past the corners of the
+  faces. Returns false if a face refers to a vertex that the file does not
+  have, which does not depend on how the file was split up.
+*/
+static bool DedupFaces(const ObjIndex*& face, const unsigned int* faceSizes, size_t numV, ObjSegment& segment) {
+    // a closed triangle mesh has about half as many vertices as triangles,
+    // so the face count is a good estimate of the number of unique corners.
+    VertexCache vertexCache(segment.numFaces);
+
+    for(size_t i = 0; i < segment.numFaces; face += faceSizes[i], ++i) {
+
+	// Polygon -> triangle fan conversion
+	for(unsigned int k = 2; k < faceSizes[i]; ++k) {
+	    const ObjIndex* triangle[3] = { &face[0], &face[k - 1], &face[k] };
+	    for(int j = 0; j < 3; ++j) {
+		const ObjIndex& corner = *triangle[j];
+		unsigned int id = vertexCache.Find(corner);
+		if(id == VertexCache::EMPTY) {
+		    if(corner.v < 0 || (size_t)corner.v >= numV)
+			return false;
+		    id = (unsigned int)segment.corners.size();
+		    segment.corners.push_back(corner);
+		    vertexCache.Insert(corner, id);
+		}
+		segment.indices.push_back(id);
+	    }
+	}
+    }
+
+    return true;
+}
+
+/*
+  Split [data, data+size) into about numChunks pieces, that all start at the
+  beginning of a line. Returns the numChunks+1 boundaries.
+*/
+static std::vector<const char*> SplitLines(const char* data, size_t size, size_t numChunks) {
+    std::vector<const char*> bounds;
+    bounds.push_back(data);
+
+    const char* end = data + size;
+    for(size_t i = 1; i < numChunks; ++i) {
+	const char* p = data + size / numChunks * i;
+	if(p <= bounds.back())
+	    continue;
+	while(p < end && *p != '\n' && *p != '\r')
+	    ++p;
+	if(p < end)
+	    ++p;
+	if(p > bounds.back() && p < end)
+	    bounds.push_back(p);
+    }
+
+    bounds.push_back(end);
+    return bounds;
+}
+
+
+static inline uint32_t HashCorner(size_t shape, const ObjIndex& i) {
+    return (uint32_t)VertexCache::Hash(i) ^ (uint32_t)shape * 0x27D4EB2Fu;
+}
+
+bool LoadObjFile(
+    const char* path,
+    std::vector<float>& positions,
+    std::vector<float>& normals,
+    std::vector<unsigned int>& indices,
+    std::vector<ObjShape>& shapes,
+    std::string& err,
+    ObjStreamSink* sink) {
+
+    // below this, splitting up the file costs more than it saves.
+    const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+    positions.clear();
+    normals.clear();
+    indices.clear();
+    shapes.clear();
+
+    MappedFile file;
+    if(!file.Open(path)) {
+	err += "Cannot open file [" + std::string(path) + "]\n";
+	return false;
+    }
+
+    ThreadPool& pool = GetThreadPool();
+
+    //
+    // Split the file into chunks. A few chunks per thread keep all the
+    // threads busy even when some parts of the file are slower to parse.
+    //
+    size_t numChunks = file.GetSize() / MIN_CHUNK_SIZE;
+    if(numChunks > (size_t)pool.GetNumThreads() * 4)
+	numChunks = (size_t)pool.GetNumThreads() * 4;
+    if(numChunks < 1)
+	numChunks = 1;
+
+    std::vector<const char*> bounds = SplitLines(file.GetData(), file.GetSize(), numChunks);
+    numChunks = bounds.size() - 1;
+
+    //
+    // Scan the chunks first, so that we know how big the mesh will be, and
+    // where the records of every chunk go, before we start parsing it.
+    //
+    std::vector<ObjChunkCounts> counts(numChunks);
+    pool.ParallelFor(numChunks, [&](size_t c) {
+	    ScanChunk(bounds[c], bounds[c + 1], counts[c]);
+	});
+
+    //
+    // A new shape starts at every group or object name that comes after
+    // a face. shapeStarts[i] is the first face of shape i.
+    //
+    std::vector<ObjChunk> chunks(numChunks);
+    std::vector<size_t> chunkFirstFace(numChunks + 1, 0);
+    std::vector<size_t> shapeStarts(1, 0);
+    size_t numV = 0;
+    size_t numVt = 0;
+    size_t numVn = 0;
+    for(size_t c = 0; c < numChunks; ++c) {
+	for(size_t i = 0; i < counts[c].groupFaces.size(); ++i) {
+	    size_t face = chunkFirstFace[c] + counts[c].groupFaces[i];
+	    if(face > shapeStarts.back())
+		shapeStarts.push_back(face);
+	}
+
+	chunks[c].numV = numV;
+	chunks[c].numVt = numVt;
+	chunks[c].numVn = numVn;
+	chunkFirstFace[c + 1] = chunkFirstFace[c] + counts[c].numFaces;
+	numV += counts[c].numV;
+	numVt += counts[c].numVt;
+	numVn += counts[c].numVn;
+    }
+    size_t numFaces = chunkFirstFace[numChunks];
+
+    // a group line after the last face does not start a shape.
+    if(shapeStarts.back() == numFaces && numFaces > 0)
+	shapeStarts.pop_back();
+    shapeStarts.push_back(numFaces);
+
+    if(numFaces == 0) {
+	err += "No faces in file [" + std::string(path) + "]\n";
+	return false;
+    }
+
+    //
+    // Split the faces into segments, at the chunk boundaries and where shapes start.
+    //
+    size_t numShapes = shapeStarts.size() - 1;
+    std::vector<ObjSegment> segments;
+    std::vector<size_t> chunkFirstSegment(numChunks + 1, 0);
+    size_t shape = 0;
+    for(size_t c = 0; c < numChunks; ++c) {
+	chunkFirstSegment[c] = segments.size();
+	for(size_t face = chunkFirstFace[c]; face < chunkFirstFace[c + 1]; ) {
+	    while(shapeStarts[shape + 1] <= face)
+		++shape;
+
+	    segments.push_back(ObjSegment());
+	    ObjSegment& segment = segments.back();
+	    segment.shape = shape;
+	    segment.firstFace = face - chunkFirstFace[c];
+	    segment.numFaces = std::min(shapeStarts[shape + 1], chunkFirstFace[c + 1]) - face;
+	    face += segment.numFaces;
+	}
+    }
+    chunkFirstSegment[numChunks] = segments.size();
+
+    std::vector<size_t> shapeFirstSegment(numShapes + 1, segments.size());
+    for(size_t s = segments.size(); s-- > 0; )
+	shapeFirstSegment[segments[s].shape] = s;
+
+    //
+    // Parse the chunks in parallel, and number the corners of every segment
+    // as soon as its chunk is parsed. All the vertices of the file are known
+    // from the scan, so faces may refer to vertices that come after them.
+    //
+    std::vector<float> v(3 * numV);
+    std::vector<float> vn(3 * numVn);
+    std::vector<char> chunkFailed(numChunks, 0);
+    pool.ParallelFor(numChunks, [&](size_t c) {
+	    ObjChunk& chunk = chunks[c];
+	    ParseChunk(bounds[c], bounds[c + 1], chunk, v.data(), vn.data());
+
+	    const ObjIndex* corner = chunk.corners.data();
+	    for(size_t s = chunkFirstSegment[c]; s < chunkFirstSegment[c + 1] && !chunkFailed[c]; ++s)
+		chunkFailed[c] = !DedupFaces(corner, &chunk.faceSizes[segments[s].firstFace], numV, segments[s]);
+
+	    std::vector<ObjIndex>().swap(chunk.corners);
+	    std::vector<unsigned int>().swap(chunk.faceSizes);
+	});
+
+    for(size_t c = 0; c < numChunks; ++c) {
+	if(chunkFailed[c]) {
+	    err += "Face refers to a vertex that does not exist.\n";
+	    return false;
+	}
+    }
+
+    //
+    // Only the first use of a corner in a shape makes a vertex. A shape with
+    // faces in several chunks may use a corner in several segments, so the
+    // corners of those segments are numbered once more, all together, and
+    // the first segment that uses a corner gets its vertex.
+    //
+    size_t numKeys = 0;
+    for(size_t s = 0; s < segments.size(); ++s) {
+	ObjSegment& segment = segments[s];
+	segment.merged = shapeFirstSegment[segment.shape + 1] - shapeFirstSegment[segment.shape] > 1;
+	segment.firstKey = numKeys;
+	if(segment.merged)
+	    numKeys += segment.corners.size();
+    }
+
+    std::vector<ObjIndex> keyCorners(numKeys);
+    std::vector<uint32_t> keyShapes(numKeys);
+    pool.ParallelFor(segments.size(), [&](size_t s) {
+	    const ObjSegment& segment = segments[s];
+	    if(!segment.merged)
+		return;
+	    std::copy(segment.corners.begin(), segment.corners.end(), keyCorners.begin() + segment.firstKey);
+	    std::fill(keyShapes.begin() + segment.firstKey, keyShapes.begin() + segment.firstKey + segment.corners.size(), (uint32_t)segment.shape);
+	});
+
+    std::vector<uint32_t> keyIds(numKeys);
+    std::vector<uint32_t> firstKeys;
+    AssignUniqueIds(numKeys,
+		    [&](size_t k) { return HashCorner(keyShapes[k], keyCorners[k]); },
+		    [&](size_t k, size_t l) {
+			const ObjIndex& a = keyCorners[k];
+			const ObjIndex& b = keyCorners[l];
+			return keyShapes[k] == keyShapes[l] && a.v == b.v && a.vt == b.vt && a.vn == b.vn;
+		    },
+		    keyIds.data(), firstKeys);
+    std::vector<ObjIndex>().swap(keyCorners);
+    std::vector<uint32_t>().swap(keyShapes);
+
+    // the vertex of every key that is a first use, counted from the first vertex of its segment for now.
+    std::vector<uint32_t> keyVertices(numKeys);
+    pool.ParallelFor(segments.size(), [&](size_t s) {
+	    ObjSegment& segment = segments[s];
+	    segment.numIndices = segment.indices.size();
+	    segment.numVertices = segment.corners.size();
+	    if(!segment.merged)
+		return;
+
+	    segment.numVertices = 0;
+	    for(size_t k = segment.firstKey; k < segment.firstKey + segment.corners.size(); ++k) {
+		if(firstKeys[keyIds[k]] == k)
+		    keyVertices[k] = (uint32_t)segment.numVertices++;
+	    }
+	});
+
+    //
+    // A prefix sum over the segments gives every segment the place of its
+    // vertices and indices in the arrays of the whole file.
+    //
+    size_t numVertices = 0;
+    size_t numIndices = 0;
+    for(size_t s = 0; s < segments.size(); ++s) {
+	segments[s].firstVertex = numVertices;
+	segments[s].firstIndex = numIndices;
+	numVertices += segments[s].numVertices;
+	numIndices += segments[s].numIndices;
+    }
+
+    shapes.resize(numShapes);
+    for(size_t i = 0; i < numShapes; ++i) {
+	const ObjSegment& first = segments[shapeFirstSegment[i]];
+	const ObjSegment& last = segments[shapeFirstSegment[i + 1] - 1];
+	shapes[i].firstIndex = (unsigned int)first.firstIndex;
+	shapes[i].numIndices = (unsigned int)(last.firstIndex + last.numIndices - first.firstIndex);
+	shapes[i].baseVertex = (unsigned int)first.firstVertex;
+	shapes[i].numVertices = (unsigned int)(last.firstVertex + last.numVertices - first.firstVertex);
+    }
+
+    pool.ParallelFor(segments.size(), [&](size_t s) {
+	    const ObjSegment& segment = segments[s];
+	    if(!segment.merged)
+		return;
+	    for(size_t k = segment.firstKey; k < segment.firstKey + segment.corners.size(); ++k) {
+		if(firstKeys[keyIds[k]] == k)
+		    keyVertices[k] += (uint32_t)segment.firstVertex;
+	    }
+	});
+
+    //
+    // Create the vertices and indices of every segment in parallel. Whichever
+    // thread finishes a segment also hands every finished segment to the
+    // sink, in file order, so the vertices always come before the indices
+    // that use them.
+    //
+    positions.resize(3 * numVertices);
+    normals.resize(3 * numVertices);
+    indices.resize(numIndices);
+    bool hasNormals = numVn > 0;
+    if(sink)
+	sink->Begin(numIndices, numVertices);
+
+    std::vector<bool> filled(segments.size(), false);
+    size_t nextStream = 0;
+    bool streaming = false;
+    std::mutex streamMutex;
+    std::vector<ObjShape> streamedShapes;
+
+    pool.ParallelFor(segments.size(), [&](size_t s) {
+	    ObjSegment& segment = segments[s];
+	    unsigned int baseVertex = shapes[segment.shape].baseVertex;
+
+	    std::vector<unsigned int> cornerVertices(segment.corners.size());
+	    for(size_t j = 0; j < segment.corners.size(); ++j) {
+		size_t vertex = segment.firstVertex + j;
+		bool firstUse = true;
+		if(segment.merged) {
+		    uint32_t first = firstKeys[keyIds[segment.firstKey + j]];
+		    vertex = keyVertices[first];
+		    firstUse = first == segment.firstKey + j;
+		}
+		cornerVertices[j] = (unsigned int)(vertex - baseVertex);
+		if(!firstUse)
+		    continue;
+
+		const ObjIndex& corner = segment.corners[j];
+		memcpy(&positions[3 * vertex], &v[3 * (size_t)corner.v], 3 * sizeof(float));
+		if(!hasNormals)
+		    continue;
+		if(corner.vn >= 0 && (size_t)corner.vn < numVn)
+		    memcpy(&normals[3 * vertex], &vn[3 * (size_t)corner.vn], 3 * sizeof(float));
+		else
+		    memset(&normals[3 * vertex], 0, 3 * sizeof(float));
+	    }
+
+	    for(size_t i = 0; i < segment.numIndices; ++i)
+		indices[segment.firstIndex + i] = cornerVertices[segment.indices[i]];
+
+	    std::vector<ObjIndex>().swap(segment.corners);
+	    std::vector<unsigned int>().swap(segment.indices);
+
+	    std::unique_lock<std::mutex> lock(streamMutex);
+	    filled[s] = true;
+	    if(streaming)
+		return; // the thread that is streaming will get to this segment.
+	    streaming = true;
+
+	    while(nextStream < segments.size() && filled[nextStream]) {
+		const ObjSegment& next = segments[nextStream];
+		const ObjShape& nextShape = shapes[next.shape];
+		bool firstOfShape = nextStream == shapeFirstSegment[next.shape];
+		bool lastOfShape = nextStream + 1 == shapeFirstSegment[next.shape + 1];
+		lock.unlock();
+
+		if(firstOfShape) {
+		    ObjShape streamed = nextShape;
+		    streamed.numIndices = 0;
+		    streamed.numVertices = 0;
+		    streamedShapes.push_back(streamed);
+		}
+		streamedShapes.back().numIndices += (unsigned int)next.numIndices;
+		streamedShapes.back().numVertices += (unsigned int)next.numVertices;
+
+		// the normals from the file come with their vertices. Without them, every
+		// shape gets smooth normals once all its faces are in.
+		size_t firstNormal = 3 * next.firstVertex;
+		size_t endNormal = 3 * (next.firstVertex + next.numVertices);
+		if(!hasNormals) {
+		    firstNormal = endNormal;
+		    if(lastOfShape) {
+			firstNormal = 3 * (size_t)nextShape.baseVertex;
+			ComputeSmoothNormals(
+			    positions.data() + firstNormal, nextShape.numVertices,
+			    indices.data() + nextShape.firstIndex, nextShape.numIndices,
+			    normals.data() + firstNormal);
+		    }
+		}
+
+		if(sink) {
+		    sink->Append(positions, 3 * next.firstVertex, 3 * (next.firstVertex + next.numVertices),
+				 normals, firstNormal, endNormal,
+				 indices, next.firstIndex, next.firstIndex + next.numIndices,
+				 streamedShapes, streamedShapes.size() - 1);
+		}
+
+		lock.lock();
+		++nextStream;
+	    }
+	    streaming = false;
+	});
+
+    return true;
+}
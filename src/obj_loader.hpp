@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+  A group or object of an .obj file. All shapes share the same vertex and
+  index arrays, and the indices of a shape count from its baseVertex.
+*/
+struct ObjShape {
+    unsigned int firstIndex;
+    unsigned int numIndices;
+    unsigned int baseVertex;
+    unsigned int numVertices;
+};
+
+/*
+  Receives the mesh piece by piece while LoadObjFile() is still creating
+  it. The calls are made from the loader's worker threads, one at a time.
+*/
+class ObjStreamSink
+{
+public:
+    virtual ~ObjStreamSink () {}
+
+    // called once before anything else, with the final sizes of the arrays.
+    virtual void Begin (size_t numIndices, size_t numVertices) = 0;
+
+    // called every time a part of the file has been turned into vertices and
+    // indices, in file order. The arrays have the size of the whole mesh, and
+    // [firstPosition, endPosition) and so on are the elements that are new.
+    // shapes holds the shapes handed over so far, and those from firstShape
+    // and on are new, or have grown. The arrays may change as soon as
+    // Append() returns.
+    virtual void Append (
+	const std::vector<float>& positions, size_t firstPosition, size_t endPosition,
+	const std::vector<float>& normals, size_t firstNormal, size_t endNormal,
+	const std::vector<unsigned int>& indices, size_t firstIndex, size_t endIndex,
+	const std::vector<ObjShape>& shapes, size_t firstShape) = 0;
+};
+
+/*
+  Loads all the shapes of an .obj file into one set of arrays.
+
+  The file is memory mapped and the v/vn/vt/f records are scanned straight
+  out of the mapping, so no per-line strings or streams are created. The
+  file is split into chunks that are parsed in parallel, and the corners
+  are numbered per chunk in parallel, and then merged.
+  Faces are triangulated as fans, and every unique position/texcoord/normal
+  triple of a shape becomes one vertex of the shape, in order of first use.
+  This gives the same vertices and indices as the shapes from tinyobj::LoadObj,
+  one after another. If any vertex has a normal, then all of them get one,
+  and vertices without a normal get a zero normal. If no vertex has a
+  normal, smooth normals are computed with ComputeSmoothNormals(), and the
+  normals of a shape are handed to the sink once the shape is complete.
+
+  Materials are not used by the renderer, so mtllib and usemtl lines are
+  ignored. Faces may refer to vertices anywhere in the file.
+
+  If sink is not NULL, it is handed the vertices and indices as they are
+  created, so that they can be used before the whole mesh is done.
+
+  Returns false and writes a message into err if the file could not be loaded.
+*/
+bool LoadObjFile(
+    const char* path,
+    std::vector<float>& positions,       // [output] xyz per vertex.
+    std::vector<float>& normals,         // [output] xyz per vertex, computed if the file has no normals.
+    std::vector<unsigned int>& indices,  // [output] three per triangle.
+    std::vector<ObjShape>& shapes,       // [output] the range of each shape in the arrays.
+    std::string& err,
+    ObjStreamSink* sink = NULL);
@@ -0,0 +1,90 @@
+#include "quantize.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <vector>
+
+// the vertices are split into blocks of this many, that are handled in parallel.
+static const size_t QUANTIZE_BLOCK_SIZE = 64 * 1024;
+
+static inline float SignNotZero(float f) {
+    return f >= 0.0f ? 1.0f : -1.0f;
+}
+
+void QuantizePositions(const float* positions, size_t numVertices, QuantizationBounds& bounds, uint16_t* out) {
+    ThreadPool& pool = GetThreadPool();
+    size_t numBlocks = (numVertices + QUANTIZE_BLOCK_SIZE - 1) / QUANTIZE_BLOCK_SIZE;
+
+    //
+    // Find the bounding box, first of every block, and then of the whole mesh.
+    //
+    std::vector<float> blockMin(3 * numBlocks, INFINITY);
+    std::vector<float> blockMax(3 * numBlocks, -INFINITY);
+    pool.ParallelFor(numBlocks, [&](size_t b) {
+	    size_t end = (b + 1) * QUANTIZE_BLOCK_SIZE < numVertices ? (b + 1) * QUANTIZE_BLOCK_SIZE : numVertices;
+	    for(size_t i = b * QUANTIZE_BLOCK_SIZE; i < end; ++i) {
+		for(int c = 0; c < 3; ++c) {
+		    blockMin[3 * b + c] = std::fmin(blockMin[3 * b + c], positions[3 * i + c]);
+		    blockMax[3 * b + c] = std::fmax(blockMax[3 * b + c], positions[3 * i + c]);
+		}
+	    }
+	});
+
+    float invScale[3];
+    for(int c = 0; c < 3; ++c) {
+	float lo = INFINITY;
+	float hi = -INFINITY;
+	for(size_t b = 0; b < numBlocks; ++b) {
+	    lo = std::fmin(lo, blockMin[3 * b + c]);
+	    hi = std::fmax(hi, blockMax[3 * b + c]);
+	}
+	if(numBlocks == 0)
+	    lo = hi = 0.0f;
+
+	bounds.min[c] = lo;
+	bounds.scale[c] = (hi - lo) / 65535.0f;
+	invScale[c] = hi > lo ? 65535.0f / (hi - lo) : 0.0f;
+    }
+
+    //
+    // Then quantize.
+    //
+    pool.ParallelFor(numBlocks, [&](size_t b) {
+	    size_t end = (b + 1) * QUANTIZE_BLOCK_SIZE < numVertices ? (b + 1) * QUANTIZE_BLOCK_SIZE : numVertices;
+	    for(size_t i = b * QUANTIZE_BLOCK_SIZE; i < end; ++i) {
+		for(int c = 0; c < 3; ++c) {
+		    float q = (positions[3 * i + c] - bounds.min[c]) * invScale[c] + 0.5f;
+		    out[3 * i + c] = (uint16_t)(q < 65535.0f ? q : 65535.0f);
+		}
+	    }
+	});
+}
+
+void OctEncodeNormals(const float* normals, size_t numVertices, int16_t* out) {
+    size_t numBlocks = (numVertices + QUANTIZE_BLOCK_SIZE - 1) / QUANTIZE_BLOCK_SIZE;
+
+    GetThreadPool().ParallelFor(numBlocks, [&](size_t b) {
+	    size_t end = (b + 1) * QUANTIZE_BLOCK_SIZE < numVertices ? (b + 1) * QUANTIZE_BLOCK_SIZE : numVertices;
+	    for(size_t i = b * QUANTIZE_BLOCK_SIZE; i < end; ++i) {
+		float x = normals[3 * i + 0];
+		float y = normals[3 * i + 1];
+		float z = normals[3 * i + 2];
+
+		// project onto the octahedron |x| + |y| + |z| = 1,
+		float l1 = std::fabs(x) + std::fabs(y) + std::fabs(z);
+		float u = l1 > 0.0f ? x / l1 : 0.0f;
+		float v = l1 > 0.0f ? y / l1 : 0.0f;
+
+		// and fold the lower half over the upper half.
+		if(z < 0.0f) {
+		    float foldedU = (1.0f - std::fabs(v)) * SignNotZero(u);
+		    float foldedV = (1.0f - std::fabs(u)) * SignNotZero(v);
+		    u = foldedU;
+		    v = foldedV;
+		}
+
+		out[2 * i + 0] = (int16_t)std::lround(u * 32767.0f);
+		out[2 * i + 1] = (int16_t)std::lround(v * 32767.0f);
+	    }
+	});
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+/*
+  A compact vertex format, that takes 10 bytes per vertex instead of the 24
+  bytes of float positions and normals:
+
+  - positions are three 16-bit unsigned integers, that span the bounding box
+    of the mesh. The shaders turn them back into floats with
+    pos = boundsMin + q * boundsScale.
+  - normals are octahedral encoded into two 16-bit signed integers.
+    The shaders decode them with octDecode() in shader_common.
+*/
+
+struct QuantizationBounds {
+    float min[3];
+    float scale[3]; // size of one step of the quantized positions.
+};
+
+/*
+  Quantize numVertices xyz positions into out, that must have room for
+  3 * numVertices values. bounds is set to the bounding box of the positions.
+*/
+void QuantizePositions(const float* positions, size_t numVertices, QuantizationBounds& bounds, uint16_t* out);
+
+/*
+  Octahedral encode numVertices xyz normals into out, that must have room for
+  2 * numVertices values. Zero normals are encoded as (0, 0).
+*/
+void OctEncodeNormals(const float* normals, size_t numVertices, int16_t* out);
@@ -1,3 +1,10 @@
+// the depth is never written here, and nothing is discarded, so the depth
+// test may as well run first. With the depth pre-pass, the noise then only
+// runs for the fragments that are visible.
+#ifdef GL_ARB_shader_image_load_store
+layout(early_fragment_tests) in;
+#endif
+
 in vec3 fsPos;
 in vec3 fsNormal;
 in vec3 fsResult;
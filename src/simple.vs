@@ -1,6 +1,14 @@
 layout(location = 0) in vec3 vsPos;
 layout(location = 1) in vec3 vsNormal;
 
+// set if the vertices are in the compact format of quantize.hpp.
+uniform int uQuantized;
+uniform vec3 uBoundsMin;
+uniform vec3 uBoundsScale;
+
+// the depth pre-pass draws with this shader too, and the depth has to come out exactly the same.
+invariant gl_Position;
+
 out vec3 fsPos;
 out vec3 fsNormal;
 out vec3 fsResult;
@@ -13,19 +21,40 @@ uniform int uNoiseOctaves;
 uniform float uNoiseScale;
 uniform float uNoisePersistence;
 
+// with uPrecomputedShading, the octaves of sampleTexture() of every vertex, computed on the CPU.
+// Octave i of a vertex is texel gl_VertexID of uNoiseLayers[i], and is weighted like in fbm().
+uniform int uPrecomputedShading;
+uniform samplerBuffer uNoiseLayers[10];
+uniform float uNoiseAmplitudes[10];
+
 void main()
 {
-    fsPos = vsPos;
-    fsNormal = vsNormal;
+    vec3 pos = vsPos;
+    vec3 normal = vsNormal;
+    if(uQuantized == 1) {
+	pos = uBoundsMin + vsPos * uBoundsScale;
+	normal = octDecode(vsNormal.xy);
+    }
+
+    fsPos = pos;
+    fsNormal = normal;
 
     if(uDoVertexCalculation==1) {
 	if(uRenderSpecular == 1)
-	    fsResult = doSpecularLight(vsNormal, vsPos, uView);
-	else
-	    fsResult = sampleTexture(vsPos, uNoiseScale,
+	    fsResult = doSpecularLight(normal, pos, uView);
+	else if(uPrecomputedShading == 1) {
+	    float v = 0.0;
+	    float total = 0.0;
+	    for(int i = 0; i < uNoiseOctaves; ++i) {
+		v += uNoiseAmplitudes[i] * texelFetch(uNoiseLayers[i], gl_VertexID).x;
+		total += uNoiseAmplitudes[i];
+	    }
+	    fsResult = vec3(v / total);
+	} else
+	    fsResult = sampleTexture(pos, uNoiseScale,
 	uNoiseOctaves, uNoisePersistence);
     }
 
 
-    gl_Position = uMvp * vec4(vsPos, 1.0);
+    gl_Position = uMvp * vec4(pos, 1.0);
 }
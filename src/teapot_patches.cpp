@@ -0,0 +1,99 @@
+#include "teapot_patches.hpp"
+
+/*
+  The classic data set is only one quarter of the body, lid and bottom, and
+  one half of the handle and spout, that are mirrored to make the rest. It is
+  z-up, and TEAPOT_POINTS[i] is control point i.
+*/
+static const int TEAPOT_NUM_PARTS = 10;
+
+// the first this many parts are mirrored four times, the rest twice.
+static const int TEAPOT_NUM_ROUND_PARTS = 6;
+
+static const int TEAPOT_PARTS[TEAPOT_NUM_PARTS][TEAPOT_PATCH_SIZE] = {
+    // rim
+    { 102, 103, 104, 105, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    // body
+    { 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27 },
+    { 24, 25, 26, 27, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40 },
+    // lid
+    { 96, 96, 96, 96, 97, 98, 99, 100, 101, 101, 101, 101, 0, 1, 2, 3 },
+    { 0, 1, 2, 3, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115, 116, 117 },
+    // bottom
+    { 118, 118, 118, 118, 124, 122, 119, 121, 123, 126, 125, 120, 40, 39, 38, 37 },
+    // handle
+    { 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56 },
+    { 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64, 28, 65, 66, 67 },
+    // spout
+    { 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83 },
+    { 80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95 }
+};
+
+static const float TEAPOT_POINTS[][3] = {
+    { 0.2f, 0.0f, 2.7f }, { 0.2f, -0.112f, 2.7f }, { 0.112f, -0.2f, 2.7f }, { 0.0f, -0.2f, 2.7f },
+    { 1.3375f, 0.0f, 2.53125f }, { 1.3375f, -0.749f, 2.53125f }, { 0.749f, -1.3375f, 2.53125f }, { 0.0f, -1.3375f, 2.53125f },
+    { 1.4375f, 0.0f, 2.53125f }, { 1.4375f, -0.805f, 2.53125f }, { 0.805f, -1.4375f, 2.53125f }, { 0.0f, -1.4375f, 2.53125f },
+    { 1.5f, 0.0f, 2.4f }, { 1.5f, -0.84f, 2.4f }, { 0.84f, -1.5f, 2.4f }, { 0.0f, -1.5f, 2.4f },
+    { 1.75f, 0.0f, 1.875f }, { 1.75f, -0.98f, 1.875f }, { 0.98f, -1.75f, 1.875f }, { 0.0f, -1.75f, 1.875f },
+    { 2.0f, 0.0f, 1.35f }, { 2.0f, -1.12f, 1.35f }, { 1.12f, -2.0f, 1.35f }, { 0.0f, -2.0f, 1.35f },
+    { 2.0f, 0.0f, 0.9f }, { 2.0f, -1.12f, 0.9f }, { 1.12f, -2.0f, 0.9f }, { 0.0f, -2.0f, 0.9f },
+    { -2.0f, 0.0f, 0.9f }, { 2.0f, 0.0f, 0.45f }, { 2.0f, -1.12f, 0.45f }, { 1.12f, -2.0f, 0.45f },
+    { 0.0f, -2.0f, 0.45f }, { 1.5f, 0.0f, 0.225f }, { 1.5f, -0.84f, 0.225f }, { 0.84f, -1.5f, 0.225f },
+    { 0.0f, -1.5f, 0.225f }, { 1.5f, 0.0f, 0.15f }, { 1.5f, -0.84f, 0.15f }, { 0.84f, -1.5f, 0.15f },
+    { 0.0f, -1.5f, 0.15f }, { -1.6f, 0.0f, 2.025f }, { -1.6f, -0.3f, 2.025f }, { -1.5f, -0.3f, 2.25f },
+    { -1.5f, 0.0f, 2.25f }, { -2.3f, 0.0f, 2.025f }, { -2.3f, -0.3f, 2.025f }, { -2.5f, -0.3f, 2.25f },
+    { -2.5f, 0.0f, 2.25f }, { -2.7f, 0.0f, 2.025f }, { -2.7f, -0.3f, 2.025f }, { -3.0f, -0.3f, 2.25f },
+    { -3.0f, 0.0f, 2.25f }, { -2.7f, 0.0f, 1.8f }, { -2.7f, -0.3f, 1.8f }, { -3.0f, -0.3f, 1.8f },
+    { -3.0f, 0.0f, 1.8f }, { -2.7f, 0.0f, 1.575f }, { -2.7f, -0.3f, 1.575f }, { -3.0f, -0.3f, 1.35f },
+    { -3.0f, 0.0f, 1.35f }, { -2.5f, 0.0f, 1.125f }, { -2.5f, -0.3f, 1.125f }, { -2.65f, -0.3f, 0.9375f },
+    { -2.65f, 0.0f, 0.9375f }, { -2.0f, -0.3f, 0.9f }, { -1.9f, -0.3f, 0.6f }, { -1.9f, 0.0f, 0.6f },
+    { 1.7f, 0.0f, 1.425f }, { 1.7f, -0.66f, 1.425f }, { 1.7f, -0.66f, 0.6f }, { 1.7f, 0.0f, 0.6f },
+    { 2.6f, 0.0f, 1.425f }, { 2.6f, -0.66f, 1.425f }, { 3.1f, -0.66f, 0.825f }, { 3.1f, 0.0f, 0.825f },
+    { 2.3f, 0.0f, 2.1f }, { 2.3f, -0.25f, 2.1f }, { 2.4f, -0.25f, 2.025f }, { 2.4f, 0.0f, 2.025f },
+    { 2.7f, 0.0f, 2.4f }, { 2.7f, -0.25f, 2.4f }, { 3.3f, -0.25f, 2.4f }, { 3.3f, 0.0f, 2.4f },
+    { 2.8f, 0.0f, 2.475f }, { 2.8f, -0.25f, 2.475f }, { 3.525f, -0.25f, 2.49375f }, { 3.525f, 0.0f, 2.49375f },
+    { 2.9f, 0.0f, 2.475f }, { 2.9f, -0.15f, 2.475f }, { 3.45f, -0.15f, 2.5125f }, { 3.45f, 0.0f, 2.5125f },
+    { 2.8f, 0.0f, 2.4f }, { 2.8f, -0.15f, 2.4f }, { 3.2f, -0.15f, 2.4f }, { 3.2f, 0.0f, 2.4f },
+    { 0.0f, 0.0f, 3.15f }, { 0.8f, 0.0f, 3.15f }, { 0.8f, -0.45f, 3.15f }, { 0.45f, -0.8f, 3.15f },
+    { 0.0f, -0.8f, 3.15f }, { 0.0f, 0.0f, 2.85f }, { 1.4f, 0.0f, 2.4f }, { 1.4f, -0.784f, 2.4f },
+    { 0.784f, -1.4f, 2.4f }, { 0.0f, -1.4f, 2.4f }, { 0.4f, 0.0f, 2.55f }, { 0.4f, -0.224f, 2.55f },
+    { 0.224f, -0.4f, 2.55f }, { 0.0f, -0.4f, 2.55f }, { 1.3f, 0.0f, 2.55f }, { 1.3f, -0.728f, 2.55f },
+    { 0.728f, -1.3f, 2.55f }, { 0.0f, -1.3f, 2.55f }, { 1.3f, 0.0f, 2.4f }, { 1.3f, -0.728f, 2.4f },
+    { 0.728f, -1.3f, 2.4f }, { 0.0f, -1.3f, 2.4f }, { 0.0f, 0.0f, 0.0f }, { 1.425f, -0.798f, 0.0f },
+    { 1.5f, 0.0f, 0.075f }, { 1.425f, 0.0f, 0.0f }, { 0.798f, -1.425f, 0.0f }, { 0.0f, -1.5f, 0.075f },
+    { 0.0f, -1.425f, 0.0f }, { 1.5f, -0.84f, 0.075f }, { 0.84f, -1.5f, 0.075f }
+};
+
+// the data set is 6.525 units long and 3.15 high. This scales and centers it like teapot.obj.
+static const float TEAPOT_SCALE = 0.7f;
+static const float TEAPOT_CENTER_X = 0.2625f;
+static const float TEAPOT_CENTER_Z = 1.575f;
+
+void CreateTeapotPatches(std::vector<float>& controlPoints) {
+    controlPoints.clear();
+    controlPoints.reserve(3 * TEAPOT_NUM_PATCHES * TEAPOT_PATCH_SIZE);
+
+    // every mirror flips x or y, or both. Flipping only one of them also reverses the columns, to keep the patches facing outwards.
+    static const float MIRROR[4][2] = { { 1.0f, 1.0f }, { 1.0f, -1.0f }, { -1.0f, 1.0f }, { -1.0f, -1.0f } };
+
+    for(int part = 0; part < TEAPOT_NUM_PARTS; ++part) {
+	int numMirrors = part < TEAPOT_NUM_ROUND_PARTS ? 4 : 2;
+
+	for(int m = 0; m < numMirrors; ++m) {
+	    bool reverse = MIRROR[m][0] * MIRROR[m][1] < 0.0f;
+
+	    for(int row = 0; row < 4; ++row) {
+		for(int col = 0; col < 4; ++col) {
+		    const float* p = TEAPOT_POINTS[TEAPOT_PARTS[part][4 * row + (reverse ? 3 - col : col)]];
+		    float x = MIRROR[m][0] * p[0];
+		    float y = MIRROR[m][1] * p[1];
+
+		    // z-up to y-up.
+		    controlPoints.push_back(TEAPOT_SCALE * (x - TEAPOT_CENTER_X));
+		    controlPoints.push_back(TEAPOT_SCALE * (p[2] - TEAPOT_CENTER_Z));
+		    controlPoints.push_back(TEAPOT_SCALE * -y);
+		}
+	    }
+	}
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+
+// the teapot is made of this many bicubic patches,
+static const int TEAPOT_NUM_PATCHES = 32;
+
+// of this many control points each.
+static const int TEAPOT_PATCH_SIZE = 16;
+
+/*
+  The Utah teapot as Newell made it: 32 bicubic Bezier patches, that can be
+  evaluated straight in the tessellation evaluation shader.
+
+  Writes TEAPOT_NUM_PATCHES * TEAPOT_PATCH_SIZE xyz control points. The
+  control points of a patch are in rows of four, the column is the u
+  parameter and the row the v parameter, and the patches face outwards where
+  u goes right and v goes up. The teapot is y-up and about the size of
+  teapot.obj, so the same camera works for both.
+*/
+void CreateTeapotPatches(std::vector<float>& controlPoints);
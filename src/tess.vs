@@ -1,10 +1,23 @@
 layout(location = 0) in vec3 vsPos;
 layout(location = 1) in vec3 vsNormal;
 
+// set if the vertices are in the compact format of quantize.hpp.
+uniform int uQuantized;
+uniform vec3 uBoundsMin;
+uniform vec3 uBoundsScale;
+
 out vec3 tcsPos;
 out vec3 tcsNormal;
+// the index of the vertex, with the base vertex of the draw added, that findEdge() takes.
+flat out uint tcsVertexId;
 
 void main(){
-	tcsPos = vsPos;
-	tcsNormal = vsNormal;
+	if(uQuantized == 1) {
+	    tcsPos = uBoundsMin + vsPos * uBoundsScale;
+	    tcsNormal = octDecode(vsNormal.xy);
+	} else {
+	    tcsPos = vsPos;
+	    tcsNormal = vsNormal;
+	}
+	tcsVertexId = uint(gl_VertexID);
 }
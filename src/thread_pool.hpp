@@ -0,0 +1,157 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+
+/*
+  A fixed set of worker threads, that are used for splitting up loops over
+  many elements.
+
+  The thread calling ParallelFor() also runs iterations, so ParallelFor()
+  may be called from inside of another ParallelFor() without deadlocking.
+*/
+class ThreadPool
+{
+public:
+    ThreadPool (int numThreads);
+    ~ThreadPool ();
+
+    // calls func(i) for every i in [0, count), and returns when all calls have finished.
+    inline void ParallelFor (size_t count, const std::function<void(size_t)>& func);
+
+    // worker threads plus the calling thread.
+    inline int GetNumThreads () const { return (int)m_threads.size() + 1; }
+
+private:
+    struct Job {
+	const std::function<void(size_t)>* func;
+	size_t count;
+	size_t next;     // next iteration to hand out.
+	size_t finished; // number of iterations that have finished.
+	int users;       // number of workers that are currently looking at this job.
+    };
+
+    inline void WorkerMain ();
+    // runs iterations of job until there are none left. m_mutex must be locked.
+    inline void RunIterations (Job& job, std::unique_lock<std::mutex>& lock);
+
+    // not copyable.
+    ThreadPool (const ThreadPool&);
+    ThreadPool& operator= (const ThreadPool&);
+
+    std::vector<std::thread> m_threads;
+    std::deque<Job*> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_jobFinished;
+    bool m_quit;
+};
+
+inline ThreadPool::ThreadPool (int numThreads)
+    :	m_quit(false) {
+    for(int i = 0; i < numThreads - 1; ++i) {
+	m_threads.push_back(std::thread(&ThreadPool::WorkerMain, this));
+    }
+}
+
+inline ThreadPool::~ThreadPool () {
+    {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_quit = true;
+    }
+    m_workAvailable.notify_all();
+    for(size_t i = 0; i < m_threads.size(); ++i) {
+	m_threads[i].join();
+    }
+}
+
+inline void ThreadPool::RunIterations (Job& job, std::unique_lock<std::mutex>& lock) {
+    while(job.next < job.count) {
+	size_t i = job.next++;
+
+	lock.unlock();
+	(*job.func)(i);
+	lock.lock();
+
+	if(++job.finished == job.count) {
+	    m_jobFinished.notify_all();
+	}
+    }
+}
+
+inline void ThreadPool::ParallelFor (size_t count, const std::function<void(size_t)>& func) {
+    if(count == 0) {
+	return;
+    }
+    if(count == 1 || m_threads.empty()) {
+	for(size_t i = 0; i < count; ++i) {
+	    func(i);
+	}
+	return;
+    }
+
+    Job job;
+    job.func = &func;
+    job.count = count;
+    job.next = 0;
+    job.finished = 0;
+    job.users = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobs.push_back(&job);
+    m_workAvailable.notify_all();
+
+    RunIterations(job, lock);
+
+    // wait for the iterations that workers are still running, and make sure
+    // no worker holds on to the job once it goes out of scope.
+    while(job.finished < job.count || job.users > 0) {
+	m_jobFinished.wait(lock);
+    }
+    for(std::deque<Job*>::iterator it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+	if(*it == &job) {
+	    m_jobs.erase(it);
+	    break;
+	}
+    }
+}
+
+inline void ThreadPool::WorkerMain () {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for(;;) {
+	// find a job that still has iterations to hand out.
+	Job* job = NULL;
+	for(size_t i = 0; i < m_jobs.size(); ++i) {
+	    if(m_jobs[i]->next < m_jobs[i]->count) {
+		job = m_jobs[i];
+		break;
+	    }
+	}
+
+	if(!job) {
+	    if(m_quit) {
+		return;
+	    }
+	    m_workAvailable.wait(lock);
+	    continue;
+	}
+
+	++job->users;
+	RunIterations(*job, lock);
+	--job->users;
+	m_jobFinished.notify_all();
+    }
+}
+
+/*
+  The pool that is shared by the whole program. It has one thread per core.
+*/
+inline ThreadPool& GetThreadPool() {
+    static ThreadPool pool(std::thread::hardware_concurrency() > 0 ? (int)std::thread::hardware_concurrency() : 1);
+    return pool;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+
+/*
+  Numbering of the unique keys among many, in parallel, for the loaders
+  and load time passes that have to find duplicates in millions of
+  vertices, corners or edges.
+*/
+
+// the keys are hashed and sorted into partitions in blocks of this many, that are handled in parallel.
+static const size_t UNIQUE_ID_BLOCK_SIZE = 64 * 1024;
+
+// the keys are handed out to this many partitions, that each find the unique keys of their own.
+static const int UNIQUE_ID_PARTITIONS = 64;
+
+// an empty slot of the hash table of a partition.
+static const uint32_t UNIQUE_ID_EMPTY = 0xFFFFFFFF;
+
+// the smallest power of two that is at least n.
+inline uint32_t UniqueIdTableSize(size_t n) {
+    uint32_t p = 1;
+    while(p < n)
+	p *= 2;
+    return p;
+}
+
+/*
+  Give every one of numKeys keys an id, so that equal keys get the same id,
+  and return the number of ids. hash(i) is the hash of key i, and equal(i, j)
+  tells whether keys i and j are equal. first[id] is set to the lowest key
+  that has the id, since the keys keep their order within a partition.
+
+  The keys are split into partitions by their hashes, and every partition
+  has a hash table of its own, so the partitions can be handled in parallel.
+*/
+template<typename Hash, typename Equal>
+inline size_t AssignUniqueIds(size_t numKeys, const Hash& hash, const Equal& equal, uint32_t* ids, std::vector<uint32_t>& first) {
+    ThreadPool& pool = GetThreadPool();
+    size_t numBlocks = (numKeys + UNIQUE_ID_BLOCK_SIZE - 1) / UNIQUE_ID_BLOCK_SIZE;
+
+    //
+    // Sort the keys into partitions, keeping their order within each partition.
+    //
+    std::vector<uint32_t> hashes(numKeys);
+    std::vector<size_t> blockOffsets(numBlocks * UNIQUE_ID_PARTITIONS, 0);
+    pool.ParallelFor(numBlocks, [&](size_t b) {
+	    size_t end = std::min((b + 1) * UNIQUE_ID_BLOCK_SIZE, numKeys);
+	    for(size_t i = b * UNIQUE_ID_BLOCK_SIZE; i < end; ++i) {
+		hashes[i] = hash(i);
+		++blockOffsets[b * UNIQUE_ID_PARTITIONS + hashes[i] % UNIQUE_ID_PARTITIONS];
+	    }
+	});
+
+    std::vector<size_t> partitionBegin(UNIQUE_ID_PARTITIONS + 1, 0);
+    size_t offset = 0;
+    for(int p = 0; p < UNIQUE_ID_PARTITIONS; ++p) {
+	partitionBegin[p] = offset;
+	for(size_t b = 0; b < numBlocks; ++b) {
+	    size_t count = blockOffsets[b * UNIQUE_ID_PARTITIONS + p];
+	    blockOffsets[b * UNIQUE_ID_PARTITIONS + p] = offset;
+	    offset += count;
+	}
+    }
+    partitionBegin[UNIQUE_ID_PARTITIONS] = offset;
+
+    std::vector<uint32_t> order(numKeys);
+    pool.ParallelFor(numBlocks, [&](size_t b) {
+	    size_t end = std::min((b + 1) * UNIQUE_ID_BLOCK_SIZE, numKeys);
+	    for(size_t i = b * UNIQUE_ID_BLOCK_SIZE; i < end; ++i)
+		order[blockOffsets[b * UNIQUE_ID_PARTITIONS + hashes[i] % UNIQUE_ID_PARTITIONS]++] = (uint32_t)i;
+	});
+
+    //
+    // Find the unique keys of every partition, with an open addressing hash
+    // table. The ids are local to the partition at first.
+    //
+    std::vector<std::vector<uint32_t> > partitionFirst(UNIQUE_ID_PARTITIONS);
+    pool.ParallelFor(UNIQUE_ID_PARTITIONS, [&](size_t p) {
+	    size_t begin = partitionBegin[p];
+	    size_t end = partitionBegin[p + 1];
+	    uint32_t mask = UniqueIdTableSize(2 * (end - begin)) - 1;
+	    std::vector<uint32_t> slots(mask + 1, UNIQUE_ID_EMPTY);
+
+	    for(size_t i = begin; i < end; ++i) {
+		uint32_t key = order[i];
+		// the low bits chose the partition, so the slot is chosen by the high ones.
+		uint32_t slot = (hashes[key] / UNIQUE_ID_PARTITIONS) & mask;
+		while(slots[slot] != UNIQUE_ID_EMPTY && !equal(slots[slot], key))
+		    slot = (slot + 1) & mask;
+
+		if(slots[slot] == UNIQUE_ID_EMPTY) {
+		    slots[slot] = key;
+		    ids[key] = (uint32_t)partitionFirst[p].size();
+		    partitionFirst[p].push_back(key);
+		} else {
+		    ids[key] = ids[slots[slot]];
+		}
+	    }
+	});
+
+    std::vector<size_t> idBegin(UNIQUE_ID_PARTITIONS + 1, 0);
+    for(int p = 0; p < UNIQUE_ID_PARTITIONS; ++p)
+	idBegin[p + 1] = idBegin[p] + partitionFirst[p].size();
+
+    first.resize(idBegin[UNIQUE_ID_PARTITIONS]);
+    pool.ParallelFor(UNIQUE_ID_PARTITIONS, [&](size_t p) {
+	    for(size_t i = partitionBegin[p]; i < partitionBegin[p + 1]; ++i)
+		ids[order[i]] += (uint32_t)idBegin[p];
+	    std::copy(partitionFirst[p].begin(), partitionFirst[p].end(), first.begin() + idBegin[p]);
+	});
+
+    return idBegin[UNIQUE_ID_PARTITIONS];
+}
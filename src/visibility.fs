@@ -0,0 +1,11 @@
+// the geometry pass of the visibility buffer. Only the id of the triangle is
+// written, plus one, so that 0 is left for the pixels that nothing covers.
+// The whole LOD is one draw, so gl_PrimitiveID counts from its first triangle.
+out uint triangleId;
+
+uniform uint uFirstTriangle;
+
+void main()
+{
+    triangleId = uFirstTriangle + uint(gl_PrimitiveID) + 1u;
+}
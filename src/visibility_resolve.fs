@@ -0,0 +1,81 @@
+// shades every pixel of the visibility buffer once. The triangle of the pixel
+// is read back from the mesh buffers, and the position and normal are
+// interpolated at the point where the ray through the pixel hits it.
+out vec3 color;
+
+uniform usampler2D uTriangleIds;
+uniform usamplerBuffer uIndices;          // three per triangle, with the base vertex added.
+uniform samplerBuffer uVertices;          // the interleaved vertices, two texels each.
+uniform isamplerBuffer uQuantizedVertices; // the same, when they are quantized.
+
+uniform int uQuantized;
+uniform vec3 uBoundsMin;
+uniform vec3 uBoundsScale;
+
+uniform vec2 uViewportOrigin;
+uniform vec2 uViewportSize;
+uniform mat4 uInverseMvp;
+uniform mat4 uView;
+uniform int uDrawWireframe;
+uniform int uRenderSpecular;
+uniform int uNoiseOctaves;
+uniform float uNoiseScale;
+uniform float uNoisePersistence;
+
+void loadVertex(uint v, out vec3 pos, out vec3 normal) {
+    if(uQuantized == 1) {
+	// the position is unsigned, so it is taken back out of the signed texel.
+	ivec4 p = texelFetch(uQuantizedVertices, int(2u * v));
+	ivec4 n = texelFetch(uQuantizedVertices, int(2u * v + 1u));
+	pos = uBoundsMin + vec3(uvec3(p.xyz) & 0xFFFFu) * uBoundsScale;
+	normal = octDecode(vec2(n.xy));
+    } else {
+	vec4 a = texelFetch(uVertices, int(2u * v));
+	vec4 b = texelFetch(uVertices, int(2u * v + 1u));
+	pos = a.xyz;
+	normal = vec3(a.w, b.xy);
+    }
+}
+
+void main()
+{
+    uint id = texelFetch(uTriangleIds, ivec2(gl_FragCoord.xy - uViewportOrigin), 0).r;
+    if(id == 0u)
+	discard;
+    uint triangle = id - 1u;
+
+    vec3 p[3];
+    vec3 n[3];
+    for(int k = 0; k < 3; ++k)
+	loadVertex(texelFetch(uIndices, int(3u * triangle + uint(k))).r, p[k], n[k]);
+
+    // the ray through the center of the pixel, from the near plane to the far plane.
+    vec2 ndc = 2.0 * (gl_FragCoord.xy - uViewportOrigin) / uViewportSize - 1.0;
+    vec4 nearPoint = uInverseMvp * vec4(ndc, -1.0, 1.0);
+    vec4 farPoint = uInverseMvp * vec4(ndc, 1.0, 1.0);
+    vec3 origin = nearPoint.xyz / nearPoint.w;
+    vec3 direction = farPoint.xyz / farPoint.w - origin;
+
+    // the barycentrics of where it hits the plane of the triangle, with Moller and Trumbore's method.
+    vec3 e1 = p[1] - p[0];
+    vec3 e2 = p[2] - p[0];
+    vec3 pv = cross(direction, e2);
+    vec3 tv = origin - p[0];
+    vec3 qv = cross(tv, e1);
+    float invDet = 1.0 / dot(e1, pv);
+    float u = dot(tv, pv) * invDet;
+    float v = dot(direction, qv) * invDet;
+    vec3 b = vec3(1.0 - u - v, u, v);
+
+    vec3 pos = b.x * p[0] + b.y * p[1] + b.z * p[2];
+    vec3 normal = b.x * n[0] + b.y * n[1] + b.z * n[2];
+
+    if(uRenderSpecular == 1)
+	color = doSpecularLight(normal, pos, uView);
+    else
+	color = sampleTexture(pos, uNoiseScale, uNoiseOctaves, uNoisePersistence);
+
+    if(uDrawWireframe==1) {
+	color = vec3(1.0);
+    }
+}